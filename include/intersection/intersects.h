@@ -10,6 +10,9 @@
 /** @brief modifies given RTCRayHit object to be ready for rtcIntersect1 usage */
 void setupRayHit1(struct RTCRayHit& rayhit, const ray& r);
 
+/** @brief modifies given RTCRay to test r for occlusion up to tfar with rtcOccluded1 */
+void setupShadowRay1(struct RTCRay& shadow, const ray& r, float tfar);
+
 /** @brief modifies given RTCRayHit object to be ready for rtcIntersect4 usage*/
 void setupRayHit4(struct RTCRayHit4& rayhit, std::vector<ray>& rays);
 
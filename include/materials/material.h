@@ -4,6 +4,7 @@
 #include "general.h"
 #include "hit_info.hh"
 #include "texture.h"
+#include "material_table.hh"
 
 class hit_record;
 
@@ -15,6 +16,9 @@ class material {
         }
 
         virtual bool scatter(const ray& r_in, const HitInfo& rec, color& attenuation, ray& scattered) const = 0;
+
+        /** @brief Appends this material (and its textures) to table, returning its id. See material_table.hh. */
+        virtual uint32_t compile(MaterialTable& table) const = 0;
 };
 
 class lambertian : public material {
@@ -36,6 +40,10 @@ class lambertian : public material {
             return true;
         }
 
+        virtual uint32_t compile(MaterialTable& table) const override {
+            return table.addMaterial(MaterialKind::Lambertian, color(0,0,0), 0, table.add(albedo));
+        }
+
     private:
     shared_ptr<texture> albedo;
 };
@@ -58,6 +66,10 @@ class hemispheric : public material {
             return true;
         }
 
+        virtual uint32_t compile(MaterialTable& table) const override {
+            return table.addMaterial(MaterialKind::Hemispheric, albedo);
+        }
+
     public:
 
         color albedo;
@@ -77,6 +89,10 @@ class metal : public material {
             return (dot(scattered.direction(), rec.normal) > 0);
         }
 
+        virtual uint32_t compile(MaterialTable& table) const override {
+            return table.addMaterial(MaterialKind::Metal, albedo, fuzz);
+        }
+
     public:
 
         color albedo;
@@ -109,7 +125,10 @@ class dielectric : public material {
             scattered = ray(rec.pos, direction, r_in.time());
             return true;
         }
-        
+
+        virtual uint32_t compile(MaterialTable& table) const override {
+            return table.addMaterial(MaterialKind::Dielectric, color(1,1,1), ir);
+        }
 
     public:
 
@@ -152,6 +171,10 @@ class pixel_lambertian : public material {
             return true;
         }
 
+        virtual uint32_t compile(MaterialTable& table) const override {
+            return table.addMaterial(MaterialKind::PixelLambertian, color(0,0,0), 0, table.add(std::static_pointer_cast<texture>(albedo)));
+        }
+
     private:
     shared_ptr<PixelImageTexture> albedo;
 };
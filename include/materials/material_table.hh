@@ -0,0 +1,218 @@
+#ifndef MATERIAL_TABLE_H
+#define MATERIAL_TABLE_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "hit_info.hh"
+#include "texture.h"
+#include "sampler.hh"
+
+class material;
+class Geometry;
+
+// MATERIAL TABLE
+// The material and texture classes describe a scene as it is parsed. Scene::commitScene() compiles
+// everything its geometries reference into this table, and the renderers only ever read the table:
+// => Materials and textures become small integer ids into tagged structure-of-arrays storage.
+// => scatter() and emitted() switch on the kind tag instead of calling through a vtable, and are
+//    defined here so they inline into the render loops.
+// => Checker textures store their children as ids and are walked in a loop rather than recursively.
+// => Geometry ids map to material ids, with per-face indices for meshes, so a hit resolves its material
+//    without touching the geometry object.
+// Image and noise textures point at the pixel data / permutation tables owned by the texture objects,
+// which the table keeps alive.
+
+enum class MaterialKind : uint8_t { Lambertian, Hemispheric, Metal, Dielectric, PixelLambertian, Emissive };
+enum class TextureKind : uint8_t { Solid, Checker, Noise, Image, PixelImage };
+
+class MaterialTable {
+
+    public:
+
+        static const uint32_t NO_TEXTURE = 0xffffffff;
+
+        /** @brief Clears the table and compiles the materials of every geometry in geom_map. */
+        void compile(const std::map<unsigned int, std::shared_ptr<Geometry>>& geom_map);
+
+        /** @brief Returns the id of m, compiling it (and its textures) on first use. */
+        uint32_t add(const std::shared_ptr<material>& m);
+        uint32_t add(const std::shared_ptr<texture>& t);
+
+        // Called by material::compile() and texture::compile() to append their compiled form.
+        uint32_t addMaterial(MaterialKind kind, color albedo, double param = 0, uint32_t tex = NO_TEXTURE);
+        uint32_t addSolid(color c);
+        uint32_t addChecker(double inv_scale, uint32_t even, uint32_t odd);
+        uint32_t addNoise(const perlin* noise, double scale);
+        uint32_t addImage(const image* img, bool alpha);
+
+        /**
+         * @brief Maps geomID to materials. With faces, triangle primID uses materials[faces[primID]]
+         * (out of range indices use the last material); otherwise every hit uses materials[0].
+        */
+        void bindGeometry(unsigned int geomID, const std::vector<std::shared_ptr<material>>& materials,
+                            const uint32_t* faces = nullptr, size_t face_count = 0);
+
+        size_t materialCount() const { return kind.size(); }
+        size_t textureCount() const { return tex_kind.size(); }
+
+        /** @brief Material id of a hit on geomID / primID. */
+        uint32_t lookup(unsigned int geomID, unsigned int primID) const {
+            const GeometryBinding& b = bindings[geomID];
+            if (b.faces == nullptr || primID >= b.face_count) return slots[b.first];
+            uint32_t index = b.faces[primID];
+            return slots[b.first + (index < b.count ? index : b.count - 1)];
+        }
+
+        /** @brief True if id scatters into the cosine-weighted lobe around the normal with its albedo as attenuation. */
+        bool isDiffuse(uint32_t id) const { return kind[id] == MaterialKind::Lambertian; }
+
+        bool isEmissive(uint32_t id) const { return kind[id] == MaterialKind::Emissive; }
+
+        color emitted(uint32_t id, double u, double v, const point3& p) const {
+            return kind[id] == MaterialKind::Emissive ? albedo[id] : color(0, 0, 0);
+        }
+
+        /** @brief Scatters r_in off material id, taking every random decision from sample. False if the path ends. */
+        bool scatter(uint32_t id, const ray& r_in, const HitInfo& rec, const ScatterSample& sample, color& attenuation, ray& scattered) const {
+            switch (kind[id]) {
+                case MaterialKind::Lambertian: {
+                    auto scatter_direction = rec.normal + sample_unit_vector(sample.u, sample.v);
+                    if (scatter_direction.near_zero()) scatter_direction = rec.normal;
+                    scattered = ray(rec.pos, scatter_direction, r_in.time());
+                    attenuation = albedo_texture[id] == NO_TEXTURE ? albedo[id] : value(albedo_texture[id], rec.u, rec.v, rec.pos);
+                    return true;
+                }
+                case MaterialKind::Hemispheric: {
+                    auto scatter_direction = sample_in_hemisphere(rec.normal, sample.u, sample.v);
+                    if (scatter_direction.near_zero()) scatter_direction = rec.normal;
+                    scattered = ray(rec.pos, scatter_direction, r_in.time());
+                    attenuation = albedo[id];
+                    return true;
+                }
+                case MaterialKind::Metal: {
+                    vec3 reflected = reflect(r_in.direction().unit_vector(), rec.normal);
+                    scattered = ray(rec.pos, reflected + param[id]*sample_in_unit_sphere(sample.u, sample.v, sample.w), r_in.time());
+                    attenuation = albedo[id];
+                    return (dot(scattered.direction(), rec.normal) > 0);
+                }
+                case MaterialKind::Dielectric: {
+                    attenuation = color(1.0, 1.0, 1.0);
+                    double ir = param[id];
+                    double refraction_ratio = rec.front_face ? (1.0/ir) : ir;
+
+                    vec3 unit_direction = r_in.direction().unit_vector();
+                    double cos_theta = fmin(dot(-unit_direction, rec.normal), 1.0);
+                    double sin_theta = sqrt(1.0 - cos_theta*cos_theta);
+
+                    vec3 direction;
+                    if (refraction_ratio * sin_theta > 1.0 || reflectance(cos_theta, refraction_ratio) > sample.w) {
+                        direction = reflect(unit_direction, rec.normal);
+                    } else {
+                        direction = refract(unit_direction, rec.normal, refraction_ratio);
+                    }
+                    scattered = ray(rec.pos, direction, r_in.time());
+                    return true;
+                }
+                case MaterialKind::PixelLambertian: {
+                    float t = sample.w;
+                    color4 val = valueRGBA(albedo_texture[id], rec.u, rec.v, rec.pos);
+                    if (t > val.A) {
+                        scattered = ray(rec.pos, r_in.direction(), 0.0);
+                        attenuation = color(1.0, 1.0, 1.0);
+                    } else {
+                        auto scatter_direction = rec.normal + sample_unit_vector(sample.u, sample.v);
+                        if (scatter_direction.near_zero()) scatter_direction = rec.normal;
+                        scattered = ray(rec.pos, scatter_direction, r_in.time());
+                        attenuation = val.RGB;
+                    }
+                    return true;
+                }
+                case MaterialKind::Emissive:
+                default:
+                    return false;
+            }
+        }
+
+        /** @brief Colour of texture id at (u, v) / p. */
+        color value(uint32_t id, double u, double v, const point3& p) const {
+            while (tex_kind[id] == TextureKind::Checker) {
+                auto xInteger = static_cast<int>(std::floor(tex_scale[id] * p.x()));
+                auto yInteger = static_cast<int>(std::floor(tex_scale[id] * p.y()));
+                auto zInteger = static_cast<int>(std::floor(tex_scale[id] * p.z()));
+                id = (xInteger + yInteger + zInteger) % 2 == 0 ? tex_even[id] : tex_odd[id];
+            }
+            switch (tex_kind[id]) {
+                case TextureKind::Noise: {
+                    auto s = tex_scale[id] * p;
+                    return color(1,1,1) * 0.5 * (1 + sin(s.z() + 10*tex_noise[id]->turb(s)));
+                }
+                case TextureKind::Image:
+                case TextureKind::PixelImage: {
+                    if (tex_image[id]->height() <= 0) return color(0,1,1); // solid cyan as a debugging aid
+                    auto pixel = image_texel(*tex_image[id], u, v);
+                    auto color_scale = 1.0 / 255.0;
+                    return color(color_scale*pixel[0], color_scale*pixel[1], color_scale*pixel[2]);
+                }
+                case TextureKind::Solid:
+                default:
+                    return tex_color[id];
+            }
+        }
+
+        /** @brief Colour and alpha of texture id. Only PixelImage textures carry alpha; others are opaque. */
+        color4 valueRGBA(uint32_t id, double u, double v, const point3& p) const {
+            if (tex_kind[id] != TextureKind::PixelImage || tex_image[id]->height() <= 0) return color4{ 1.0, value(id, u, v, p) };
+            auto pixel = image_texel(*tex_image[id], u, v);
+            auto color_scale = 1.0 / 255.0;
+            return color4 {
+                static_cast<float>(color_scale)*pixel[3],
+                color(color_scale*pixel[0], color_scale*pixel[1], color_scale*pixel[2]),
+            };
+        }
+
+    private:
+
+        struct GeometryBinding {
+            uint32_t first = 0;             // index into slots
+            uint32_t count = 1;
+            const uint32_t* faces = nullptr;
+            size_t face_count = 0;
+        };
+
+        // Materials
+        std::vector<MaterialKind> kind;
+        std::vector<color> albedo;      // LAMBERTIAN without texture, HEMISPHERIC, METAL albedo; EMISSIVE emission
+        std::vector<double> param;      // METAL fuzz, DIELECTRIC index of refraction
+        std::vector<uint32_t> albedo_texture;  // LAMBERTIAN, PIXELLAMBERTIAN, or NO_TEXTURE
+
+        // Textures
+        std::vector<TextureKind> tex_kind;
+        std::vector<color> tex_color;           // SOLID
+        std::vector<double> tex_scale;          // CHECKER inverse scale, NOISE scale
+        std::vector<uint32_t> tex_even;         // CHECKER children
+        std::vector<uint32_t> tex_odd;
+        std::vector<const perlin*> tex_noise;   // NOISE
+        std::vector<const image*> tex_image;    // IMAGE, PIXELIMAGE
+
+        // Geometry ids
+        std::vector<GeometryBinding> bindings;  // indexed by geomID
+        std::vector<uint32_t> slots;            // material ids referenced by bindings
+
+        std::unordered_map<const material*, uint32_t> material_ids;
+        std::unordered_map<const texture*, uint32_t> texture_ids;
+        std::vector<std::shared_ptr<const void>> sources; // every compiled material and texture, which own image and noise data
+
+        uint32_t addTexture(TextureKind kind);
+
+        // Christophe Schlick's approximation (probability of reflectance)
+        static double reflectance(double cosine, double ref_idx) {
+            auto r0 = (1 - ref_idx) / (1 + ref_idx);
+            r0 = r0 * r0;
+            return r0 + (1 - r0) * pow((1 - cosine), 5);
+        }
+};
+
+#endif
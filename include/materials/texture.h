@@ -5,13 +5,21 @@
 #include "image.hh"
 #include "perlin.h"
 
+class MaterialTable;
+
 class texture {
   public:
     virtual ~texture() = default;
 
     virtual color value(double u, double v, const point3& p) const = 0;
+
+    /** @brief Appends this texture (and any textures it references) to table, returning its id. */
+    virtual uint32_t compile(MaterialTable& table) const = 0;
 };
 
+/** @brief Pixel of img at texture coordinates (u, v), clamped to [0,1] with v flipped to image rows. */
+const unsigned char* image_texel(const image& img, double u, double v);
+
 class noise_texture : public texture {
   public:
     noise_texture();
@@ -19,6 +27,7 @@ class noise_texture : public texture {
     noise_texture(double sc);
 
     color value(double u, double v, const point3& p) const override;
+    uint32_t compile(MaterialTable& table) const override;
 
   private:
     perlin noise;
@@ -32,6 +41,7 @@ class solid_color : public texture {
     solid_color(double red, double green, double blue);
    
     color value(double u, double v, const point3& p) const override;
+    uint32_t compile(MaterialTable& table) const override;
 
   private:
     color color_value;
@@ -43,6 +53,7 @@ class checker_texture : public texture {
     checker_texture(double _scale, color c1, color c2);
 
     color value(double u, double v, const point3& p) const override;
+    uint32_t compile(MaterialTable& table) const override;
 
   private:
     double inv_scale;
@@ -54,7 +65,12 @@ class image_texture : public texture {
   public:
     image_texture(const char* filename);
 
+    // Creates the texture without pixel data; call load() (possibly from another thread) before rendering.
+    image_texture();
+    void load(const char* filename);
+
     color value(double u, double v, const point3& p) const;
+    uint32_t compile(MaterialTable& table) const override;
 
   private:
     image image_data;
@@ -69,9 +85,14 @@ class PixelImageTexture : public texture {
   public:
   PixelImageTexture(const char* filename);
 
+  // Creates the texture without pixel data; call load() (possibly from another thread) before rendering.
+  PixelImageTexture();
+  void load(const char* filename);
+
   color value(double u, double v, const point3& p) const; // should never be used, its simply purely virtual above
 
   color4 value(double u, double v) const;
+  uint32_t compile(MaterialTable& table) const override;
 
   private:
     image img;
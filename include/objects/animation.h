@@ -0,0 +1,33 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <vector>
+#include "camera.h"
+
+// ANIMATION INTERFACE
+// Keyframe tracks read from Keyframe[...] blocks. Frames are numbered 0, 1, 2, ...; keys may sit on any
+// frame (including fractional ones) and values are interpolated linearly between them, holding the first
+// and last key's value outside their range.
+
+struct CameraKeyframe {
+    double frame;
+    point3 lookfrom;
+    point3 lookat;
+    vec3 vup;
+    double vfov;
+    double aperture;
+    double focus_dist;
+};
+
+struct PositionKeyframe {
+    double frame;
+    vec3 position; // sphere center, or instance translation
+};
+
+/** @brief Position track value at frame. keys must be sorted by frame and non-empty. */
+vec3 interpolate(const std::vector<PositionKeyframe>& keys, double frame);
+
+/** @brief Camera for frame. keys must be sorted by frame and non-empty; aspect_ratio is not animated. */
+Camera interpolate(const std::vector<CameraKeyframe>& keys, double frame, double aspect_ratio);
+
+#endif
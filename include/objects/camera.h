@@ -30,7 +30,26 @@ class Camera : Base {
 
         ray get_ray(double s, double t) const;
 
+        /** @brief As above, with the point on the aperture given by (lens_u, lens_v) in [0,1)^2 instead of drawn at random. */
+        ray get_ray(double s, double t, double lens_u, double lens_v) const;
+
+        // Construction parameters, kept so a camera can be rebuilt with some of them overridden.
+        point3 getLookfrom() const;
+        point3 getLookat() const;
+        vec3 getVup() const;
+        double getVfov() const;
+        double getAspectRatio() const;
+        double getAperture() const;
+        double getFocusDist() const;
+
     private:
+        point3 lookat;
+        vec3 vup;
+        double vfov;
+        double aspect_ratio;
+        double aperture;
+        double focus_dist;
+
         point3 lower_left_corner;
         vec3 horizontal;
         vec3 vertical;
@@ -0,0 +1,84 @@
+#ifndef ENVIRONMENT_H
+#define ENVIRONMENT_H
+
+#include <string>
+#include <vector>
+#include "alias_table.hh"
+#include "vec3.h"
+#include "color.h"
+
+// ENVIRONMENT
+// Radiance arriving from infinitely far away, seen by every ray that leaves the scene.
+// => GradientSky is the renderer's original blue-white sky. It is cheap to hit by chance, so it is not sampled.
+// => ImageEnvironment is an equirectangular (latitude-longitude) image, HDR or LDR. When it loads, a 2D
+//    piecewise-constant distribution proportional to luminance * sin(theta) is built from alias tables: one
+//    over the rows and one per row over its pixels, so a direction is drawn in O(1) with two table reads.
+// Environments that canSample() are also sampled directly at diffuse hits, and the renderer combines that
+// light sample with the BSDF sample by multiple importance sampling.
+
+class Environment {
+
+    public:
+
+        virtual ~Environment() = default;
+
+        /** @brief Radiance arriving along -direction (direction need not be unit length). */
+        virtual color radiance(const vec3& direction) const = 0;
+
+        /** @brief True if sample() and pdf() are implemented, so the environment can be light sampled. */
+        virtual bool canSample() const { return false; }
+
+        /**
+         * @brief Draws a unit direction towards the environment from (u, v) in [0,1)^2, returning its radiance.
+         * pdf is the solid angle density of the direction, 0 if the direction cannot be used.
+        */
+        virtual color sample(double u, double v, vec3& direction, double& pdf) const;
+
+        /** @brief Solid angle density with which sample() returns the given unit direction. */
+        virtual double pdf(const vec3& direction) const { return 0; }
+};
+
+/** @brief Lerp from white straight down to light blue straight up. */
+class GradientSky : public Environment {
+    public:
+        color radiance(const vec3& direction) const override;
+};
+
+/**
+ * @brief Equirectangular environment map. Image row 0 is straight up (+y), the centre column looks along +x
+ * and columns to its right turn towards +z.
+*/
+class ImageEnvironment : public Environment {
+
+    public:
+
+        explicit ImageEnvironment(double intensity = 1.0);
+
+        /**
+         * @brief Decodes the image (Radiance .hdr as is, 8-bit formats linearised by stb_image) and builds the
+         * sampling tables. @throws std::runtime_error if the file cannot be read.
+        */
+        void load(const std::string& path);
+
+        color radiance(const vec3& direction) const override;
+        bool canSample() const override { return width > 0; }
+        color sample(double u, double v, vec3& direction, double& pdf) const override;
+        double pdf(const vec3& direction) const override;
+
+        int imageWidth() const { return width; }
+        int imageHeight() const { return height; }
+
+    private:
+
+        double intensity;
+        int width = 0;
+        int height = 0;
+        std::vector<color> pixels;          // row major, already scaled by intensity
+        AliasTable rows;                    // marginal over rows
+        std::vector<AliasTable> columns;    // conditional over the pixels of each row
+
+        /** @brief Pixel (x, y) looked up by direction. */
+        void pixelOf(const vec3& direction, int& x, int& y) const;
+};
+
+#endif
@@ -4,6 +4,8 @@
 #include "visual.h"
 #include "material.h"
 #include "hit_info.hh"
+#include "light_bvh.h"
+#include <vector>
 #include <embree4/rtcore.h>
 
 /**
@@ -23,6 +25,24 @@ class Geometry : public Visual {
      * @return HitInfo A structure containing details about the intersection (e.g., hit point, normal at the hit, material properties).
      */
     virtual HitInfo getHitInfo(const ray& r, const vec3& p, const float t, unsigned int geomID) const = 0;
+
+    /**
+     * @brief Same as above, for geometries made of many Embree primitives (e.g. a triangle mesh) where the
+     * material and surface depend on which primitive was hit. Renderers pass the hit's primID.
+     * Defaults to ignoring primID.
+     */
+    virtual shared_ptr<material> materialById(unsigned int geomID, unsigned int primID) const { return materialById(geomID); }
+    virtual HitInfo getHitInfo(const ray& r, const vec3& p, const float t, unsigned int geomID, unsigned int primID) const {
+        return getHitInfo(r, p, t, geomID);
+    }
+
+    /** @brief Registers this geometry's material(s) under geomID in a scene's compiled MaterialTable. */
+    virtual void bindMaterials(MaterialTable& table, unsigned int geomID) const {
+        table.bindGeometry(geomID, { materialById(geomID) });
+    }
+
+    /** @brief Appends the surfaces of this geometry that use an emissive material in table to lights, in world space. */
+    virtual void collectLights(const MaterialTable& table, unsigned int geomID, std::vector<LightShape>& lights) const {}
 };
 
 #endif
\ No newline at end of file
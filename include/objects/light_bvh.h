@@ -0,0 +1,91 @@
+#ifndef LIGHT_BVH_H
+#define LIGHT_BVH_H
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "vec3.h"
+#include "color.h"
+
+// LIGHT BVH
+// Scenes lit by thousands of small emitters (windows, lamps) can neither rely on paths hitting them by chance
+// nor pick one uniformly, since almost every pick barely reaches the shading point. Scene::commitScene()
+// collects every emissive quad, sphere and mesh triangle (Geometry::collectLights) and builds a binary tree:
+// => Every node stores the bounds, an orientation cone (the spread of the emitters' normals) and the total
+//    power of the lights under it.
+// => pick() walks down from the root and at each node takes a child with probability proportional to its
+//    estimated contribution at the shading point: power over squared distance, reduced by how far the cone
+//    turns away from the point and by the point's own cosine (Conty Estevez and Kulla 2018).
+// => pmf() repeats the walk for a known light through the branch bits stored with it, which MIS needs when
+//    a BSDF-sampled ray hits an emitter.
+// The emissive material emits from both faces, so planar emitters are treated as two-sided.
+
+/** @brief One emissive surface in world space, keyed by the geomID (scene attachment id) and primID of its hits. */
+struct LightShape {
+    enum Type : uint8_t { Quad, Triangle, Sphere };
+
+    Type type;
+    point3 p;           // QUAD corner, TRIANGLE first vertex, SPHERE centre
+    vec3 e1, e2;        // QUAD and TRIANGLE edges from p
+    double radius = 0;  // SPHERE
+    color emission;
+    unsigned int geomID, primID;
+
+    static LightShape quad(const point3& p, const vec3& u, const vec3& v, const color& emission, unsigned int geomID, unsigned int primID = 0);
+    static LightShape triangle(const point3& a, const point3& b, const point3& c, const color& emission, unsigned int geomID, unsigned int primID);
+    static LightShape sphere(const point3& center, double radius, const color& emission, unsigned int geomID, unsigned int primID = 0);
+
+    double area() const;
+
+    /** @brief Point drawn uniformly over the surface from (u, v) in [0,1)^2, and its unit (outward) normal. */
+    point3 sample(double u, double v, vec3& normal) const;
+};
+
+class LightBVH {
+
+    public:
+
+        /** @brief Replaces the tree with one over lights (which may be empty). */
+        void build(std::vector<LightShape> lights);
+
+        bool empty() const { return lights.empty(); }
+        size_t size() const { return lights.size(); }
+
+        /**
+         * @brief Chooses a light for the shading point p with normal n from u in [0,1). pmf is its probability and
+         * remapped a fresh uniform number left over from u. Returns nullptr if no light can reach p.
+        */
+        const LightShape* pick(const point3& p, const vec3& n, double u, double& remapped, double& pmf) const;
+
+        /** @brief The light of a hit on geomID / primID, or nullptr; pmf is what pick() at (p, n) would give it. */
+        const LightShape* find(unsigned int geomID, unsigned int primID, const point3& p, const vec3& n, double& pmf) const;
+
+        /** @brief Memory held by the nodes, lights and hit lookup. */
+        size_t memoryBytes() const;
+
+        double build_seconds = 0;   // time spent in the last build()
+
+    private:
+
+        // Children of an interior node are at index + 1 and at second. Leaves hold exactly one light.
+        struct Node {
+            float lower[3], upper[3];
+            float axis[3];
+            float cos_theta_o;  // cone half angle around axis; -1 when the node emits in every direction
+            float power;
+            uint32_t second;    // interior: index of the right child; leaf: index into lights
+            uint32_t leaf;
+        };
+
+        std::vector<Node> nodes;
+        std::vector<LightShape> lights;
+        std::vector<uint64_t> trails;   // per light: bit d set if the path from the root turns right at depth d
+        std::unordered_map<uint64_t, uint32_t> by_hit;  // (geomID << 32 | primID) -> light
+
+        uint32_t buildRange(std::vector<uint32_t>& order, size_t begin, size_t end, int depth, uint64_t trail);
+        static Node leafNode(const LightShape& light);
+        static Node merge(const Node& a, const Node& b);
+        static double importance(const Node& node, const point3& p, const vec3& n);
+};
+
+#endif
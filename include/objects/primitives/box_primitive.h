@@ -18,6 +18,7 @@ class BoxPrimitive : public Primitive {
     shared_ptr<material> materialById(unsigned int geomID) const override;
 
     HitInfo getHitInfo(const ray& r, const vec3& p, const float t, unsigned int geomID) const;
+    void collectLights(const MaterialTable& table, unsigned int geomID, std::vector<LightShape>& lights) const override;
 
     vec3 getA();
     vec3 getB();
@@ -0,0 +1,40 @@
+#ifndef MESH_PRIMITIVE_H
+#define MESH_PRIMITIVE_H
+
+#include <vector>
+#include "primitive.h"
+#include "mesh_parser.hh"
+
+// MESHPRIMITIVE INTERFACE
+// A triangle mesh loaded from a PLY or OBJ file. Every triangle is one Embree primitive (primID),
+// and each triangle can use its own material through the mesh's per-face material indices.
+
+class MeshPrimitive : public Primitive {
+    public:
+    std::vector<shared_ptr<material>> materials;
+
+    /**
+     * @brief Binds the mesh's vertex and index arrays to a triangle geometry without copying them.
+     * face_materials entries index into materials (out of range entries use the last material).
+     * @note The MeshData (and the mapping it keeps alive) is stored in the primitive.
+    */
+    MeshPrimitive(MeshData mesh, std::vector<shared_ptr<material>> materials, RTCDevice device);
+
+    size_t triangleCount() const;
+
+    shared_ptr<material> materialById(unsigned int geomID) const override;
+    shared_ptr<material> materialById(unsigned int geomID, unsigned int primID) const override;
+
+    HitInfo getHitInfo(const ray& r, const vec3& p, const float t, unsigned int geomID) const override;
+    HitInfo getHitInfo(const ray& r, const vec3& p, const float t, unsigned int geomID, unsigned int primID) const override;
+
+    void bindMaterials(MaterialTable& table, unsigned int geomID) const override;
+    void collectLights(const MaterialTable& table, unsigned int geomID, std::vector<LightShape>& lights) const override;
+
+    private:
+    MeshData mesh;
+
+    vec3 vertex(uint32_t index) const;
+};
+
+#endif
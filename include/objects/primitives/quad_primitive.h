@@ -17,9 +17,16 @@ class QuadPrimitive : public Primitive {
 
         QuadPrimitive(const point3& position, const vec3& _u, const vec3& _v, shared_ptr<material> mat_ptr, RTCDevice device);
 
+        /**
+         * @brief Builds the quad on top of existing vertex (p, p+u, p+u+v, p+v) and index buffers without copying them.
+         * @note Both buffers must stay valid (e.g. inside a MappedFile) for as long as the geometry is in use.
+        */
+        QuadPrimitive(const Vertex3f* shared_vertices, const Quad* shared_index, shared_ptr<material> mat_ptr, RTCDevice device);
+
         shared_ptr<material> materialById(unsigned int geomID) const override;
 
         HitInfo getHitInfo(const ray& r, const vec3& p, const float t, unsigned int geomID) const override;
+        void collectLights(const MaterialTable& table, unsigned int geomID, std::vector<LightShape>& lights) const override;
 
         vec3 getV();
         vec3 getU();
@@ -12,9 +12,22 @@ class SpherePrimitive : public Primitive {
 
     SpherePrimitive(vec3 position, shared_ptr<material> mat_ptr, double radius, RTCDevice device);
 
+    /**
+     * @brief Builds the sphere on top of an existing float4 (x, y, z, radius) vertex without copying it.
+     * @note shared_vertex must stay valid (e.g. inside a MappedFile) for as long as the geometry is in use.
+    */
+    SpherePrimitive(const float* shared_vertex, shared_ptr<material> mat_ptr, RTCDevice device);
+
+    /**
+     * @brief Moves the sphere and marks its geometry for a refit on the next scene commit.
+     * @note Only for spheres built with their own vertex buffer (the first constructor), not shared ones.
+    */
+    void setCenter(const point3& center);
+
     shared_ptr<material> materialById(unsigned int geomID) const override;
 
     HitInfo getHitInfo(const ray& r, const vec3& p, const float t, unsigned int geomID) const override;
+    void collectLights(const MaterialTable& table, unsigned int geomID, std::vector<LightShape>& lights) const override;
 
     private:
     static void get_sphere_uv(const point3& p, double& u, double& v);
@@ -0,0 +1,31 @@
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include <string>
+#include "render.h"
+#include "cli_parser.hh"
+
+// AUTOTUNING
+// The fastest -Vx, thread count and tiles per thread depend on the scene and the machine: packets lose on
+// incoherent glass, small images do not feed many threads. --autotune times short pilot renders instead of guessing:
+// => The pilot renders the image scaled down to at most PILOT_PIXELS pixels, at 1 sample per pixel, doubled
+//    until the default configuration takes a measurable time (or the render's own spp is reached).
+// => Every candidate is rendered twice and keeps its faster time: vectorization 0, 4 and 8 (only 0 when
+//    --split, --radiance-cache or --guide need the scalar integrator), 1 thread without the pool, then 2, 4, ...
+//    and all pool workers, each with 1, 4 and 16 tiles per thread.
+// => The fastest is written into the config; with --autotune-cache it is also stored under the scene file's
+//    hash, the host and the resolution, and later runs with the same key reuse it without timing anything.
+
+struct TuneChoice {
+    int vectorization = 0;
+    bool multithreading = false;
+    int threads = 1;            // workers used; 1 without multithreading
+    int tiles_per_thread = 4;
+    double seconds = 0;         // pilot time of the choice, 0 if read from the cache
+    bool cached = false;
+};
+
+/** @brief Picks the fastest configuration for the scene and applies it to config. Reports it on stderr. */
+TuneChoice autotune(RenderData& render_data, Camera& cam, std::shared_ptr<Scene> scene_ptr, Config& config);
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef DENOISER_H
+#define DENOISER_H
+
+#include <string>
+#include <vector>
+#include "render.h"
+
+// DENOISER
+// Edge-avoiding a-trous wavelet filter (Dammertz et al. 2010) run on the float framebuffer after rendering,
+// guided by the first-hit albedo, normal and depth the integrators write into RenderData::aovs:
+// => The image is divided by the albedo first, so texture detail is not blurred, only the lighting, and
+//    multiplied back at the end.
+// => Every iteration applies the 5x5 B3 spline kernel with holes, its taps 2^i pixels apart, so five
+//    iterations cover 125x125 pixels at 25 taps each. Each tap is weighted down by how much its lighting,
+//    normal, depth and albedo differ from the centre pixel's; the lighting tolerance halves every iteration.
+// => Pixels are stored as one float plane per channel, padded left and right with copies of the border so
+//    every tap reads a whole row without bounds checks. The tap loops run over 8 adjacent pixels at a time with
+//    no branches or calls (the weight falloff is rational, not exp), which the compiler turns into SIMD code.
+// => Rows are split into blocks over the shared thread pool, one iteration after another.
+
+enum class DenoiseQuality { Off, Fast, Balanced, High };
+
+/** @brief Quality preset of a --denoise name. @throws std::invalid_argument for unknown names. */
+DenoiseQuality parseDenoiseQuality(const std::string& name);
+
+std::string denoiseQualityName(DenoiseQuality quality);
+
+class Denoiser {
+
+    public:
+
+        explicit Denoiser(DenoiseQuality quality);
+
+        /**
+         * @brief Filters render_data.buffer in place. The buffer and the albedo, normal and depth layers of
+         * render_data.aovs hold sums over samples_per_pixel samples, and the result is scaled back the same way.
+         * @throws std::invalid_argument if those layers were not rendered.
+        */
+        void apply(RenderData& render_data, bool multithreaded);
+
+        double seconds = 0; // time spent in the last apply()
+
+    private:
+
+        struct Settings {
+            int iterations;
+            float sigma_color;  // lighting tolerance of the first iteration, relative to the mean luminance
+            float sigma_normal;
+            float sigma_depth;  // relative to the centre pixel's depth
+            float sigma_albedo;
+        };
+        Settings settings;
+
+        int width = 0, height = 0;
+        int pad = 0;        // copies of the border on each side of a row, a multiple of 8
+        int stride = 0;     // floats per padded row
+
+        // Planes of stride * height floats: the lighting being filtered, and the guides.
+        std::vector<float> light[3], filtered[3], albedo[3], normal[3], depth;
+
+        float* row(std::vector<float>& plane, int y) { return plane.data() + static_cast<size_t>(y) * stride + pad; }
+
+        /** @brief Copies the first and last pixel of row y of plane into its padding. */
+        void padRow(std::vector<float>& plane, int y);
+
+        /** @brief One a-trous iteration over rows [first, last) from light into filtered. */
+        void filterRows(int first, int last, int step, float inv_sigma_color);
+};
+
+#endif
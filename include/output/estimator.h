@@ -0,0 +1,51 @@
+#ifndef ESTIMATOR_H
+#define ESTIMATOR_H
+
+#include <ostream>
+#include "render.h"
+#include "cli_parser.hh"
+
+// RENDER TIME ESTIMATE
+// --estimate predicts how long the configured render will take, without rendering it, from a pilot pass:
+// => A sparse, jittered grid of up to PILOT_PIXELS pixels is traced at a few samples each on one thread, timing
+//    every pixel, which gives the distribution of the cost of one path through this scene.
+// => The same pixels are traced again over the worker pool; the speedup over one thread gives the serial
+//    fraction of Amdahl's law, which scales the single-thread cost to the configured thread count.
+// => With -Vx, a few rows are rendered with the scalar and the packet kernel to measure how much faster it is.
+// The prediction is paths * mean path cost / thread speedup (/ kernel speedup), plus the scene setup time this
+// run measured. Its range comes from the standard error of the mean path cost.
+
+struct RenderEstimate {
+    int pilot_pixels = 0;
+    int pilot_samples = 0;          // per pilot pixel
+    double pilot_seconds = 0;       // wall time of the whole pilot
+
+    // Cost of one path in microseconds, over the pilot pixels
+    double path_mean_us = 0;
+    double path_p50_us = 0;
+    double path_p90_us = 0;
+    double path_p99_us = 0;
+    double path_max_us = 0;
+    double path_stderr_us = 0;      // standard error of path_mean_us
+
+    int workers = 1;                // pool workers the scaling was measured on
+    double measured_speedup = 1;    // pilot on all workers over one thread
+    double serial_fraction = 0;     // Amdahl's law fit to measured_speedup
+    int threads = 1;                // threads of the predicted render
+    double thread_speedup = 1;      // predicted for threads
+
+    double kernel_speedup = 1;      // -Vx kernel over the scalar one, 1 without -Vx
+
+    double setup_seconds = 0;       // parse and commit of this run
+    double render_seconds = 0;      // predicted
+    double render_low_seconds = 0;
+    double render_high_seconds = 0;
+};
+
+/** @brief Runs the pilot pass for render_data's resolution, samples and depth under config's threading and kernel. */
+RenderEstimate estimateRender(RenderData& render_data, Camera& cam, std::shared_ptr<Scene> scene_ptr, const Config& config);
+
+/** @brief Writes estimate as one JSON object, with the render settings it was made for. */
+void writeEstimateJSON(std::ostream& out, const RenderEstimate& estimate, const RenderData& render_data, const Config& config);
+
+#endif
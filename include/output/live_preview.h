@@ -0,0 +1,113 @@
+#ifndef LIVE_PREVIEW_H
+#define LIVE_PREVIEW_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "render.h"
+
+// LIVE PREVIEW
+// With --preview <name> the framebuffer is published while it renders, into a POSIX shared memory object
+// (/dev/shm/<name>) that any process can map read-only to watch the render converge:
+// => A publisher thread wakes at a fixed rate, averages every pixel over the samples it has so far
+//    (RenderData::pixel_samples) and writes the frame into the next of PREVIEW_SLOTS slots, as tone-mapped
+//    8-bit RGB or linear float RGB.
+// => Render threads are never told about it: the publisher only reads the framebuffer, so no worker ever waits.
+//    It reads without synchronisation, so a pixel finished during the copy can show its previous pass for a frame.
+// => Each slot is guarded by a sequence number, odd while the slot is being written. A reader copies the slot the
+//    header names as newest and keeps the copy if the sequence was even and unchanged around it; with several
+//    slots in the ring a reader has a whole publishing interval before the slot is reused.
+// The object is unlinked when the render finishes; readers that mapped it keep it, and see done set after the
+// final (denoised) frame.
+
+enum class PreviewFormat : uint32_t { RGB8 = 0, Float = 1 };
+
+/** @brief Format of a --preview-format name. @throws std::invalid_argument for unknown names. */
+PreviewFormat parsePreviewFormat(const std::string& name);
+
+static const uint32_t PREVIEW_MAGIC = 0x50564c43; // "CLVP"
+static const uint32_t PREVIEW_VERSION = 1;
+static const uint32_t PREVIEW_SLOTS = 3;
+
+// Layout of the object: the header in the first PREVIEW_ALIGN bytes, then slot i at PREVIEW_ALIGN + i * slot_bytes.
+// A slot starts with PreviewSlot; its pixels follow PREVIEW_ALIGN bytes into it, rows top to bottom.
+static const size_t PREVIEW_ALIGN = 64;
+
+/** @brief Start of the shared memory object. */
+struct PreviewHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t format;            // PreviewFormat
+    uint32_t slots;
+    uint64_t slot_bytes;        // a multiple of PREVIEW_ALIGN
+    std::atomic<uint64_t> frame;    // number of the newest complete frame, in slot (frame - 1) % slots; 0 = none yet
+    std::atomic<uint32_t> done;     // 1 once the final frame is published
+};
+
+struct PreviewSlot {
+    std::atomic<uint64_t> sequence; // 2 * frame + 1 while writing frame, 2 * frame + 2 once written
+    uint32_t samples;               // largest sample count of a pixel in the frame
+    uint32_t reserved;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "preview sequence numbers must be lock free to be shared");
+static_assert(sizeof(PreviewHeader) <= PREVIEW_ALIGN && sizeof(PreviewSlot) <= PREVIEW_ALIGN, "preview headers must fit their space");
+
+class LivePreview {
+
+    public:
+
+        /**
+         * @brief Creates /dev/shm/<name> for width x height frames published rate times a second.
+         * @throws std::runtime_error if the object cannot be created or mapped.
+        */
+        LivePreview(const std::string& name, int width, int height, PreviewFormat format, double rate);
+        ~LivePreview();
+
+        LivePreview(const LivePreview&) = delete;
+        LivePreview& operator=(const LivePreview&) = delete;
+
+        /** @brief Starts publishing render_data's framebuffer until stop(). render_data must outlive it. */
+        void start(const RenderData& render_data);
+
+        /** @brief Stops the publisher thread after its current frame. */
+        void stop();
+
+        /** @brief Publishes one frame of render_data now; final marks it the last. Not while started. */
+        void publish(const RenderData& render_data, bool final);
+
+        uint64_t frames() const { return frame; }
+
+    private:
+
+        std::string name;
+        int width, height;
+        PreviewFormat format;
+        double rate;
+        size_t pixel_bytes;
+        size_t mapped_bytes = 0;
+        unsigned char* mapped = nullptr;
+        uint64_t frame = 0;
+        std::vector<float> averages;    // scratch for one frame, RGB
+
+        std::thread publisher;
+        std::mutex mutex;               // guards stopping only; the render side never takes it
+        std::condition_variable wake;
+        bool stopping = false;
+
+        PreviewHeader& header() { return *reinterpret_cast<PreviewHeader*>(mapped); }
+};
+
+/**
+ * @brief Reference reader: attaches to /dev/shm/<name> and writes every new frame to path (binary PPM for
+ * 8-bit frames, PFM for float) until the renderer publishes its final frame. Returns the frames written.
+ * @throws std::runtime_error if the object does not exist or is not a preview.
+*/
+int dumpPreview(const std::string& name, const std::string& path);
+
+#endif
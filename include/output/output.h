@@ -7,6 +7,7 @@
 #include <fstream>
 #include "png_output.h"
 #include "cli_parser.hh"
+#include "thread_pool.hh"
 
 #include "stb_image_write.h"
 
@@ -29,4 +30,25 @@ struct RGB{
 */
 void output(RenderData& render_data, Camera& cam, std::shared_ptr<Scene> scene_ptr, Config& config);
 
+/** @brief Renders into render_data.buffer with the render function, threading and sampler already configured. */
+void renderImage(RenderData& render_data, Camera& cam, std::shared_ptr<Scene> scene_ptr, Config& config);
+
+/**
+ * @brief Renders the scene once per sampler at the configured samples per pixel and writes each one's RMSE
+ * against an independent 16x spp random reference, and its error ratio to the random sampler, to out.
+*/
+void reportSamplerError(RenderData& render_data, Camera& cam, std::shared_ptr<Scene> scene_ptr, Config& config, std::ostream& out);
+
+/** @brief Path an AOV layer is written to: the output path with _<layer>.pfm in place of its extension. */
+std::string aovOutputPath(const Config& config, AOV layer);
+
+/** @brief Writes every layer listed in config.aovs as a PFM image, averaged over the samples per pixel. */
+void writeAOVs(const RenderData& render_data, const Config& config);
+
+/**
+ * @brief Output path of one frame of an animation: the frame number, zero padded to 4 digits,
+ * is inserted before the extension (image.png -> image_0007.png).
+*/
+std::string frameOutputPath(const Config& config, int frame);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,13 @@
+#ifndef PFM_OUTPUT_H
+#define PFM_OUTPUT_H
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief Writes a PFM (portable float map) image: pixels holds channels (1 or 3) interleaved floats per pixel,
+ * bottom row first, which is the order of the render buffers. @throws std::runtime_error if the file cannot be opened.
+*/
+void write_pfm(const std::string& path, int width, int height, int channels, const std::vector<float>& pixels);
+
+#endif
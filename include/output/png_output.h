@@ -5,9 +5,10 @@
 #include <vector>
 #include <cstdio>
 #include "color.h"
+#include "frame_buffer.hh"
 
 uint8_t to_byte(float value);
 
-void write_png(const char* filename, int width, int height, int samples_per_pixel, const std::vector<color>& buffer);
+void write_png(const char* filename, int width, int height, int samples_per_pixel, const FrameBuffer& buffer);
 
 #endif
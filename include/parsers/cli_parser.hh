@@ -22,18 +22,72 @@ struct Config {
     std::string outputPath = "image.ppm";
     int image_width = 1200;
     int image_height = 675;
-    std::string outputType = "ppm"; // [jpg|png|ppm]
+    std::string outputType = "ppm"; // [jpg|png|ppm|pfm]
     
     // Output flags
     bool showVersion = false;
     bool showHelp = false;
     bool verbose = false;
     std::string debugFile = "debug.txt";
+    std::string aovs = ""; // comma separated first-hit layers [albedo|normal|depth|id], written as <output>_<layer>.pfm
 
     // Optimization flags
     bool multithreading = false;
     int threads = -1; // if -1, then uses hardware concurrency. only used if multithreading is true.
+    bool pinThreads = false; // pin render/pool threads to cores, spread over NUMA nodes
     int vectorization = 0; // [NONE|4|8|16], NONE = 0    
+    bool reorderRays = false; // packet kernels bin secondary rays by origin cell and direction octant
+    int tilesPerThread = 4; // blocks of rows per worker when multithreading
+    std::string schedule = "auto"; // [auto|rows|samples] split multithreaded passes over rows or over sample ranges
+    bool autotune = false; // time short pilot renders to pick vectorization, threads and tiles per thread
+    std::string autotuneCache = ""; // file remembering autotune choices per scene and host; empty = none
+
+    // Sampling flags
+    std::string sampler = "random"; // [random|stratified|sobol|bluenoise]
+    bool samplerReport = false; // after rendering, compare every sampler's error at equal spp
+    int split = 1; // paths continuing each camera ray; samples_per_pixel / split camera rays per pixel
+    std::string radianceCache = "off"; // [off|preview|final]
+    double cacheCellSize = 0; // radiance cache cell edge in world units; 0 picks one from the scene bounds
+    bool guide = false; // learn where light comes from over doubling passes and sample diffuse bounces towards it
+
+    // Progressive rendering: samples_per_pixel becomes the most a render may reach
+    double timeBudget = 0; // seconds from start until rendering stops; 0 = no limit
+    double noiseTarget = 0; // stop once the estimated relative RMS error is this low; 0 = no target
+    double progressInterval = 0; // seconds between intermediate images written to the output path; 0 = none
+
+    // Live preview
+    std::string preview = ""; // if set, publishes the framebuffer to this POSIX shared memory object while rendering
+    std::string previewFormat = "rgb8"; // [rgb8|float]
+    double previewRate = 10; // frames published per second
+    std::string previewDump = ""; // if set, writes the frames of this preview to outputPath and exits
+
+    // Estimation
+    bool estimate = false; // trace a pilot pass, print the predicted render time as JSON and exit
+
+    // Denoising flags
+    std::string denoise = "off"; // [off|fast|balanced|high]
+
+    // Scene compilation
+    std::string compileFile = ""; // if set, compiles this CSR file to .csrb (written to outputPath) and exits
+
+    // Server flags
+    std::string serverSocket = ""; // if set, runs as a persistent render server on this Unix socket
+    int serverCacheSize = 8; // max number of committed scenes kept warm by the server
+
+    // Animation flags
+    int frames = 0; // frames to render for keyframed scenes; 0 renders up to the last keyframe
+
+    // Embree flags. Empty or zero values keep the scene's (or Embree's) defaults.
+    std::string buildQuality = ""; // [low|medium|high], overrides the scene's Build block
+    std::string sceneFlags = ""; // e.g. "compact,robust" or "none", overrides the scene's Build block
+    int embreeThreads = 0; // Embree build threads
+    std::string isa = ""; // [sse2|sse4.2|avx|avx2|avx512]
+    bool hugepages = false;
+    bool setAffinity = false; // let Embree pin its threads
+    std::string deviceConfig = ""; // extra raw Embree device config, appended last
+
+    // Texture flags
+    std::string textureCacheDir = ""; // if set, decoded textures are stored here and reused across runs
 
 };
 
@@ -41,8 +95,20 @@ void outputHelpGuide(std::ostream& out);
 
 void outputRenderInfo(std::ostream& out, Config& config, RenderData& render_data, float time);
 
+/** @brief Builds the Embree device config string from the Embree flags, e.g. "threads=8,isa=avx2". */
+std::string deviceConfigString(const Config& config);
+
+/** @brief Returns the scene's build settings with any CLI overrides applied. */
+BuildSettings buildSettings(const Config& config, BuildSettings scene_settings);
+
 int checkValidIntegerInput(int& i, int argc, char* argv[], std::string flagName);
 
+/** @brief Reads the positive number after flag i, like checkValidIntegerInput. */
+double checkValidDoubleInput(int& i, int argc, char* argv[], std::string flagName);
+
+/** @brief Reads the duration after flag i in seconds: a positive number with an optional s, m or h unit (90, 90s, 1.5m). */
+double checkValidDurationInput(int& i, int argc, char* argv[], std::string flagName);
+
 /**
  * @brief given argc, argv, process and return a Config struct containing all the settings.
  * Doesn't account for some invalid input, such as:
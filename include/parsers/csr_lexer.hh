@@ -0,0 +1,84 @@
+#ifndef CSR_LEXER_H
+#define CSR_LEXER_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Max whitespace separated values after a key on one line (e.g. "albedo 0.1 0.2 0.3" has 3).
+const int CSR_MAX_ARGS = 8;
+
+/**
+ * @struct CSRLine
+ * @brief One non-empty CSR line, split into a key and its arguments.
+ * @note Every string_view points into the lexed buffer and is only valid while that buffer is.
+*/
+struct CSRLine {
+    std::string_view key;
+    std::string_view args[CSR_MAX_ARGS];
+    int argc = 0;
+    int number = 0; // 1-based line number in the file, for error messages
+};
+
+/**
+ * @class CSRLexer
+ * @brief Single-pass, allocation-free tokenizer over an in-memory CSR file.
+ *
+ * Comments (anything after a '#') and blank lines are skipped. Each call to next() yields the
+ * next line as string_view tokens, without copying any text out of the buffer.
+*/
+class CSRLexer {
+
+    public:
+
+        CSRLexer(const char* data, size_t size);
+
+        /** @brief Reads the next non-empty line. Returns false at the end of the buffer. */
+        bool next(CSRLine& line);
+
+    private:
+        const char* cursor;
+        const char* end;
+        int line_number = 0;
+};
+
+/**
+ * @class CSRIdTable
+ * @brief Interns CSR ids (material, texture and primitive names) into dense integer handles.
+ * Redefining an id makes it refer to the newest definition, as in the original map-based parser.
+ * @note Keys view into the lexed buffer, so the table must not outlive it.
+*/
+class CSRIdTable {
+
+    public:
+
+        /** @brief Registers id and returns its new handle. Handles are assigned 0, 1, 2, ... */
+        uint32_t define(std::string_view id);
+
+        /** @throws std::runtime_error naming the kind and line if id was never defined. */
+        uint32_t lookup(std::string_view id, const char* kind, int line_number) const;
+
+    private:
+        std::unordered_map<std::string_view, uint32_t> handles;
+        uint32_t next_handle = 0;
+};
+
+// Value parsers. All throw std::runtime_error mentioning the line number on malformed input.
+
+/** @brief Parses a float with std::from_chars (no locale, no allocation). */
+float parseFloat(std::string_view token, int line_number);
+
+/** @brief Parses a non-negative integer such as an index; rejects signs, fractions and overflow. */
+size_t parseIndex(std::string_view token, int line_number);
+
+/** @brief Parses "true" or "false". */
+bool parseBool(std::string_view token, int line_number);
+
+/** @brief Parses a ratio such as "16/9", or a plain number. */
+double parseRatio(std::string_view token, int line_number);
+
+/** @brief Builds an exception message of the form "CSR line N: <message>". */
+std::string csrError(int line_number, const std::string& message);
+
+#endif
@@ -5,9 +5,7 @@
 #include <memory>
 #include <vector>
 #include <string>
-#include <fstream>
-#include <sstream>
-#include <optional>
+#include <string_view>
 #include "camera.h"
 #include "material.h"
 #include "light.h"
@@ -15,8 +13,13 @@
 #include "sphere_primitive.h"
 #include "quad_primitive.h"
 #include "box_primitive.h"
+#include "mesh_primitive.h"
+#include "mesh_parser.hh"
 #include "scene.h"
 #include "instances.h"
+#include "csrb_format.hh"
+#include "csr_lexer.hh"
+#include "mapped_file.hh"
 
 // From csr-schema lib
 #include "csr_validator.hh"
@@ -26,41 +29,65 @@
  * @brief A parser that constructs Scene objects by reading a given CSR (Caitlyn Scene Representation) file.
  *
  * Call parseCSR(parseCSR(const std::string& filePath, RTCDevice device) to get a std::shared_ptr<Scene>
- * parseCSR does NOT validate the formatting and structure of the CSR file, and may result in a seg fault without prior validation.
+ * parseCSR does NOT validate the formatting and structure of the CSR file, but malformed values and
+ * undefined ids are reported as std::runtime_error with the offending line number.
+ *
+ * FRONT END
+ * => The text file is memory-mapped and lexed in a single pass (CSRLexer), with string_view tokens
+ *    and std::from_chars number parsing. Material, texture and primitive ids are interned into
+ *    integer handles (CSRIdTable), so no strings are allocated per line or per property.
+ * => The text is compiled in memory into exactly the same layout as a .csrb file (csrb_format.hh),
+ *    and every scene, text or binary, is then built by the same loader.
 */
 class CSRParser {
 
     public:
 
-        std::ifstream file;
-
         /**
-         * @brief Parses a CSR file and returns a std::shared_ptr<Scene> WITHOUT the scene committed.
+         * @brief Parses a CSR (or compiled .csrb) file and returns a std::shared_ptr<Scene> WITHOUT the scene committed.
          * The user must call scene_ptr->commitScene(); and rtcReleaseDevice(device);.
         */
         std::shared_ptr<Scene> parseCSR(std::string& filePath, RTCDevice device);
 
+        /**
+         * @brief Loads a compiled .csrb scene by memory-mapping it. Returns the scene WITHOUT it committed.
+         * Sphere and quad vertex buffers are shared with Embree straight out of the mapping.
+         * parseCSR calls this automatically for paths ending in ".csrb".
+        */
+        std::shared_ptr<Scene> parseCSRB(const std::string& filePath, RTCDevice device);
+
+        /**
+         * @brief Compiles a CSR file into the binary .csrb layout described in csrb_format.hh.
+         * Does not create any Embree objects, so no device is needed.
+        */
+        void compileCSR(const std::string& csrPath, const std::string& csrbPath);
+
     private:
 
+        /** @brief Lexes CSR text and returns it laid out as a .csrb image (header, aligned sections, end padding). */
+        std::shared_ptr<std::vector<char>> compileText(const char* data, size_t size);
+
         /**
-         * @brief Given a string, reads in the next line from the file while accounting for comments,
-         * If the line begins with a '#', it is a comment and skips to the next line.
-         * String is also preprocessed to ignore anything after a #.
+         * @brief Validates a .csrb image and builds a Scene from it. Geometry buffers point into the image,
+         * so keepalive (which owns the image memory) is stored in the scene.
         */
-        bool getNextLine(std::ifstream& file, std::string& holder);
+        std::shared_ptr<Scene> buildScene(const char* base, size_t size, std::shared_ptr<const void> keepalive,
+                                          const std::string& name, RTCDevice device);
 
-        // Helper String Functions
-        std::vector<std::string> split(const std::string &s, char delimiter = ' ');
-        std::string trim(const std::string& str);
-        bool startsWith(const std::string& str, const std::string& prefix);
+        /** @brief Reads the next line and checks that it has the given key and at least argc values. */
+        CSRLine expectLine(CSRLexer& lexer, std::string_view key, int argc);
 
         // Property Readers
-        bool readBooleanProperty(std::string line);
-        point3 readXYZProperty(std::string line);
-        double readDoubleProperty(std::string line);
-        std::string readStringProperty(std::string line);
-        double readRatioProperty(std::string line);
-        Camera readCamera();
+        bool readBooleanProperty(CSRLexer& lexer, std::string_view key);
+        point3 readXYZProperty(CSRLexer& lexer, std::string_view key);
+        double readDoubleProperty(CSRLexer& lexer, std::string_view key);
+        std::string_view readStringProperty(CSRLexer& lexer, std::string_view key);
+        double readRatioProperty(CSRLexer& lexer, std::string_view key);
+        CSRBCamera readCamera(CSRLexer& lexer);
+
+        /** @brief Returns the text between '[' and ']' of a block header such as Material[Lambertian]. */
+        static std::string_view blockType(std::string_view key);
+        static bool startsWith(std::string_view str, std::string_view prefix);
 };
 
 #endif
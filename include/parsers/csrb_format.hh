@@ -0,0 +1,117 @@
+#ifndef CSRB_FORMAT_H
+#define CSRB_FORMAT_H
+
+#include <cstdint>
+
+// CSRB (Compiled Scene Representation, Binary) LAYOUT
+// Produced by `caitlyn --compile scene.csr -o scene.csrb` and loaded with a single mmap.
+//
+// => A fixed CSRBHeader at offset 0, followed by sections.
+// => Every section starts on a CSRB_ALIGNMENT boundary and is an array of one record type.
+// => Vertex sections are laid out exactly as Embree expects them, so each primitive's geometry is
+//    bound straight into the mapping with rtcSetSharedGeometryBuffer instead of being copied.
+// => Meshes are not embedded: only their file path is stored, and the PLY/OBJ file is mapped at load time.
+// => Strings (texture and mesh paths) live in the STRINGS section and are referenced by byte offset.
+//
+// Bump CSRB_VERSION whenever any record below changes. Loaders reject other versions, so stale
+// .csrb files must be recompiled from their .csr source.
+
+const char CSRB_MAGIC[4] = {'C', 'S', 'R', 'B'};
+const uint32_t CSRB_VERSION = 5;
+const uint32_t CSRB_ALIGNMENT = 16;
+
+enum CSRBSectionId : uint32_t {
+    CSRB_SECTION_STRINGS = 0,       // char
+    CSRB_SECTION_TEXTURES,          // CSRBTexture
+    CSRB_SECTION_MATERIALS,         // CSRBMaterial
+    CSRB_SECTION_SPHERE_VERTICES,   // float[4] x, y, z, radius (RTC_FORMAT_FLOAT4)
+    CSRB_SECTION_SPHERE_MATERIALS,  // uint32_t index into MATERIALS, one per sphere
+    CSRB_SECTION_QUAD_VERTICES,     // Vertex3f[4] p, p+u, p+u+v, p+v per quad (RTC_FORMAT_FLOAT3)
+    CSRB_SECTION_QUAD_MATERIALS,    // uint32_t index into MATERIALS, one per quad
+    CSRB_SECTION_QUAD_INDEX,        // uint32_t[4] {0, 1, 2, 3}, shared by every quad (RTC_FORMAT_UINT4)
+    CSRB_SECTION_INSTANCES,         // CSRBInstance
+    CSRB_SECTION_MESHES,            // CSRBMesh
+    CSRB_SECTION_MESH_MATERIALS,    // uint32_t index into MATERIALS, referenced by CSRBMesh ranges
+    CSRB_SECTION_KEYFRAMES,         // CSRBKeyframe, in file order
+    CSRB_SECTION_COUNT
+};
+
+struct CSRBSection {
+    uint64_t offset; // byte offset from the start of the file
+    uint64_t count;  // number of records
+};
+
+struct CSRBCamera {
+    float lookfrom[3];
+    float lookat[3];
+    float vup[3];
+    float vfov;
+    float aspect_ratio;
+    float aperture;
+    float focus_dist;
+};
+
+const uint32_t CSRB_BUILD_DEFAULT = 0xffffffff;
+const uint32_t CSRB_NO_ENVIRONMENT = 0xffffffff;
+
+struct CSRBHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t section_count;
+    uint32_t reserved;
+    uint32_t build_quality;  // RTCBuildQuality from the Build block, or CSRB_BUILD_DEFAULT
+    uint32_t build_flags;    // RTCSceneFlags from the Build block, or CSRB_BUILD_DEFAULT
+    uint32_t environment;    // Environment[Image] path as an offset into STRINGS, or CSRB_NO_ENVIRONMENT (gradient sky)
+    float environment_intensity;
+    CSRBCamera camera;
+    CSRBSection sections[CSRB_SECTION_COUNT];
+};
+
+enum CSRBTextureType : uint32_t { CSRB_TEXTURE_CHECKER = 0, CSRB_TEXTURE_IMAGE, CSRB_TEXTURE_NOISE };
+
+struct CSRBTexture {
+    uint32_t type;          // CSRBTextureType
+    uint32_t path;          // IMAGE: offset into STRINGS
+    uint32_t transparency;  // IMAGE: nonzero loads a PixelImageTexture
+    float scale;            // CHECKER, NOISE
+    float c1[3];            // CHECKER
+    float c2[3];            // CHECKER
+};
+
+enum CSRBMaterialType : uint32_t { CSRB_MATERIAL_LAMBERTIAN = 0, CSRB_MATERIAL_METAL, CSRB_MATERIAL_DIELECTRIC, CSRB_MATERIAL_EMISSIVE };
+
+const uint32_t CSRB_NO_TEXTURE = 0xffffffff;
+
+struct CSRBMaterial {
+    uint32_t type;      // CSRBMaterialType
+    uint32_t texture;   // LAMBERTIAN: index into TEXTURES, or CSRB_NO_TEXTURE to use albedo
+    float albedo[3];    // LAMBERTIAN, METAL albedo; EMISSIVE rgb already multiplied by strength
+    float param;        // METAL fuzz, DIELECTRIC index of refraction
+};
+
+enum CSRBInstanceType : uint32_t { CSRB_INSTANCE_SPHERE = 0, CSRB_INSTANCE_QUAD };
+
+struct CSRBInstance {
+    uint32_t type;      // CSRBInstanceType
+    uint32_t prim;      // index into the SPHERE_* or QUAD_* sections
+    float translate[3];
+};
+
+struct CSRBMesh {
+    uint32_t path;              // offset into STRINGS of the .ply or .obj file
+    uint32_t first_material;    // index of the mesh's first entry in MESH_MATERIALS
+    uint32_t material_count;    // per-face material index i selects MESH_MATERIALS[first_material + i]
+    uint32_t material_names;    // offset into STRINGS of the same material ids, space separated (matched against OBJ usemtl)
+};
+
+enum CSRBKeyframeType : uint32_t { CSRB_KEYFRAME_CAMERA = 0, CSRB_KEYFRAME_SPHERE, CSRB_KEYFRAME_INSTANCE };
+
+struct CSRBKeyframe {
+    uint32_t type;      // CSRBKeyframeType
+    uint32_t target;    // SPHERE: index into SPHERE_*; INSTANCE: index into INSTANCES
+    float frame;
+    float position[3];  // SPHERE center, INSTANCE translation
+    CSRBCamera camera;  // CAMERA (aspect_ratio unused)
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef MESH_PARSER_H
+#define MESH_PARSER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @struct MeshData
+ * @brief Triangle arrays of a loaded mesh, laid out the way Embree reads them.
+ *
+ * vertices points at the first vertex's x; y and z follow it and vertex_stride bytes separate vertices.
+ * indices holds 3 vertex indices per triangle, face_materials one entry per triangle (nullptr means
+ * every triangle uses material 0). The pointers stay valid for as long as keepalive does.
+*/
+struct MeshData {
+    const float* vertices = nullptr;
+    size_t vertex_count = 0;
+    size_t vertex_stride = 3*sizeof(float);
+
+    const uint32_t* indices = nullptr;
+    size_t triangle_count = 0;
+
+    const uint32_t* face_materials = nullptr;
+
+    bool mapped_vertices = false;   // vertices point straight into the file mapping (no copy made)
+
+    std::vector<std::shared_ptr<const void>> keepalive; // the file mapping and/or converted arrays
+};
+
+/**
+ * @class MeshParser
+ * @brief Loads triangle meshes from binary PLY and OBJ files.
+ *
+ * PLY (binary_little_endian)
+ * => The file is memory-mapped. When the vertex element stores x, y, z as consecutive floats (the usual
+ *    export) and the data starts 4-byte aligned, the vertex array is handed to Embree in place, with
+ *    the element size as the stride. Otherwise positions are converted into a packed float3 array.
+ * => Faces are variable-length lists, which Embree cannot read directly, so they are converted once into
+ *    a packed triangle index array (polygons are fanned). An integer face property named
+ *    material_index, material or mat is used as the per-face material index.
+ *
+ * OBJ
+ * => Parsed from a memory mapping in one pass (v, f and usemtl lines; negative and v/vt/vn indices are
+ *    accepted). Faces take the index of their usemtl name in material_names, or 0 if it is not listed.
+*/
+class MeshParser {
+
+    public:
+
+        /**
+         * @brief Loads the mesh at path, choosing the format by extension (.ply or .obj).
+         * @throws std::runtime_error if the file cannot be read or is malformed.
+        */
+        MeshData load(const std::string& path, const std::vector<std::string>& material_names);
+
+    private:
+
+        MeshData loadPLY(const std::string& path);
+        MeshData loadOBJ(const std::string& path, const std::vector<std::string>& material_names);
+};
+
+#endif
@@ -2,40 +2,262 @@
 #define RENDER_H
 
 #include <embree4/rtcore.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "frame_buffer.hh"
 #include "intersects.h"
+#include "radiance_cache.hh"
+#include "path_guide.hh"
+#include "sampler.hh"
 #include "scene.h"
 #include "vec3.h"
 
+/** @brief A packet lane that hit geometry, waiting to be shaded. */
+struct ShadeHit {
+    int lane;
+    int targetID;
+    uint32_t mat;   // id in Scene::materials
+};
+
+/**
+ * @brief Coherence figures of the packet kernels. A batch is the set of lanes of one packet intersect that hit
+ * something; each batch is shaded in material order (see sortByMaterial).
+*/
+struct ShadeStats {
+    long long batches = 0;
+    long long hits = 0;
+    long long unique_materials = 0; // summed over batches: material changes when shading in sorted order
+    long long lane_switches = 0;    // summed over batches: material changes when shading in lane order
+    long long cache_misses = -1;    // hardware cache misses in the packet kernels, -1 if not measurable
+    double intersect_seconds = 0;   // time spent in rtcIntersect4/8, summed over workers
+
+    void record(const ShadeHit* batch, int count, int unique);
+    void merge(const ShadeStats& other);
+};
+
+/**
+ * @brief Counting sort of hits by material id into sorted, so equal materials end up adjacent.
+ * counts must have one zeroed entry per material and is left zeroed. Returns the number of distinct materials.
+ * @note count must be at most 16 (one packet).
+*/
+int sortByMaterial(const ShadeHit* hits, int count, ShadeHit* sorted, std::vector<uint32_t>& counts);
+
+/** @brief Timings gathered while preparing and running a render. Reported by outputRenderInfo. */
+struct RenderStats {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now(); // process start, or job receipt in server mode
+    double parse_seconds = 0;       // reading the scene file and building the Scene
+    double commit_seconds = 0;      // BVH build, plus waiting on texture decodes still in flight
+    double time_to_first_ray = 0;   // seconds from start until the first camera ray is traced
+    double bvh_build_seconds = 0;   // part of commit_seconds spent building the BVH
+    long long bvh_bytes = 0;        // memory held by Embree after the build
+    long long bvh_peak_bytes = 0;   // highest Embree memory use so far
+    double mesh_load_seconds = 0;   // part of parse_seconds spent mapping and converting mesh files
+    size_t mesh_triangles = 0;
+    size_t lights = 0;              // emissive surfaces in the light BVH
+    double light_bvh_seconds = 0;   // part of commit_seconds spent building the light BVH
+    size_t light_bvh_bytes = 0;
+    double denoise_seconds = 0;     // --denoise pass after the render, part of the render time
+    int progressive_passes = 0;     // passes completed by a progressive render (--time, --noise)
+    double noise_estimate = 0;      // relative RMS error after the last progressive pass, 0 if not measured
+    int sample_tasks = 0;           // sample ranges the last pass was split into (--schedule samples), 0 if by rows
+    ShadeStats shading;             // packet kernels only; reset by output() for every render
+};
+
+/** @brief Seconds elapsed since the given time point. */
+double secondsSince(std::chrono::steady_clock::time_point t);
+
+/** @brief Peak resident set size of this process so far, in megabytes. */
+double peakResidentMB();
+
+class RayBinner;
+
+// FRAMEBUFFER LAYERS
+// Besides the beauty radiance in RenderData::buffer, a render can fill output variables (AOVs) from what each
+// camera ray hits first. Only the requested layers are allocated and written, each as one float plane per channel:
+// => albedo: the attenuation of the surface (1 for emitters), or the radiance itself for misses
+// => normal: the shading normal, 0 for misses
+// => depth: the distance to the hit, 0 for misses
+// => id: the geometry (or instance) id seen by the pixel's first sample, -1 for misses
+// Albedo, normal and depth are summed over samples like the beauty buffer. output() writes the layers asked
+// for with --aov as PFM images, and the denoiser (denoiser.h) uses the first three as its guides.
+
+enum class AOV : uint8_t { Albedo, Normal, Depth, ObjectID };
+
+/** @brief Layer of an --aov name. @throws std::invalid_argument for unknown names. */
+AOV parseAOV(const std::string& name);
+
+std::string aovName(AOV layer);
+
+/** @brief Layers of a comma separated --aov list such as "albedo,depth". */
+std::vector<AOV> parseAOVList(const std::string& names);
+
+class AOVBuffers {
+
+    public:
+
+        /** @brief Asks for a layer. It is allocated by the next reset(). */
+        void request(AOV layer) { requested |= 1u << static_cast<int>(layer); }
+
+        bool has(AOV layer) const { return (allocated >> static_cast<int>(layer)) & 1u; }
+        bool any() const { return allocated != 0; }
+
+        /** @brief Allocates the requested layers, zeroed (ids -1), for the given number of pixels and frees the others. */
+        void reset(size_t pixels);
+
+        /** @brief Frees every layer and forgets the requests. */
+        void clear();
+
+        /** @brief Adds the sums of other, allocated for as many pixels, to these layers and takes the ids it recorded. */
+        void merge(const AOVBuffers& other);
+
+        /** @brief Records the first hit of sample number sample of pixel in every allocated layer. */
+        void add(uint32_t pixel, uint32_t sample, const color& a, const vec3& n, float d, int32_t id) {
+            if (!albedo[0].empty()) {
+                albedo[0][pixel] += a.x();
+                albedo[1][pixel] += a.y();
+                albedo[2][pixel] += a.z();
+            }
+            if (!normal[0].empty()) {
+                normal[0][pixel] += n.x();
+                normal[1][pixel] += n.y();
+                normal[2][pixel] += n.z();
+            }
+            if (!depth.empty()) depth[pixel] += d;
+            if (sample == 0 && !object_id.empty()) object_id[pixel] = id;
+        }
+
+        /** @brief Multiplies the sums of pixel in every summed layer (all but the ids) by factor. */
+        void scale(size_t pixel, float factor) {
+            for (int c = 0; c < 3; ++c) {
+                if (!albedo[c].empty()) albedo[c][pixel] *= factor;
+                if (!normal[c].empty()) normal[c][pixel] *= factor;
+            }
+            if (!depth.empty()) depth[pixel] *= factor;
+        }
+
+        std::vector<float> albedo[3];
+        std::vector<float> normal[3];
+        std::vector<float> depth;
+        std::vector<int32_t> object_id;
+
+    private:
+
+        uint32_t requested = 0; // bit per AOV
+        uint32_t allocated = 0;
+};
+
+/** @brief Rows finished by the render workers of a pass, counted atomically. Copies take the value copied. */
+struct LineCounter {
+    std::atomic<int> value{0};
+
+    LineCounter() = default;
+    LineCounter(const LineCounter& other) : value(other.value.load()) {}
+    LineCounter& operator=(const LineCounter& other) { value = other.value.load(); return *this; }
+    LineCounter& operator=(int lines) { value = lines; return *this; }
+
+    /** @brief Adds lines and returns the new count. */
+    int operator+=(int lines) { return value.fetch_add(lines) + lines; }
+    operator int() const { return value.load(); }
+};
+
 struct RenderData {
     int image_width;
     int image_height;
     int samples_per_pixel;
     int max_depth;
-    std::vector<color> buffer;
-    int completed_lines;
+    FrameBuffer buffer;         // pixel sums, uninitialised until the first pass writes them (frame_buffer.hh)
+    LineCounter completed_lines;    // rows of the current pass finished by the render functions
+    std::shared_ptr<const Sampler> sampler;   // random by default (setRenderData); output() applies --sampler
+    int split = 1;  // paths continuing each camera ray (--split); scalar integrator only
+    std::shared_ptr<const Sampler> primary_sampler; // pixel and lens numbers of the camera rays when split > 1
+    std::shared_ptr<RadianceCache> radiance_cache;  // --radiance-cache; scalar integrator only
+    std::shared_ptr<PathGuide> path_guide;          // --guide; scalar integrator only
+    int first_sample = 0;   // render functions add samples [first_sample, samples_per_pixel) to buffer when > 0
+    bool accumulate = false;    // add to buffer and pixel_samples from sample 0 too, no per-row progress (per-worker partial sums)
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max(); // rows not started by then are skipped
+    std::vector<uint32_t> pixel_samples;    // samples summed into each pixel of buffer, kept if allocated (progressive renders)
+    bool reorder_rays = false;  // packet kernels bin secondary rays by origin cell and direction (ray_binner.hh)
+    AOVBuffers aovs;            // first-hit layers; output() allocates the ones --aov and --denoise need
+    RenderStats stats;
 };
 
 struct RayQueue {
     int index;
     int depth;
     ray r;
+    double scatter_pdf = 0; // see PathSample::scatter_pdf
+    vec3 scatter_normal;
 };
 
 void setRenderData(RenderData& render_data, 
                     const float aspect_ratio, const int image_width,
                     const int samples_per_pixel, const int max_depth);
 
-/** @brief recursive, shoots ray and gets its sum color through a scene. */
-color colorize_ray(const ray& r, std::shared_ptr<Scene> scene, int depth);
+/** @brief Identifies the path a ray belongs to, so each bounce draws its numbers from the right sampler dimensions. */
+struct PathSample {
+    const Sampler* sampler;
+    uint32_t pixel;     // y * image_width + x
+    uint32_t index;     // sample number within the pixel
+    uint32_t bounce;    // 0 for the camera ray
+    double scatter_pdf = 0; // density of the ray's direction if the bounce that made it also sampled the lights, else 0
+    vec3 scatter_normal;    // normal at that bounce
+    AOVBuffers* aovs = nullptr; // receives the camera ray's first hit, if set
+    RadianceCache* cache = nullptr; // trained or queried at diffuse hits after the camera ray, if set
+    PathGuide* guide = nullptr;     // trained and sampled at diffuse hits, if set
+};
+
+/** @brief Camera ray of sample s of pixel (i, j), with pixel jitter and lens position taken from sampler. */
+ray cameraRay(const Camera& cam, const Sampler& sampler, int i, int j, int s, int image_width, int image_height);
+
+// LIGHT SAMPLING
+// A diffuse hit whose path goes on also samples the lights directly and traces shadow rays towards them
+// (next event estimation): the environment when it canSample(), and one emitter picked by the scene's light
+// BVH. The BSDF sample of the next bounce can reach the same light, so each side is weighted by the power heuristic:
+// => directLight() returns the light samples' share, to be multiplied by the throughput including the hit's albedo.
+// => It sets scatter_pdf for the continuing ray; environmentRadiance() and hitEmission() weight that ray by it
+//    if it escapes or lands on an emitter.
+// Paths that end at this hit (max depth) take no light sample, so an image converges to the same result as without.
+
+/**
+ * @brief Light samples of the environment and of one emitter at a diffuse hit of path, weighted against the
+ * cosine-weighted scattered ray, or against the mix with path.guide's region guide_region when that is >= 0.
+ * Sets scatter_pdf for scattered, which is 0 (and the result black) unless mat is diffuse and the scene has a
+ * light to sample.
+*/
+color directLight(const Scene& scene, uint32_t mat, const HitInfo& rec, const ray& scattered, const PathSample& path, double& scatter_pdf,
+                    int guide_region = -1);
+
+/** @brief Environment radiance seen by escaping ray r, MIS weighted if scatter_pdf > 0 (see directLight). */
+color environmentRadiance(const Scene& scene, const ray& r, double scatter_pdf);
+
+/**
+ * @brief Emission of material mat at hit rec of ray r on geomID / primID. MIS weighted against the light BVH's
+ * choice if scatter_pdf > 0, with scatter_normal the normal at the bounce r came from.
+*/
+color hitEmission(const Scene& scene, uint32_t mat, const HitInfo& rec, const ray& r, unsigned int geomID, unsigned int primID,
+                    double scatter_pdf, const vec3& scatter_normal);
+
+/**
+ * @brief recursive, shoots ray and gets its sum color through a scene.
+ * With splits > 1 the hit is found and set up once, then continued by the paths of sample indices path.index
+ * to path.index + splits - 1; the sum of their colours is returned.
+*/
+color colorize_ray(const ray& r, std::shared_ptr<Scene> scene, int depth, PathSample path, int splits = 1);
 
 
 // RENDER FUNCTIONS
 
 void render_scanlines(int lines, int start_line, std::shared_ptr<Scene> scene_ptr, RenderData& data, Camera cam);
 
+/**
+ * @brief Adds a finished pixel sample to full_buffer and gives lane i the next primary ray (or disables it).
+ * With a binner (ray reordering on) the lane is only disabled; RayBinner::refill() fills it.
+*/
 void completeRayQueueTask(std::vector<RayQueue>& current, std::vector<color>& temp_buffer,
                             std::vector<color>& full_buffer, std::vector<RayQueue>& queue,
-                            int mask[], int i, int current_index);
+                            int mask[], int i, int current_index, RayBinner* binner = nullptr);
 
 /**
  * @brief Calculates colours of the given RenderData's buffer according to the assigned lines of pixels.
@@ -2,12 +2,18 @@
 #define SCENE_H
 
 #include <embree4/rtcore.h>
+#include <future>
 #include <map>
+#include <string>
 #include "camera.h"
 #include "material.h"
+#include "material_table.hh"
 #include "sphere_primitive.h"
 #include "instances.h"
+#include "animation.h"
+#include "environment.h"
 #include "hit_info.hh"
+#include <vector>
 
 // SCENE INTERFACE
 // The scene class object covers all relevant objects in a scene:
@@ -24,20 +30,104 @@
 // => Scene can have emissives and meshes added to it.
 // => Once everything is added, the user commits the scene.
 
+/**
+ * @struct BuildSettings
+ * @brief BVH build options of a scene. Read from the CSR Build block, and overridable from the CLI.
+ * quality applies to the top-level scene and to every attached geometry.
+*/
+struct BuildSettings {
+    RTCBuildQuality quality = RTC_BUILD_QUALITY_HIGH;
+    RTCSceneFlags flags = RTC_SCENE_FLAG_DYNAMIC;
+};
+
+/** @brief Parses "low", "medium" or "high". @throws std::invalid_argument otherwise. */
+RTCBuildQuality parseBuildQuality(const std::string& name);
+
+/** @brief Parses a comma or space separated list of "compact", "robust", "dynamic", or "none". @throws std::invalid_argument */
+RTCSceneFlags parseSceneFlags(const std::string& names);
+
 class Scene {
     public:
     Camera cam;
     std::map<unsigned int, std::shared_ptr<Geometry>> geom_map;
     RTCScene rtc_scene;
 
+    // Memory bound directly into geometry buffers (e.g. a mapped .csrb file or an in-memory compiled CSR).
+    // Kept here so it outlives every geometry that reads from it.
+    std::vector<std::shared_ptr<const void>> shared_buffers;
+
+    // Texture decodes running on ThreadPool::shared() while the rest of the scene is built.
+    // commitScene() waits for all of them, so rendering never sees a half-loaded texture.
+    std::vector<std::future<void>> pending_loads;
+
+    // Every material and texture referenced by geom_map, compiled by commitScene(). Renderers resolve
+    // hits and evaluate materials through this rather than through the material objects.
+    MaterialTable materials;
+
+    // Every emissive surface, rebuilt by each commitScene() since keyframes may move them.
+    LightBVH lights;
+
+    // What rays that leave the scene see. The gradient sky unless the scene has an Environment block.
+    std::shared_ptr<Environment> environment = std::make_shared<GradientSky>();
+
+    // ANIMATION
+    // => Keyframe tracks from the scene file. Instances are addressed by the order they were added in,
+    //    spheres by their index in animated_spheres (only keyframed spheres get their own vertex buffer).
+    // => setFrame() only touches what actually moved since the previous frame, marks moved geometry for
+    //    a refit, and recommits with a fast top-level build.
+    std::vector<CameraKeyframe> camera_keys;
+    std::map<size_t, std::vector<PositionKeyframe>> instance_keys;
+    std::map<size_t, std::vector<PositionKeyframe>> sphere_keys;
+    std::map<size_t, std::shared_ptr<SpherePrimitive>> animated_spheres;
+
+    BuildSettings build;
+    double bvh_build_seconds = 0; // time spent in the last commitScene() building the BVH
+
+    // Filled in by the parser for scenes with Mesh blocks.
+    double mesh_load_seconds = 0;
+    size_t mesh_triangles = 0;
+
+    // Image textures, meshes and the environment map the scene file names, as the parser loaded them.
+    std::vector<std::string> asset_paths;
+
     // Default Constructor
     // requires a device to initialize RTCScene
     Scene(RTCDevice device, Camera cam);
     ~Scene();
+
+    /**
+     * @brief Builds the BVH with every ThreadPool::shared() worker joining in (rtcJoinCommitScene),
+     * then waits for outstanding texture decodes, compiles the material table and builds the light BVH.
+     * Rethrows the first decode error, if any.
+    */
     void commitScene();
+
+    /** @brief Applies build quality and scene flags to the scene and every geometry attached so far (and later). */
+    void setBuildSettings(const BuildSettings& settings);
     void releaseScene();
     unsigned int add_primitive(std::shared_ptr<Primitive> prim);
     unsigned int add_primitive_instance(std::shared_ptr<PrimitiveInstance> pi_ptr, RTCDevice device);
+
+    /** @brief True if the scene has any keyframes. */
+    bool isAnimated() const;
+
+    /** @brief Number of frames needed to reach the last keyframe (1 for a still scene). */
+    int frameCount() const;
+
+    /**
+     * @brief Moves every keyframed object to its position at frame and recommits the scene if anything moved.
+     * The scene must already have been committed once. Returns the camera for the frame.
+    */
+    Camera setFrame(double frame);
+
+    private:
+    struct InstanceRecord {
+        RTCGeometry geom;
+        std::shared_ptr<PrimitiveInstance> instance;
+        vec3 translate;
+    };
+    std::vector<InstanceRecord> instances;
+    bool refit_mode = false;
 };
 
 void add_sphere(RTCDevice device, RTCScene scene);
@@ -0,0 +1,106 @@
+#ifndef RENDER_SERVER_H
+#define RENDER_SERVER_H
+
+#include <embree4/rtcore.h>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include "cli_parser.hh"
+#include "scene.h"
+
+/**
+ * @struct RenderJob
+ * @brief A single render request received by the RenderServer.
+ *
+ * Jobs are sent as CSR-style "key value" lines, terminated by an empty line:
+ *     scene tests/cornell_box.csr
+ *     resolution 600 600
+ *     samples 100
+ *     output cornell.png
+ *     lookfrom 278 278 -800
+ *
+ * Only `scene` is required. Any unset field falls back to the server's startup Config.
+ * Camera keys (lookfrom, lookat, vup, vfov, aperture, focus_dist) override the scene's camera.
+*/
+struct RenderJob {
+    std::string scene;
+    std::optional<int> image_width, image_height;
+    std::optional<int> samples_per_pixel;
+    std::optional<int> max_depth;
+    std::optional<std::string> outputPath;
+    std::optional<std::string> outputType;
+
+    // Camera overrides
+    std::optional<point3> lookfrom, lookat;
+    std::optional<vec3> vup;
+    std::optional<double> vfov, aperture, focus_dist;
+
+    bool hasCameraOverride() const;
+};
+
+/**
+ * @class RenderServer
+ * @brief Persistent render daemon listening on a Unix domain socket.
+ *
+ * Keeps one RTCDevice alive for its whole lifetime and caches parsed, committed scenes keyed
+ * by the content hash of their CSR file, so repeated jobs on an unchanged scene skip parsing,
+ * texture decoding and the BVH build and go straight to tracing. A cached scene is also checked
+ * against the size and modification time of every texture, mesh and environment map it loaded,
+ * and parsed again if any of them changed.
+ *
+ * Each connection carries one job. The server replies with a single line:
+ *     ok <render seconds> <cached|parsed>
+ *     error <message>
+ * Sending the line "shutdown" stops the server. A client that sends nothing for
+ * REQUEST_TIMEOUT_SECONDS is answered with an error and disconnected.
+*/
+class RenderServer {
+
+    public:
+
+        RenderServer(const Config& base_config);
+        ~RenderServer();
+
+        /** @brief Binds the socket and serves jobs until a shutdown request is received. */
+        void run();
+
+    private:
+
+        struct CachedScene {
+            uint64_t hash;
+            std::shared_ptr<Scene> scene;
+            uint64_t asset_stamp;   // assetStamp() of scene->asset_paths when it was parsed
+        };
+
+        static constexpr int REQUEST_TIMEOUT_SECONDS = 10;
+
+        Config base_config;
+        RTCDevice device;
+        int listen_fd = -1;
+
+        // Most recently used scenes are kept at the front.
+        std::list<CachedScene> lru;
+        std::map<uint64_t, std::list<CachedScene>::iterator> cache;
+
+        /**
+         * @brief Returns a committed scene for the given file, parsing it only on a cache miss.
+         * Parse and commit times are recorded in stats (and stay zero on a cache hit).
+        */
+        std::shared_ptr<Scene> acquireScene(const std::string& path, bool& was_cached, RenderStats& stats);
+
+        /** @brief Renders a job and returns the reply line sent back to the client. */
+        std::string handleJob(const RenderJob& job);
+
+        void serveConnection(int client_fd, bool& shutdown);
+};
+
+/**
+ * @brief Parses the text of a job request.
+ * @throws std::invalid_argument on unknown keys or malformed values.
+*/
+RenderJob parseRenderJob(const std::string& request);
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef ALIAS_TABLE_H
+#define ALIAS_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// ALIAS TABLES
+// Walker's alias method, built with Vose's O(n) algorithm: every entry i keeps a probability prob[i] and a
+// second index alias[i]. A sample picks an entry uniformly and keeps it with probability prob[i], otherwise
+// takes its alias, so drawing from any discrete distribution costs one table read however many entries it has.
+
+class AliasTable {
+
+    public:
+
+        /** @brief Builds the table for the given non-negative weights. All-zero weights give a uniform table. */
+        void build(const std::vector<double>& weights);
+
+        /**
+         * @brief Draws an entry with u in [0,1). remapped is set to a fresh uniform value in [0,1) left over
+         * from u, so a caller can place the sample inside the chosen entry without asking for another number.
+        */
+        uint32_t sample(double u, double& remapped) const {
+            double scaled = u * entries.size();
+            uint32_t i = static_cast<uint32_t>(scaled);
+            if (i >= entries.size()) i = static_cast<uint32_t>(entries.size() - 1);
+            double frac = scaled - i;
+            const Entry& e = entries[i];
+            if (frac < e.prob) {
+                remapped = frac / e.prob;
+                return i;
+            }
+            remapped = (frac - e.prob) / (1 - e.prob);
+            if (remapped >= 1) remapped = 0.99999999999999989;
+            return e.alias;
+        }
+
+        /** @brief Probability of drawing entry i (its weight over the sum of weights). */
+        double pdf(uint32_t i) const { return entries[i].pdf; }
+
+        /** @brief Sum of the weights the table was built from. */
+        double total() const { return sum; }
+
+        size_t size() const { return entries.size(); }
+
+    private:
+
+        struct Entry {
+            float prob;
+            uint32_t alias;
+            double pdf;
+        };
+        std::vector<Entry> entries;
+        double sum = 0;
+};
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef DEVICE_H
 #define DEVICE_H
 #include <iostream>
+#include <string>
 #include <embree4/rtcore.h>
 
 /**
@@ -11,8 +12,16 @@ void errorFunction(void* userPtr, enum RTCError error, const char* str);
 /**
  * @brief Initializes and returns a new rendering device.
  * 
+ * @param config Embree device configuration string (e.g. "threads=8,isa=avx2,hugepages=1"), empty for defaults.
  * @return RTCDevice A handle to the newly created device, or nullptr if creation failed.
+ * @note Every device created here reports its allocations to deviceMemoryBytes() / deviceMemoryPeakBytes().
  */
-RTCDevice initializeDevice();
+RTCDevice initializeDevice(const std::string& config = "");
+
+/** @brief Bytes currently allocated by Embree (BVHs and Embree-owned buffers) across all devices. */
+long long deviceMemoryBytes();
+
+/** @brief Highest value deviceMemoryBytes() has reached. */
+long long deviceMemoryPeakBytes();
 
 #endif
@@ -0,0 +1,92 @@
+#ifndef FRAME_BUFFER_HH
+#define FRAME_BUFFER_HH
+
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include "vec3.h"
+
+// FRAMEBUFFER
+// The image's pixel sums, kept in one block that is allocated but not initialised:
+// => A std::vector<color> constructs every pixel on the thread that creates it. color zeroes itself, so every
+//    page would be touched, and on NUMA machines placed, on that thread's node. Here the first write to a row,
+//    made by the render worker that owns the row, decides where its pages live.
+// => Nothing reads a pixel before it is written: the first pass of a render stores (not adds) every row, and
+//    zeroes the rows a deadline makes it skip. assign() fills the whole buffer for sums that start at zero.
+// Copies copy the pixels.
+
+static_assert(std::is_trivially_copyable<color>::value, "framebuffer pixels are copied as bytes");
+
+class FrameBuffer {
+
+    public:
+
+        FrameBuffer() = default;
+
+        /** @brief Allocates pixels uninitialised pixels. */
+        explicit FrameBuffer(size_t pixels) { allocate(pixels); }
+
+        FrameBuffer(const FrameBuffer& other) {
+            allocate(other.count);
+            if (count > 0) std::memcpy(pixels.get(), other.pixels.get(), count * sizeof(color));
+        }
+
+        FrameBuffer(FrameBuffer&& other) noexcept : pixels(std::move(other.pixels)), count(other.count) { other.count = 0; }
+
+        FrameBuffer& operator=(const FrameBuffer& other) {
+            if (this != &other) {
+                if (count != other.count) allocate(other.count);
+                if (count > 0) std::memcpy(pixels.get(), other.pixels.get(), count * sizeof(color));
+            }
+            return *this;
+        }
+
+        FrameBuffer& operator=(FrameBuffer&& other) noexcept {
+            pixels = std::move(other.pixels);
+            count = other.count;
+            other.count = 0;
+            return *this;
+        }
+
+        /** @brief Resizes to size pixels, every one set to value. */
+        void assign(size_t size, const color& value) {
+            if (count != size) allocate(size);
+            for (size_t i = 0; i < count; ++i) pixels[i] = value;
+        }
+
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+
+        color* data() { return pixels.get(); }
+        const color* data() const { return pixels.get(); }
+        color* begin() { return pixels.get(); }
+        color* end() { return pixels.get() + count; }
+        const color* begin() const { return pixels.get(); }
+        const color* end() const { return pixels.get() + count; }
+
+        color& operator[](size_t i) { return pixels[i]; }
+        const color& operator[](size_t i) const { return pixels[i]; }
+
+    private:
+
+        struct Free {
+            void operator()(color* p) const { std::free(p); }
+        };
+
+        void allocate(size_t size) {
+            pixels.reset();
+            count = 0;
+            if (size == 0) return;
+            color* block = static_cast<color*>(std::malloc(size * sizeof(color)));
+            if (!block) throw std::bad_alloc();
+            pixels.reset(block);
+            count = size;
+        }
+
+        std::unique_ptr<color[], Free> pixels;
+        size_t count = 0;
+};
+
+#endif
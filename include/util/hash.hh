@@ -0,0 +1,20 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+/** @brief 64-bit FNV-1a hash of a block of bytes. Pass a previous result as seed to continue hashing. */
+uint64_t fnv1a64(const void* data, size_t size, uint64_t seed = 14695981039346656037ULL);
+
+/**
+ * @brief Hashes the full contents of a file.
+ * @throws std::runtime_error if the file cannot be opened.
+*/
+uint64_t hashFile(const std::string& path);
+
+/** @brief Formats a hash as a fixed-width 16 character hex string (e.g. for cache file names). */
+std::string hashToHex(uint64_t hash);
+
+#endif
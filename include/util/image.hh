@@ -11,6 +11,8 @@
 
 #include <cstdlib>
 #include <iostream>
+#include <memory>
+#include "texture_cache.hh"
 
 class image {
 
@@ -28,7 +30,12 @@ class image {
 
     ~image();
 
-    // Loads image data from the given file name. Returns true if the load succeeded.
+    // Searches for and loads the image exactly as the constructor above does. Lets an image be
+    // constructed empty on one thread and decoded later on another (see Scene::pending_loads).
+    void open(const char* image_filename, int bytes_per_pixel = 3);
+
+    // Loads image data from the given file name through TextureCache::shared(), so images with
+    // identical contents share one decoded copy. Returns true if the load succeeded.
     bool load(const std::string filename);
 
     int width()  const;
@@ -39,9 +46,7 @@ class image {
 
   private:
     int bytes_per_pixel = 3;
-    unsigned char *data;
-    int image_width, image_height;
-    int bytes_per_scanline;
+    std::shared_ptr<const ImageData> data;
 
     // Return the value clamped to the range [low, high).
     static int clamp(int x, int low, int high);
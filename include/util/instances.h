@@ -18,8 +18,12 @@ class Instance {
 class PrimitiveInstance : public Instance {
   public:
   std::shared_ptr<Primitive> pptr;
+  vec3 origin; // position of the instanced primitive before translation
 
   PrimitiveInstance(float* transform);
+
+  /** @brief Moves the translated copy used for hit information. The Embree instance transform is updated by Scene. */
+  void setTranslation(const vec3& translate);
 };
 
 class SpherePrimitiveInstance : public PrimitiveInstance {
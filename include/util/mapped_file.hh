@@ -0,0 +1,35 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+/**
+ * @class MappedFile
+ * @brief Read-only memory mapping of a whole file. The mapping lives as long as the object.
+ *
+ * Used to hand file contents to parsers and to Embree (rtcSetSharedGeometryBuffer) without copying.
+ * Pages are loaded lazily by the OS, so mapping a large file is cheap until it is read.
+*/
+class MappedFile {
+
+    public:
+
+        /** @throws std::runtime_error if the file cannot be opened or mapped. */
+        MappedFile(const std::string& path);
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        const char* data() const;
+        size_t size() const;
+        const std::string& path() const;
+
+    private:
+        std::string file_path;
+        const char* mapped = nullptr;
+        size_t mapped_size = 0;
+};
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef PATH_GUIDE_H
+#define PATH_GUIDE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "alias_table.hh"
+#include "vec3.h"
+
+// PATH GUIDING
+// A simplified SD-tree (Mueller et al. 2017, "Practical Path Guiding"): a binary tree over space whose leaves
+// (regions) each learn a distribution of the light arriving from every direction.
+// => Directions map to a 16x16 grid over cylindrical coordinates (cos theta, phi), which has equal solid angle
+//    per bin, so a bin's density is its probability times 256 / 4 pi.
+// => While a pass trains, every diffuse bounce adds the luminance its path brought back, over the density it
+//    was sampled with, to its region's bin for that direction. Workers add with atomic compare-and-swap.
+// => Between passes, update() turns each region's bins into an alias table to sample from, and splits regions
+//    that saw many samples in two (the children start from the parent's distribution). Passes double in size,
+//    so each one learns from twice the samples of the last.
+// At diffuse hits the renderer draws from the region's distribution half the time and from the BSDF otherwise,
+// and weights by the combined density, so the image stays unbiased however poor the learned distribution is.
+
+class PathGuide {
+
+    public:
+
+        static const int RESOLUTION = 16;   // bins per side of a region's direction grid
+        static constexpr double GUIDE_FRACTION = 0.5;   // share of diffuse bounces drawn from the guide
+
+        /** @brief Untrained guide over the box [lower, upper] (the scene bounds). */
+        PathGuide(const point3& lower, const point3& upper);
+
+        /** @brief Region containing p; points outside the box go to the nearest region. */
+        int regionAt(const point3& p) const;
+
+        /** @brief True once the region has learned a distribution to sample. */
+        bool canSample(int region) const { return regions[region]->trained; }
+
+        /** @brief Unit direction drawn from the region's distribution with (u, v) in [0,1)^2. */
+        vec3 sample(int region, double u, double v) const;
+
+        /** @brief Solid angle density of sample() returning the unit direction. */
+        double pdf(int region, const vec3& direction) const;
+
+        /** @brief Adds radiance arriving along the unit direction, sampled with density pdf, to the training bins. */
+        void record(int region, const vec3& direction, double radiance, double pdf);
+
+        /** @brief Rebuilds the sampling distributions from what was recorded, refines the tree and clears the bins. */
+        void update();
+
+        size_t regionCount() const { return regions.size(); }
+        int iterations() const { return iteration; }
+        size_t memoryBytes() const;
+
+        bool training = true;   // record() in this pass (the renderer skips it otherwise)
+
+    private:
+
+        static const int BINS = RESOLUTION * RESOLUTION;
+        static const size_t MAX_REGIONS = 4096;
+        static const int MIN_SAMPLES = 64;      // recorded samples before a region trusts its distribution
+
+        struct Region {
+            AliasTable table;
+            bool trained = false;
+            std::unique_ptr<std::atomic<float>[]> bins{new std::atomic<float>[BINS]};
+            std::atomic<uint32_t> samples{0};
+            point3 lower, upper;
+
+            void clear();
+        };
+
+        // Interior nodes split their box in half along axis; leaves point at a region.
+        struct Node {
+            int axis;       // -1 for a leaf
+            float split;
+            int children;   // first of two adjacent nodes
+            int region;
+        };
+
+        std::vector<Node> nodes;
+        std::vector<std::unique_ptr<Region>> regions;
+        int iteration = 0;
+
+        static int binOf(const vec3& direction);
+};
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef PERF_COUNTER_H
+#define PERF_COUNTER_H
+
+/**
+ * @class CacheMissCounter
+ * @brief Counts the hardware cache misses of the calling thread, in user space, from construction on.
+ *
+ * Backed by perf_event_open on Linux. Where that is not available (other platforms, or perf events
+ * blocked by kernel.perf_event_paranoid or a container's seccomp profile) read() returns -1.
+*/
+class CacheMissCounter {
+
+    public:
+
+        CacheMissCounter();
+        ~CacheMissCounter();
+
+        CacheMissCounter(const CacheMissCounter&) = delete;
+        CacheMissCounter& operator=(const CacheMissCounter&) = delete;
+
+        /** @brief Misses counted so far, or -1 if the counter could not be opened. */
+        long long read() const;
+
+    private:
+        int fd = -1;
+};
+
+#endif
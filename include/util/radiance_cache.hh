@@ -0,0 +1,92 @@
+#ifndef RADIANCE_CACHE_H
+#define RADIANCE_CACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "vec3.h"
+#include "color.h"
+
+// RADIANCE CACHE
+// Diffuse interreflection in closed rooms varies slowly over surfaces, yet every path pays for all its bounces.
+// With --radiance-cache the scalar integrator renders in two passes (output.cc):
+// => Training: the first part of the samples are traced as usual, and every diffuse hit after the camera ray
+//    adds the radiance its path brought back to a cell of a hash grid over the scene.
+// => Query: the remaining samples stop at diffuse hits from a set bounce on and take the cell's average instead,
+//    once the cell has seen enough samples. Paths that find no usable cell go on as usual.
+// Cells are cubes of a fixed size, split by the dominant axis of the normal so the two sides of a wall or a
+// corner do not mix. The table is open addressed with linear probing; a worker claims an empty slot with one
+// compare-and-swap and adds to it with atomic fixed-point sums, so training needs no locks.
+// The cache trades noise for bias: light is averaged over a cell, and samples are clamped before they are added
+// so a few fireflies cannot light up a cell.
+
+enum class CacheQuality { Off, Preview, Final };
+
+/** @brief Quality of a --radiance-cache name. @throws std::invalid_argument for unknown names. */
+CacheQuality parseCacheQuality(const std::string& name);
+
+class RadianceCache {
+
+    public:
+
+        /** @brief Empty cache of 2^log2_entries cells of the given size (world units). */
+        RadianceCache(CacheQuality quality, double cell_size, int log2_entries = 20);
+
+        /** @brief Adds an estimate of the radiance leaving a diffuse surface at p with normal n. */
+        void insert(const point3& p, const vec3& n, const color& radiance);
+
+        /** @brief Average of the cell of (p, n) if it has at least minSamples() samples. Counts the lookup. */
+        bool lookup(const point3& p, const vec3& n, color& radiance);
+
+        /** @brief Paths stop at diffuse hits of this bounce and later when querying (1 = first bounce after the camera ray). */
+        int firstBounce() const { return first_bounce; }
+        int minSamples() const { return min_samples; }
+
+        /** @brief Share of the samples per pixel spent training. */
+        double trainingFraction() const { return training_fraction; }
+
+        double cellSize() const { return cell_size; }
+        size_t memoryBytes() const;
+
+        /** @brief Cells holding samples. */
+        size_t cells() const;
+
+        uint64_t lookups() const;
+        uint64_t hits() const;
+
+        bool training = true;   // insert() in this pass (output() clears it before the query pass)
+
+    private:
+
+        struct Entry {
+            std::atomic<uint64_t> key{0};   // 0 while the slot is free
+            std::atomic<uint64_t> sum[3];   // radiance in 1/FIXED_ONE units
+            std::atomic<uint32_t> count{0};
+        };
+
+        // Lookup counters, spread over cache lines so workers rarely share one.
+        struct alignas(64) Counter {
+            std::atomic<uint64_t> lookups{0};
+            std::atomic<uint64_t> hits{0};
+        };
+        static const int COUNTERS = 64;
+
+        std::unique_ptr<Entry[]> entries;
+        uint64_t mask;
+        Counter counters[COUNTERS];
+
+        double cell_size;
+        double inv_cell_size;
+        int first_bounce;
+        int min_samples;
+        double training_fraction;
+
+        /** @brief Key of the cell holding (p, n); never 0. */
+        uint64_t keyOf(const point3& p, const vec3& n) const;
+
+        /** @brief Slot of key, claiming a free one if insert is set. nullptr if not found within the probe limit. */
+        Entry* find(uint64_t key, bool insert);
+};
+
+#endif
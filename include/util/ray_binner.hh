@@ -0,0 +1,52 @@
+#ifndef RAY_BINNER_H
+#define RAY_BINNER_H
+
+#include <embree4/rtcore.h>
+#include <vector>
+#include "render.h"
+
+// RAY REORDERING
+// After the first diffuse bounce a lane's next ray points anywhere, so packets built from whatever ray each
+// lane happens to hold make rtcIntersect4/8 traverse nearly one ray at a time. With reordering on, the packet
+// kernels hand every secondary ray to a RayBinner instead, and build each packet from a single bin:
+// => Bins are keyed by origin cell (a CELLS^3 grid over the scene bounds) and direction octant.
+// => Packets come from a bin holding at least a full packet if there is one, then from the primary rays
+//    (which are coherent already), and only then from partially filled bins.
+// Pixel state is kept per pixel (RayQueue::index), so it does not matter which lane a ray ends up in.
+
+class RayBinner {
+
+    public:
+
+        static const int CELLS = 4;
+
+        /** @brief bounds is the scene's (rtcGetSceneBounds); packet_size the lane count of the kernel. */
+        RayBinner(const RTCBounds& bounds, int packet_size);
+
+        void push(const RayQueue& r);
+
+        /**
+         * @brief Gives every lane whose mask is 0 a ray (setting its mask to -1), taking from the bins in the
+         * order above and from primary (back first). Lanes stay 0 once there is nothing left.
+        */
+        void refill(std::vector<RayQueue>& current, int mask[], std::vector<RayQueue>& primary);
+
+        size_t pending() const;
+
+    private:
+
+        int packet_size;
+        float lower[3];
+        float cell_scale[3];
+
+        std::vector<std::vector<RayQueue>> bins;
+        std::vector<int> full;          // bins holding at least packet_size rays
+        std::vector<char> in_full;
+        size_t pending_rays = 0;
+        int cursor = 0;                 // next bin to drain once only partial bins are left
+
+        int binOf(const ray& r) const;
+        void take(int bin, std::vector<RayQueue>& current, int mask[], int& lane);
+};
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// SAMPLERS
+// Every random decision of a path reads its numbers from a Sampler instead of calling random_double().
+// A sample is addressed by (pixel, sample index, dimension) and samplers are stateless, so packet lanes,
+// threads and bounces can ask for any sample in any order.
+//
+// DIMENSIONS
+// Dimensions are allocated the same way for every path, so each dimension always drives the same decision
+// (low-discrepancy sequences only help if that holds):
+// => DIM_PIXEL (2D)  position within the pixel
+// => DIM_LENS  (2D)  point on the camera aperture
+// => bounce b starts at DIM_BOUNCE + b * DIMS_PER_BOUNCE:
+//      +0 (2D) BSDF direction, +2 (1D) BSDF choice (reflect/refract, alpha test), +3 (2D) environment sample,
+//      +5 (2D) emitter sample (light BVH choice and point on the light)
+
+const uint32_t DIM_PIXEL = 0;
+const uint32_t DIM_LENS = 2;
+const uint32_t DIM_BOUNCE = 4;
+const uint32_t DIMS_PER_BOUNCE = 7;
+
+enum class SamplerType { Random, Stratified, Sobol, BlueNoise };
+
+/** @brief Parses "random", "stratified", "sobol" or "bluenoise". @throws std::invalid_argument otherwise. */
+SamplerType parseSamplerType(const std::string& name);
+std::string samplerName(SamplerType type);
+
+/** @brief Numbers for one BSDF evaluation: (u, v) for the direction, w for a discrete choice. */
+struct ScatterSample {
+    double u, v, w;
+};
+
+class Sampler {
+
+    public:
+
+        virtual ~Sampler() = default;
+
+        /** @brief Values in [0,1) of dimensions dim and dim+1 of sample index of pixel (y * image_width + x). */
+        virtual void get2D(uint32_t pixel, uint32_t index, uint32_t dim, double& u, double& v) const = 0;
+        virtual double get1D(uint32_t pixel, uint32_t index, uint32_t dim) const = 0;
+
+        /** @brief BSDF numbers of the given bounce (0 = the camera ray's hit). */
+        ScatterSample scatter(uint32_t pixel, uint32_t index, uint32_t bounce) const;
+
+        /** @brief Environment light sample numbers of the given bounce. */
+        void light(uint32_t pixel, uint32_t index, uint32_t bounce, double& u, double& v) const;
+
+        /** @brief Emitter light sample numbers of the given bounce. */
+        void emitter(uint32_t pixel, uint32_t index, uint32_t bounce, double& u, double& v) const;
+
+        /**
+         * @brief Creates a sampler. samples_per_pixel sizes the stratified strata and image_width lets the
+         * blue-noise sampler recover pixel coordinates.
+        */
+        static std::unique_ptr<Sampler> create(SamplerType type, int samples_per_pixel, int image_width);
+};
+
+/** @brief Independent white noise from random_double(), the renderer's original behaviour. */
+class RandomSampler : public Sampler {
+    public:
+        void get2D(uint32_t pixel, uint32_t index, uint32_t dim, double& u, double& v) const override;
+        double get1D(uint32_t pixel, uint32_t index, uint32_t dim) const override;
+};
+
+/**
+ * @brief Jittered stratification: the samples of a pixel fall in distinct cells of a ceil(sqrt(spp))^2 grid
+ * (2D) or of spp intervals (1D). Cells are visited in an order permuted per pixel and dimension.
+*/
+class StratifiedSampler : public Sampler {
+    public:
+        StratifiedSampler(int samples_per_pixel);
+        void get2D(uint32_t pixel, uint32_t index, uint32_t dim, double& u, double& v) const override;
+        double get1D(uint32_t pixel, uint32_t index, uint32_t dim) const override;
+    private:
+        uint32_t samples;
+        uint32_t grid;
+};
+
+/**
+ * @brief 2D Sobol (0,2)-sequence padded across dimension pairs, with hash-based Owen scrambling and a shuffled
+ * sample order per pixel and dimension pair (Burley 2020, "Practical Hash-based Owen Scrambling").
+*/
+class SobolSampler : public Sampler {
+    public:
+        void get2D(uint32_t pixel, uint32_t index, uint32_t dim, double& u, double& v) const override;
+        double get1D(uint32_t pixel, uint32_t index, uint32_t dim) const override;
+};
+
+/**
+ * @brief The Owen-scrambled Sobol sequence shared by all pixels, toroidally shifted per pixel by a 64x64
+ * blue-noise mask (offset differently per dimension). Neighbouring pixels get well separated offsets, so
+ * the remaining error is pushed to high screen-space frequencies.
+*/
+class BlueNoiseSampler : public Sampler {
+    public:
+        BlueNoiseSampler(int image_width);
+        void get2D(uint32_t pixel, uint32_t index, uint32_t dim, double& u, double& v) const override;
+        double get1D(uint32_t pixel, uint32_t index, uint32_t dim) const override;
+    private:
+        uint32_t width;
+        const std::vector<float>& mask;
+        double offset(uint32_t pixel, uint32_t dim) const;
+};
+
+#endif
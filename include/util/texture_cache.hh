@@ -0,0 +1,115 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <cstdint>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "mapped_file.hh"
+
+/** @brief One mip level of an ImageData, stored as TILE x TILE pixel tiles. */
+struct ImageLevel {
+    int width;
+    int height;
+    int tiles_x;        // tiles per row
+    uint64_t offset;    // byte offset of the level's first tile from ImageData::pixels
+};
+
+/**
+ * @class ImageData
+ * @brief Decoded, immutable pixel data shared by every image that loads the same file contents.
+ *
+ * Pixels are stored in TILE x TILE tiles (row-major tiles, row-major pixels inside a tile) so that
+ * nearby lookups touch the same cache lines, followed by a full box-filtered mip chain.
+ * The memory either belongs to the object or is a mapping of an on-disk cache file.
+*/
+class ImageData {
+
+    public:
+
+        static const int TILE = 8;
+
+        int bytes_per_pixel = 3;
+        std::vector<ImageLevel> levels;
+        const unsigned char* pixels = nullptr;
+
+        /** @brief Address of the pixel at x, y of the given level. Coordinates must be in range. */
+        const unsigned char* texel(int x, int y, int level = 0) const {
+            const ImageLevel& l = levels[level];
+            int tile = (y / TILE) * l.tiles_x + (x / TILE);
+            int inner = (y % TILE) * TILE + (x % TILE);
+            return pixels + l.offset + (static_cast<uint64_t>(tile) * TILE * TILE + inner) * bytes_per_pixel;
+        }
+
+        int width() const { return levels.empty() ? 0 : levels[0].width; }
+        int height() const { return levels.empty() ? 0 : levels[0].height; }
+
+        /** @brief Converts a row-major decoded image into tiled, mipmapped data owned by the result. */
+        static std::shared_ptr<ImageData> fromLinear(const unsigned char* linear, int width, int height, int bytes_per_pixel);
+
+        // Backing storage: exactly one of these holds the bytes pixels points into.
+        std::vector<unsigned char> owned;
+        std::shared_ptr<MappedFile> mapping;
+};
+
+/**
+ * @class TextureCache
+ * @brief Process-wide cache of decoded images keyed by file content hash.
+ *
+ * => Image lookups ($IMAGES, then the path itself) are resolved once per file name.
+ * => Files are hashed once per (path, size, mtime), so an unchanged file is never re-read to be identified.
+ * => Images with identical contents are decoded once and shared (reference counted) by every texture
+ *    and scene that uses them, including concurrent requests from pool threads.
+ * => With a disk cache directory set, the tiled and mipmapped form is written to <dir>/<hash>-<bpp>.ctex
+ *    and later runs map that file directly instead of decoding the JPEG/PNG at all.
+*/
+class TextureCache {
+
+    public:
+
+        struct Stats {
+            int requests = 0;
+            int shared = 0;      // served from memory, already decoded for another texture or scene
+            int disk_hits = 0;   // mapped from the on-disk cache
+            int decodes = 0;     // decoded from the source image
+        };
+
+        static TextureCache& shared();
+
+        /** @brief Enables the on-disk cache. The directory is created if it does not exist. */
+        void setDiskCache(const std::string& directory);
+
+        /** @brief Returns the decoded image for filename, or nullptr if it cannot be found or decoded. */
+        std::shared_ptr<const ImageData> get(const std::string& filename, int bytes_per_pixel);
+
+        Stats stats();
+
+    private:
+        struct FileId {
+            int64_t size;
+            int64_t mtime_sec;
+            int64_t mtime_nsec;
+            uint64_t hash;
+        };
+        typedef std::pair<uint64_t, int> Key; // content hash, bytes per pixel
+
+        std::mutex mutex;
+        std::string disk_cache;
+        std::map<std::string, std::string> resolved_paths;
+        std::map<std::string, FileId> file_ids;
+        std::map<Key, std::weak_ptr<const ImageData>> entries;
+        std::map<Key, std::shared_future<std::shared_ptr<const ImageData>>> in_flight;
+        Stats counters;
+
+        std::string resolvePath(const std::string& filename);
+        bool contentHash(const std::string& path, uint64_t& hash);
+        std::string diskPath(const Key& key) const;
+        std::shared_ptr<const ImageData> loadFromDisk(const std::string& path, int bytes_per_pixel);
+        void writeToDisk(const std::string& path, const ImageData& data);
+};
+
+#endif
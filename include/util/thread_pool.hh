@@ -0,0 +1,107 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+/**
+ * @class ThreadPool
+ * @brief Fixed set of worker threads consuming a FIFO task queue, plus one private queue per worker.
+ *
+ * The process shares one pool (ThreadPool::shared()) for startup work such as texture decoding,
+ * joining Embree's BVH build and rendering, so none of those spawn threads of their own.
+ *
+ * NUMA
+ * => Workers are spread evenly over the CPUs listed in /sys/devices/system/node, ordered node by node,
+ *    so worker i always runs on node(i) and consecutive workers share a node.
+ * => With pinning enabled each worker is bound to its CPU, so memory it touches first (its scratch
+ *    buffers, the framebuffer rows it renders) is allocated on its own node and stays local.
+ * => submitTo() runs a task on a specific worker, which keeps the same data on the same node every time.
+*/
+class ThreadPool {
+
+    public:
+
+        /**
+         * @param threads number of workers. If <= 0, uses hardware concurrency.
+         * @param pin bind each worker to one CPU (Linux only; ignored elsewhere).
+        */
+        ThreadPool(int threads, bool pin = false);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        /** @brief Queues a task for any worker. The returned future rethrows anything the task throws. */
+        template <typename F>
+        auto submit(F task) -> std::future<decltype(task())> {
+            return enqueue(-1, std::move(task));
+        }
+
+        /** @brief Queues a task for one specific worker (0 <= worker < size()). */
+        template <typename F>
+        auto submitTo(int worker, F task) -> std::future<decltype(task())> {
+            return enqueue(worker, std::move(task));
+        }
+
+        int size() const;
+
+        /** @brief NUMA node worker runs on (0 if the topology is unknown). */
+        int node(int worker) const;
+
+        /** @brief Number of NUMA nodes the workers are spread over. */
+        int nodeCount() const;
+
+        bool pinned() const;
+
+        /**
+         * @brief Sets the size and pinning of the shared pool. Must be called before the first use of shared(),
+         * otherwise it has no effect and returns false.
+        */
+        static bool configureShared(int threads, bool pin);
+
+        /** @brief Process-wide pool, created on first use (one unpinned worker per hardware thread by default). */
+        static ThreadPool& shared();
+
+    private:
+        struct Worker {
+            std::thread thread;
+            std::queue<std::function<void()>> tasks;
+            int cpu = -1;
+            int node = 0;
+        };
+
+        std::vector<Worker> workers;
+        std::queue<std::function<void()>> tasks;
+        std::mutex queue_mutex;
+        std::condition_variable queue_cv;
+        bool stopping = false;
+        bool pin_workers = false;
+        int node_count = 1;
+
+        template <typename F>
+        auto enqueue(int worker, F task) -> std::future<decltype(task())> {
+            using R = decltype(task());
+            auto packaged = std::make_shared<std::packaged_task<R()>>(std::move(task));
+            std::future<R> result = packaged->get_future();
+            {
+                std::lock_guard<std::mutex> lock(queue_mutex);
+                auto& queue = (worker >= 0 && worker < (int)workers.size()) ? workers[worker].tasks : tasks;
+                queue.push([packaged]() { (*packaged)(); });
+            }
+            // A private task has to wake its own worker, so wake everyone in that case.
+            if (worker >= 0) queue_cv.notify_all();
+            else queue_cv.notify_one();
+            return result;
+        }
+
+        void workerLoop(int index);
+};
+
+#endif
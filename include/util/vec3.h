@@ -81,6 +81,12 @@ vec3 random_in_unit_sphere();
 vec3 random_in_hemisphere(const vec3& normal);
 vec3 random_in_unit_disk();
 
+// the same distributions, warped from given numbers in [0,1) (see sampler.hh)
+vec3 sample_unit_vector(double u, double v);
+vec3 sample_in_unit_sphere(double u, double v, double w);
+vec3 sample_in_hemisphere(const vec3& normal, double u, double v);
+vec3 sample_in_unit_disk(double u, double v);
+
 // reflection and refraction
 vec3 reflect(const vec3& v, const vec3& n);
 vec3 refract(const vec3& uv, const vec3& n, float etai_over_etat);
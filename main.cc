@@ -2,22 +2,96 @@
 #include "csr_parser.hh"
 #include "cli_parser.hh"
 #include "device.h"
+#include "render_server.hh"
+#include "texture_cache.hh"
+#include "thread_pool.hh"
 
 #include "output.h"
+#include "live_preview.h"
+#include "estimator.h"
+#include "autotune.h"
 
 int main(int argc, char* argv[]) {
+    auto process_start = std::chrono::steady_clock::now();
     Config config = parseArguments(argc, argv);
+
+    if (!config.previewDump.empty()) {
+        int frames = dumpPreview(config.previewDump, config.outputPath);
+        if (config.verbose) std::cerr << "Wrote " << frames << " preview frames to " << config.outputPath << std::endl;
+        return 0;
+    }
+
+    if (!config.compileFile.empty()) {
+        std::string csrbPath = config.outputPath;
+        if (csrbPath == "image.ppm") { // no -o given, write next to the source
+            csrbPath = config.compileFile.substr(0, config.compileFile.find_last_of('.')) + ".csrb";
+        }
+        CSRParser parser;
+        parser.compileCSR(config.compileFile, csrbPath);
+        if (config.verbose) std::cerr << "Compiled " << config.compileFile << " -> " << csrbPath << std::endl;
+        return 0;
+    }
+
+    // Size the shared pool before anything uses it: it renders (-mt), decodes textures and joins BVH builds.
+    ThreadPool::configureShared(config.multithreading ? config.threads : -1, config.pinThreads);
+
+    if (!config.textureCacheDir.empty()) TextureCache::shared().setDiskCache(config.textureCacheDir);
+
+    if (!config.serverSocket.empty()) {
+        RenderServer server(config);
+        server.run();
+        return 0;
+    }
     
     RenderData render_data;
+    render_data.stats.start = process_start;
     const auto aspect_ratio = static_cast<float>(config.image_width) / config.image_height;
     setRenderData(render_data, aspect_ratio, config.image_width, config.samples_per_pixel, config.max_depth);
     std::string filePath = config.inputFile;
-    RTCDevice device = initializeDevice();
+    RTCDevice device = initializeDevice(deviceConfigString(config));
     CSRParser parser;
+    auto parse_start = std::chrono::steady_clock::now();
     auto scene_ptr = parser.parseCSR(filePath, device);
+    render_data.stats.parse_seconds = secondsSince(parse_start);
+    render_data.stats.mesh_load_seconds = scene_ptr->mesh_load_seconds;
+    render_data.stats.mesh_triangles = scene_ptr->mesh_triangles;
+
+    if (!config.buildQuality.empty() || !config.sceneFlags.empty()) scene_ptr->setBuildSettings(buildSettings(config, scene_ptr->build));
+    auto commit_start = std::chrono::steady_clock::now();
     scene_ptr->commitScene();
+    render_data.stats.commit_seconds = secondsSince(commit_start);
+    render_data.stats.bvh_build_seconds = scene_ptr->bvh_build_seconds;
+    render_data.stats.bvh_bytes = deviceMemoryBytes();
+    render_data.stats.bvh_peak_bytes = deviceMemoryPeakBytes();
+    render_data.stats.lights = scene_ptr->lights.size();
+    render_data.stats.light_bvh_seconds = scene_ptr->lights.build_seconds;
+    render_data.stats.light_bvh_bytes = scene_ptr->lights.memoryBytes();
     rtcReleaseDevice(device);
 
-    output(render_data, scene_ptr->cam, scene_ptr, config);
+    if (config.autotune) autotune(render_data, scene_ptr->cam, scene_ptr, config);
+
+    if (config.estimate) {
+        RenderEstimate estimate = estimateRender(render_data, scene_ptr->cam, scene_ptr, config);
+        writeEstimateJSON(std::cout, estimate, render_data, config);
+        return 0;
+    }
+
+    if (!scene_ptr->isAnimated() && config.frames == 0) {
+        output(render_data, scene_ptr->cam, scene_ptr, config);
+        if (config.samplerReport) reportSamplerError(render_data, scene_ptr->cam, scene_ptr, config, std::cerr);
+        return 0;
+    }
+
+    // Frame sequence: the device, textures, thread pool and BVH are reused, and each frame only
+    // updates and refits what its keyframes moved.
+    int frames = config.frames > 0 ? config.frames : scene_ptr->frameCount();
+    Config frame_config = config;
+    for (int frame = 0; frame < frames; ++frame) {
+        Camera cam = scene_ptr->setFrame(frame);
+        frame_config.outputPath = frameOutputPath(config, frame);
+        render_data.stats.start = std::chrono::steady_clock::now();
+        output(render_data, cam, scene_ptr, frame_config);
+        if (config.verbose) std::cerr << "Frame " << frame + 1 << "/" << frames << " -> " << frame_config.outputPath << std::endl;
+    }
 }
 
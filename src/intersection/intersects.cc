@@ -15,6 +15,19 @@ void setupRayHit1(struct RTCRayHit& rayhit, const ray& r) {
     rayhit.hit.instID[0] = RTC_INVALID_GEOMETRY_ID;
 }
 
+void setupShadowRay1(struct RTCRay& shadow, const ray& r, float tfar) {
+    shadow.org_x = r.origin().x();
+    shadow.org_y = r.origin().y();
+    shadow.org_z = r.origin().z();
+    shadow.dir_x = r.direction().x();
+    shadow.dir_y = r.direction().y();
+    shadow.dir_z = r.direction().z();
+    shadow.tnear = 0.001;
+    shadow.tfar = tfar;
+    shadow.mask = -1;
+    shadow.flags = 0;
+}
+
 void setupRayHit4(struct RTCRayHit4& rayhit, std::vector<ray>& rays) {
     int ix = 0;
     for(auto r: rays) {
@@ -0,0 +1,87 @@
+#include "material_table.hh"
+#include "material.h"
+#include "geometry.h"
+#include <stdexcept>
+#include <string>
+
+void MaterialTable::compile(const std::map<unsigned int, std::shared_ptr<Geometry>>& geom_map) {
+    *this = MaterialTable();
+    for (const auto& entry : geom_map) entry.second->bindMaterials(*this, entry.first);
+}
+
+uint32_t MaterialTable::add(const std::shared_ptr<material>& m) {
+    auto found = material_ids.find(m.get());
+    if (found != material_ids.end()) return found->second;
+    uint32_t id = m->compile(*this);
+    material_ids[m.get()] = id;
+    sources.push_back(m);
+    return id;
+}
+
+uint32_t MaterialTable::add(const std::shared_ptr<texture>& t) {
+    auto found = texture_ids.find(t.get());
+    if (found != texture_ids.end()) return found->second;
+    uint32_t id = t->compile(*this);
+    texture_ids[t.get()] = id;
+    sources.push_back(t);
+    return id;
+}
+
+uint32_t MaterialTable::addMaterial(MaterialKind kind, color albedo, double param, uint32_t tex) {
+    this->kind.push_back(kind);
+    this->albedo.push_back(albedo);
+    this->param.push_back(param);
+    albedo_texture.push_back(tex);
+    return static_cast<uint32_t>(this->kind.size() - 1);
+}
+
+uint32_t MaterialTable::addTexture(TextureKind kind) {
+    tex_kind.push_back(kind);
+    tex_color.push_back(color(0,0,0));
+    tex_scale.push_back(0);
+    tex_even.push_back(0);
+    tex_odd.push_back(0);
+    tex_noise.push_back(nullptr);
+    tex_image.push_back(nullptr);
+    return static_cast<uint32_t>(tex_kind.size() - 1);
+}
+
+uint32_t MaterialTable::addSolid(color c) {
+    uint32_t id = addTexture(TextureKind::Solid);
+    tex_color[id] = c;
+    return id;
+}
+
+uint32_t MaterialTable::addChecker(double inv_scale, uint32_t even, uint32_t odd) {
+    uint32_t id = addTexture(TextureKind::Checker);
+    tex_scale[id] = inv_scale;
+    tex_even[id] = even;
+    tex_odd[id] = odd;
+    return id;
+}
+
+uint32_t MaterialTable::addNoise(const perlin* noise, double scale) {
+    uint32_t id = addTexture(TextureKind::Noise);
+    tex_noise[id] = noise;
+    tex_scale[id] = scale;
+    return id;
+}
+
+uint32_t MaterialTable::addImage(const image* img, bool alpha) {
+    uint32_t id = addTexture(alpha ? TextureKind::PixelImage : TextureKind::Image);
+    tex_image[id] = img;
+    return id;
+}
+
+void MaterialTable::bindGeometry(unsigned int geomID, const std::vector<std::shared_ptr<material>>& materials,
+                                    const uint32_t* faces, size_t face_count) {
+    if (materials.empty()) throw std::invalid_argument("Geometry " + std::to_string(geomID) + " has no material");
+    if (bindings.size() <= geomID) bindings.resize(geomID + 1);
+
+    GeometryBinding& b = bindings[geomID];
+    b.first = static_cast<uint32_t>(slots.size());
+    b.count = static_cast<uint32_t>(materials.size());
+    b.faces = faces;
+    b.face_count = face_count;
+    for (const auto& m : materials) slots.push_back(add(m));
+}
@@ -1,4 +1,17 @@
 #include "texture.h"
+#include "material_table.hh"
+
+const unsigned char* image_texel(const image& img, double u, double v) {
+    // Clamp input texture coordinates to [0,1] x [1,0]
+    u = clamp(u, 0.0, 1.0);
+
+    if (0 <= v && v <= 1) v = 1 - v;
+    else v = clamp(v, 0.0, 1.0);
+
+    auto i = static_cast<int>(u * img.width());
+    auto j = static_cast<int>(v * img.height());
+    return img.pixel_data(i,j);
+}
 
 noise_texture::noise_texture() {}
 noise_texture::noise_texture(double sc) : scale(sc) {}
@@ -8,11 +21,15 @@ color noise_texture::value(double u, double v, const point3& p) const {
     return color(1,1,1) * 0.5 * (1 + sin(s.z() + 10*noise.turb(s)));
 }
 
+uint32_t noise_texture::compile(MaterialTable& table) const { return table.addNoise(&noise, scale); }
+
 solid_color::solid_color(color c) : color_value(c) {}
 solid_color::solid_color(double red, double green, double blue) : solid_color(color(red, green, blue)) {}
 
 color solid_color::value(double u, double v, const point3& p) const { return color_value; }
 
+uint32_t solid_color::compile(MaterialTable& table) const { return table.addSolid(color_value); }
+
 
 
 checker_texture::checker_texture(double _scale, shared_ptr<texture> _even, shared_ptr<texture> _odd)
@@ -33,30 +50,38 @@ color checker_texture::value(double u, double v, const point3& p) const {
     return isEven ? even->value(u, v, p) : odd->value(u, v, p);
 }
 
+uint32_t checker_texture::compile(MaterialTable& table) const {
+    uint32_t even_id = table.add(even);
+    uint32_t odd_id = table.add(odd);
+    return table.addChecker(inv_scale, even_id, odd_id);
+}
+
 
 image_texture::image_texture(const char* filename) : image_data(filename) {}
 
+image_texture::image_texture() {}
+
+void image_texture::load(const char* filename) { image_data.open(filename); }
+
 color image_texture::value(double u, double v, const point3& p) const {
     // If we have no texture data, then return solid cyan as a debugging aid.
     if (image_data.height() <= 0) return color(0,1,1);
 
-    // Clamp input texture coordinates to [0,1] x [1,0]
-    u = clamp(u, 0.0, 1.0);
-
-    if (0 <= v && v <= 1) v = 1 - v;
-    else v = clamp(v, 0.0, 1.0);
-    
-    auto i = static_cast<int>(u * image_data.width());
-    auto j = static_cast<int>(v * image_data.height());
-    auto pixel = image_data.pixel_data(i,j);
+    auto pixel = image_texel(image_data, u, v);
 
     auto color_scale = 1.0 / 255.0;
     return color(color_scale*pixel[0], color_scale*pixel[1], color_scale*pixel[2]);
 }
 
+uint32_t image_texture::compile(MaterialTable& table) const { return table.addImage(&image_data, false); }
+
 // Pixel Image Textures
 PixelImageTexture::PixelImageTexture(const char* filename) : img(filename, 4) {}
 
+PixelImageTexture::PixelImageTexture() {}
+
+void PixelImageTexture::load(const char* filename) { img.open(filename, 4); }
+
 color PixelImageTexture::value(double u, double v, const point3& p) const {
     throw std::runtime_error("Incorrect value func. called. Use { color4 value(double u, double v) } instead.");
     return color(0,1,1);
@@ -66,19 +91,13 @@ color4 PixelImageTexture::value(double u, double v) const {
 
     if (img.height() <= 0) throw std::invalid_argument("Image height is less than 0");
 
-    u = clamp(u, 0.0, 1.0);
-
-    if (0 <= v && v <= 1) v = 1 - v;
-    else v = clamp(v, 0.0, 1.0);
-
-    auto i = static_cast<int>(u * img.width());
-    auto j = static_cast<int>(v * img.height());
-
-    auto pixel = img.pixel_data(i,j);
+    auto pixel = image_texel(img, u, v);
     auto color_scale = 1.0 / 255.0;
 
     return color4 {
         static_cast<float>(color_scale)*pixel[3],
         color(color_scale*pixel[0], color_scale*pixel[1], color_scale*pixel[2]), 
     };
-}
\ No newline at end of file
+}
+
+uint32_t PixelImageTexture::compile(MaterialTable& table) const { return table.addImage(&img, true); }
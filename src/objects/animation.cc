@@ -0,0 +1,36 @@
+#include "animation.h"
+#include <algorithm>
+
+namespace {
+    // Index of the key at or before frame and the blend weight towards the next key.
+    template <typename Key>
+    size_t locate(const std::vector<Key>& keys, double frame, double& weight) {
+        weight = 0;
+        if (frame <= keys.front().frame) return 0;
+        if (frame >= keys.back().frame) return keys.size() - 1;
+        auto next = std::upper_bound(keys.begin(), keys.end(), frame, [](double f, const Key& k) { return f < k.frame; });
+        size_t i = (next - keys.begin()) - 1;
+        weight = (frame - keys[i].frame) / (keys[i + 1].frame - keys[i].frame);
+        return i;
+    }
+
+    template <typename T>
+    T lerp(const T& a, const T& b, double t) { return (1.0 - t) * a + t * b; }
+}
+
+vec3 interpolate(const std::vector<PositionKeyframe>& keys, double frame) {
+    double t;
+    size_t i = locate(keys, frame, t);
+    if (t == 0) return keys[i].position;
+    return lerp(keys[i].position, keys[i + 1].position, t);
+}
+
+Camera interpolate(const std::vector<CameraKeyframe>& keys, double frame, double aspect_ratio) {
+    double t;
+    size_t i = locate(keys, frame, t);
+    const CameraKeyframe& a = keys[i];
+    if (t == 0) return Camera(a.lookfrom, a.lookat, a.vup, a.vfov, aspect_ratio, a.aperture, a.focus_dist);
+    const CameraKeyframe& b = keys[i + 1];
+    return Camera(lerp(a.lookfrom, b.lookfrom, t), lerp(a.lookat, b.lookat, t), lerp(a.vup, b.vup, t),
+                  lerp(a.vfov, b.vfov, t), aspect_ratio, lerp(a.aperture, b.aperture, t), lerp(a.focus_dist, b.focus_dist, t));
+}
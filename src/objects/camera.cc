@@ -7,7 +7,8 @@ Camera::Camera(
     double vfov, 
     double aspect_ratio,
     double aperture,
-    double focus_dist) : Base(lookfrom) {
+    double focus_dist) : Base(lookfrom), lookat{lookat}, vup{vup}, vfov{vfov},
+                         aspect_ratio{aspect_ratio}, aperture{aperture}, focus_dist{focus_dist} {
     
     // Convert vertical field of view from degrees to radians
     auto theta = degrees_to_radians(vfov);
@@ -32,11 +33,21 @@ Camera::Camera(
     lens_radius = aperture / 2;
 }
 
-ray Camera::get_ray(double s, double t) const {
-    vec3 rd = lens_radius * random_in_unit_disk();
+ray Camera::get_ray(double s, double t) const { return get_ray(s, t, random_double(), random_double()); }
+
+ray Camera::get_ray(double s, double t, double lens_u, double lens_v) const {
+    vec3 rd = lens_radius * sample_in_unit_disk(lens_u, lens_v);
     vec3 offset = u * rd.x() + v * rd.y();
 
 
     return ray(position + offset, 
         lower_left_corner + s*horizontal + t*vertical - position - offset, 0.0);
-}
\ No newline at end of file
+}
+
+point3 Camera::getLookfrom() const { return position; }
+point3 Camera::getLookat() const { return lookat; }
+vec3 Camera::getVup() const { return vup; }
+double Camera::getVfov() const { return vfov; }
+double Camera::getAspectRatio() const { return aspect_ratio; }
+double Camera::getAperture() const { return aperture; }
+double Camera::getFocusDist() const { return focus_dist; }
\ No newline at end of file
@@ -0,0 +1,93 @@
+#include "environment.h"
+#include "general.h"
+#include "stb_image.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+color Environment::sample(double u, double v, vec3& direction, double& pdf) const {
+    direction = vec3(0, 1, 0);
+    pdf = 0;
+    return color(0, 0, 0);
+}
+
+// GRADIENT SKY
+
+color GradientSky::radiance(const vec3& direction) const {
+    vec3 unit_direction = direction.unit_vector();
+    auto t = 0.5*(unit_direction.y() + 1.0);
+    return (1.0-t)*color(1.0, 1.0, 1.0) + t*color(0.5, 0.7, 1.0); // lerp formula (1.0-t)*start + t*endval
+}
+
+// IMAGE ENVIRONMENT
+
+ImageEnvironment::ImageEnvironment(double intensity) : intensity{intensity} {}
+
+void ImageEnvironment::load(const std::string& path) {
+    int w, h, n;
+    float* data = stbi_loadf(path.c_str(), &w, &h, &n, 3);
+    if (data == nullptr) throw std::runtime_error("Could not load environment image '" + path + "': " + stbi_failure_reason());
+
+    pixels.resize(static_cast<size_t>(w) * h);
+    for (size_t i = 0; i < pixels.size(); ++i) {
+        pixels[i] = intensity * color(data[3*i], data[3*i + 1], data[3*i + 2]);
+    }
+    stbi_image_free(data);
+
+    // Rows near the poles cover less solid angle, so each pixel is weighted by sin(theta) at its row centre.
+    std::vector<double> row_weights(h);
+    std::vector<double> weights(w);
+    columns.assign(h, AliasTable());
+    for (int y = 0; y < h; ++y) {
+        double sin_theta = std::sin(pi * (y + 0.5) / h);
+        for (int x = 0; x < w; ++x) {
+            const color& c = pixels[static_cast<size_t>(y) * w + x];
+            weights[x] = std::max(0.0, 0.2126*c.x() + 0.7152*c.y() + 0.0722*c.z()) * sin_theta;
+        }
+        columns[y].build(weights);
+        row_weights[y] = columns[y].total();
+    }
+    rows.build(row_weights);
+    width = w;
+    height = h;
+}
+
+void ImageEnvironment::pixelOf(const vec3& direction, int& x, int& y) const {
+    vec3 d = direction.unit_vector();
+    double u = (std::atan2(d.z(), d.x()) + pi) / (2*pi);
+    double v = std::acos(std::clamp(static_cast<double>(d.y()), -1.0, 1.0)) / pi;
+    x = std::clamp(static_cast<int>(u * width), 0, width - 1);
+    y = std::clamp(static_cast<int>(v * height), 0, height - 1);
+}
+
+color ImageEnvironment::radiance(const vec3& direction) const {
+    if (width == 0) return color(0, 0, 0);
+    int x, y;
+    pixelOf(direction, x, y);
+    return pixels[static_cast<size_t>(y) * width + x];
+}
+
+color ImageEnvironment::sample(double u, double v, vec3& direction, double& pdf) const {
+    double u_remapped, v_remapped;
+    uint32_t y = rows.sample(u, u_remapped);
+    uint32_t x = columns[y].sample(v, v_remapped);
+
+    double phi = 2*pi * (x + v_remapped) / width - pi;
+    double theta = pi * (y + u_remapped) / height;
+    double sin_theta = std::sin(theta);
+    direction = vec3(sin_theta * std::cos(phi), std::cos(theta), sin_theta * std::sin(phi));
+
+    // Uniform within the pixel in (u, v); the equirectangular map stretches a pixel over 2 pi^2 sin(theta) / (w h) steradians.
+    pdf = sin_theta <= 0 ? 0 : rows.pdf(y) * columns[y].pdf(x) * width * height / (2*pi*pi * sin_theta);
+    return pixels[static_cast<size_t>(y) * width + x];
+}
+
+double ImageEnvironment::pdf(const vec3& direction) const {
+    if (width == 0) return 0;
+    int x, y;
+    pixelOf(direction, x, y);
+    vec3 d = direction.unit_vector();
+    double sin_theta = std::sqrt(std::max(0.0, 1.0 - d.y()*d.y()));
+    if (sin_theta <= 0) return 0;
+    return rows.pdf(y) * columns[y].pdf(x) * width * height / (2*pi*pi * sin_theta);
+}
@@ -10,4 +10,8 @@ color emissive::emitted(double u, double v, const point3& p) const {
     return emission_color;
 }
 
+uint32_t emissive::compile(MaterialTable& table) const {
+    return table.addMaterial(MaterialKind::Emissive, emission_color);
+}
+
 Light::Light(vec3 position) : Visual(position) {}
\ No newline at end of file
@@ -0,0 +1,291 @@
+#include "light_bvh.h"
+#include "general.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+
+// LIGHT SHAPES
+
+LightShape LightShape::quad(const point3& p, const vec3& u, const vec3& v, const color& emission, unsigned int geomID, unsigned int primID) {
+    return LightShape{ Quad, p, u, v, 0, emission, geomID, primID };
+}
+
+LightShape LightShape::triangle(const point3& a, const point3& b, const point3& c, const color& emission, unsigned int geomID, unsigned int primID) {
+    return LightShape{ Triangle, a, b - a, c - a, 0, emission, geomID, primID };
+}
+
+LightShape LightShape::sphere(const point3& center, double radius, const color& emission, unsigned int geomID, unsigned int primID) {
+    return LightShape{ Sphere, center, vec3(0, 0, 0), vec3(0, 0, 0), radius, emission, geomID, primID };
+}
+
+double LightShape::area() const {
+    switch (type) {
+        case Quad: return cross(e1, e2).length();
+        case Triangle: return 0.5 * cross(e1, e2).length();
+        default: return 4 * pi * radius * radius;
+    }
+}
+
+point3 LightShape::sample(double u, double v, vec3& normal) const {
+    switch (type) {
+        case Quad:
+            normal = cross(e1, e2).unit_vector();
+            return p + u*e1 + v*e2;
+        case Triangle: {
+            double su = std::sqrt(u);
+            normal = cross(e1, e2).unit_vector();
+            return p + (su * (1 - v))*e1 + (su * v)*e2;
+        }
+        default: {
+            double z = 1 - 2*u;
+            double r = std::sqrt(std::max(0.0, 1 - z*z));
+            double phi = 2*pi*v;
+            normal = vec3(r * std::cos(phi), r * std::sin(phi), z);
+            return p + radius*normal;
+        }
+    }
+}
+
+static point3 centroid(const LightShape& light) {
+    switch (light.type) {
+        case LightShape::Quad: return light.p + 0.5*(light.e1 + light.e2);
+        case LightShape::Triangle: return light.p + (1.0/3.0)*(light.e1 + light.e2);
+        default: return light.p;
+    }
+}
+
+static double luminance(const color& c) {
+    return 0.2126*c.x() + 0.7152*c.y() + 0.0722*c.z();
+}
+
+// BUILD
+
+void LightBVH::build(std::vector<LightShape> shapes) {
+    auto build_start = std::chrono::steady_clock::now();
+    lights = std::move(shapes);
+    nodes.clear();
+    trails.assign(lights.size(), 0);
+    by_hit.clear();
+    if (!lights.empty()) {
+        nodes.reserve(2*lights.size() - 1);
+        std::vector<uint32_t> order(lights.size());
+        for (uint32_t i = 0; i < order.size(); ++i) order[i] = i;
+        buildRange(order, 0, order.size(), 0, 0);
+        for (uint32_t i = 0; i < lights.size(); ++i) {
+            by_hit[(static_cast<uint64_t>(lights[i].geomID) << 32) | lights[i].primID] = i;
+        }
+    }
+    build_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - build_start).count();
+}
+
+uint32_t LightBVH::buildRange(std::vector<uint32_t>& order, size_t begin, size_t end, int depth, uint64_t trail) {
+    uint32_t index = static_cast<uint32_t>(nodes.size());
+    nodes.push_back(Node{});
+    if (end - begin == 1) {
+        Node leaf = leafNode(lights[order[begin]]);
+        leaf.second = order[begin];
+        leaf.leaf = 1;
+        nodes[index] = leaf;
+        trails[order[begin]] = trail;
+        return index;
+    }
+    if (depth >= 63) throw std::runtime_error("Light BVH is too deep");
+
+    // Median split along the longest axis of the centroids.
+    point3 lo = centroid(lights[order[begin]]), hi = lo;
+    for (size_t i = begin + 1; i < end; ++i) {
+        point3 c = centroid(lights[order[i]]);
+        for (int a = 0; a < 3; ++a) {
+            lo[a] = std::min(lo[a], c[a]);
+            hi[a] = std::max(hi[a], c[a]);
+        }
+    }
+    vec3 extent = hi - lo;
+    int axis = extent.x() > extent.y() ? (extent.x() > extent.z() ? 0 : 2) : (extent.y() > extent.z() ? 1 : 2);
+    size_t mid = (begin + end) / 2;
+    std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end, [&](uint32_t a, uint32_t b) {
+        return centroid(lights[a])[axis] < centroid(lights[b])[axis];
+    });
+
+    buildRange(order, begin, mid, depth + 1, trail);
+    uint32_t right = buildRange(order, mid, end, depth + 1, trail | (uint64_t(1) << depth));
+    Node node = merge(nodes[index + 1], nodes[right]);
+    node.second = right;
+    node.leaf = 0;
+    nodes[index] = node;
+    return index;
+}
+
+LightBVH::Node LightBVH::leafNode(const LightShape& light) {
+    Node node;
+    point3 lo, hi;
+    if (light.type == LightShape::Sphere) {
+        vec3 r(light.radius, light.radius, light.radius);
+        lo = light.p - r;
+        hi = light.p + r;
+    } else {
+        point3 corners[4] = { light.p, light.p + light.e1, light.p + light.e2, light.p + light.e1 + light.e2 };
+        int count = light.type == LightShape::Quad ? 4 : 3;
+        lo = hi = corners[0];
+        for (int i = 1; i < count; ++i) {
+            for (int a = 0; a < 3; ++a) {
+                lo[a] = std::min(lo[a], corners[i][a]);
+                hi[a] = std::max(hi[a], corners[i][a]);
+            }
+        }
+    }
+    for (int a = 0; a < 3; ++a) {
+        node.lower[a] = lo[a];
+        node.upper[a] = hi[a];
+    }
+
+    if (light.type == LightShape::Sphere) {
+        node.axis[0] = 0; node.axis[1] = 0; node.axis[2] = 1;
+        node.cos_theta_o = -1;
+        node.power = luminance(light.emission) * light.area() * pi;
+    } else {
+        vec3 n = cross(light.e1, light.e2).unit_vector();
+        node.axis[0] = n.x(); node.axis[1] = n.y(); node.axis[2] = n.z();
+        node.cos_theta_o = 1;
+        node.power = luminance(light.emission) * light.area() * 2 * pi; // both faces
+    }
+    return node;
+}
+
+LightBVH::Node LightBVH::merge(const Node& a, const Node& b) {
+    Node node;
+    for (int i = 0; i < 3; ++i) {
+        node.lower[i] = std::min(a.lower[i], b.lower[i]);
+        node.upper[i] = std::max(a.upper[i], b.upper[i]);
+    }
+    node.power = a.power + b.power;
+
+    // Union of the two cones. Cones are two-sided, so b may be flipped to face the same way as a.
+    vec3 wa(a.axis[0], a.axis[1], a.axis[2]);
+    vec3 wb(b.axis[0], b.axis[1], b.axis[2]);
+    if (dot(wa, wb) < 0) wb = -wb;
+    vec3 w = wa;
+    double cos_theta_o = -1;
+    if (a.cos_theta_o > -1 && b.cos_theta_o > -1) {
+        double theta_a = std::acos(a.cos_theta_o);
+        double theta_b = std::acos(b.cos_theta_o);
+        double theta_d = std::acos(std::clamp(static_cast<double>(dot(wa, wb)), -1.0, 1.0));
+        if (std::min(theta_d + theta_b, pi) <= theta_a) {
+            cos_theta_o = a.cos_theta_o;
+        } else if (std::min(theta_d + theta_a, pi) <= theta_b) {
+            w = wb;
+            cos_theta_o = b.cos_theta_o;
+        } else {
+            double theta_o = (theta_a + theta_d + theta_b) / 2;
+            vec3 k = cross(wa, wb);
+            if (theta_o < pi && k.length() > 0) {
+                // Rotate wa towards wb by theta_o - theta_a (Rodrigues, with k perpendicular to wa).
+                double theta_r = theta_o - theta_a;
+                k = k.unit_vector();
+                w = (std::cos(theta_r) * wa + std::sin(theta_r) * cross(k, wa)).unit_vector();
+                cos_theta_o = std::cos(theta_o);
+            }
+        }
+    }
+    node.axis[0] = w.x(); node.axis[1] = w.y(); node.axis[2] = w.z();
+    node.cos_theta_o = static_cast<float>(cos_theta_o);
+    return node;
+}
+
+// IMPORTANCE
+
+// cos(max(0, a - b)) and sin(max(0, a - b)) of angles a, b in [0, pi] given by their sines and cosines.
+static double cosSubClamped(double sin_a, double cos_a, double sin_b, double cos_b) {
+    return cos_a > cos_b ? 1 : cos_a*cos_b + sin_a*sin_b;
+}
+
+static double sinSubClamped(double sin_a, double cos_a, double sin_b, double cos_b) {
+    return cos_a > cos_b ? 0 : sin_a*cos_b - cos_a*sin_b;
+}
+
+static double safeSqrt(double x) { return std::sqrt(std::max(0.0, x)); }
+
+double LightBVH::importance(const Node& node, const point3& p, const vec3& n) {
+    point3 center(0.5f*(node.lower[0] + node.upper[0]), 0.5f*(node.lower[1] + node.upper[1]), 0.5f*(node.lower[2] + node.upper[2]));
+    vec3 half_diagonal(0.5f*(node.upper[0] - node.lower[0]), 0.5f*(node.upper[1] - node.lower[1]), 0.5f*(node.upper[2] - node.lower[2]));
+    double r2 = dot(half_diagonal, half_diagonal);
+    vec3 offset = p - center;
+    double d2 = dot(offset, offset);
+    if (d2 <= r2) return node.power / std::max(r2, 1e-12); // inside the bounding sphere: every direction is possible
+
+    vec3 wi = offset / std::sqrt(d2);   // from the lights towards p
+    vec3 axis(node.axis[0], node.axis[1], node.axis[2]);
+    double cos_w = std::fabs(dot(axis, wi));
+    double sin_w = safeSqrt(1 - cos_w*cos_w);
+    double cos_b = safeSqrt(1 - r2 / d2);   // half angle of the bounding sphere seen from p
+    double sin_b = safeSqrt(1 - cos_b*cos_b);
+    double cos_o = node.cos_theta_o;
+    double sin_o = safeSqrt(1 - cos_o*cos_o);
+
+    // Smallest angle between the emitters' normals and p, over the whole node.
+    double cos_x = cosSubClamped(sin_w, cos_w, sin_o, cos_o);
+    double sin_x = sinSubClamped(sin_w, cos_w, sin_o, cos_o);
+    double cos_emit = cosSubClamped(sin_x, cos_x, sin_b, cos_b);
+    if (cos_emit <= 0) return 0;   // diffuse emitters: nothing beyond 90 degrees
+
+    // Smallest angle between p's normal and the node.
+    double cos_i = -dot(wi, n);
+    double sin_i = safeSqrt(1 - cos_i*cos_i);
+    double cos_receive = cosSubClamped(sin_i, cos_i, sin_b, cos_b);
+    if (cos_receive <= 0) return 0;
+
+    return node.power * cos_emit * cos_receive / std::max(d2, r2);
+}
+
+// QUERIES
+
+const LightShape* LightBVH::pick(const point3& p, const vec3& n, double u, double& remapped, double& pmf) const {
+    if (lights.empty()) return nullptr;
+    uint32_t i = 0;
+    pmf = 1;
+    while (!nodes[i].leaf) {
+        uint32_t left = i + 1, right = nodes[i].second;
+        double importance_left = importance(nodes[left], p, n);
+        double importance_right = importance(nodes[right], p, n);
+        if (importance_left + importance_right <= 0) return nullptr;
+        double p_left = importance_left / (importance_left + importance_right);
+        if (u < p_left) {
+            u = u / p_left;
+            pmf *= p_left;
+            i = left;
+        } else {
+            u = (u - p_left) / (1 - p_left);
+            pmf *= 1 - p_left;
+            i = right;
+        }
+        u = std::min(u, 0.99999999999999989);
+    }
+    remapped = u;
+    return &lights[nodes[i].second];
+}
+
+const LightShape* LightBVH::find(unsigned int geomID, unsigned int primID, const point3& p, const vec3& n, double& pmf) const {
+    pmf = 0;
+    auto found = by_hit.find((static_cast<uint64_t>(geomID) << 32) | primID);
+    if (found == by_hit.end()) return nullptr;
+    uint64_t trail = trails[found->second];
+    uint32_t i = 0;
+    double probability = 1;
+    for (int depth = 0; !nodes[i].leaf; ++depth) {
+        uint32_t left = i + 1, right = nodes[i].second;
+        double importance_left = importance(nodes[left], p, n);
+        double importance_right = importance(nodes[right], p, n);
+        if (importance_left + importance_right <= 0) return &lights[found->second];
+        bool go_right = (trail >> depth) & 1;
+        probability *= (go_right ? importance_right : importance_left) / (importance_left + importance_right);
+        i = go_right ? right : left;
+    }
+    pmf = probability;
+    return &lights[found->second];
+}
+
+size_t LightBVH::memoryBytes() const {
+    size_t map_bytes = by_hit.bucket_count() * sizeof(void*) + by_hit.size() * (sizeof(std::pair<const uint64_t, uint32_t>) + 2 * sizeof(void*));
+    return nodes.capacity() * sizeof(Node) + lights.capacity() * sizeof(LightShape) + trails.capacity() * sizeof(uint64_t) + map_bytes;
+}
@@ -89,3 +89,16 @@ HitInfo BoxPrimitive::getHitInfo(const ray& r, const vec3& p, const float t, uns
 vec3 BoxPrimitive::getA() { return a; }
 vec3 BoxPrimitive::getB() { return b; }
 vec3 BoxPrimitive::getC() { return c; }
+
+void BoxPrimitive::collectLights(const MaterialTable& table, unsigned int geomID, std::vector<LightShape>& lights) const {
+    uint32_t mat = table.lookup(geomID, 0);
+    if (!table.isEmissive(mat)) return;
+    // Each face as a corner and its two edges, in the order the faces were given to Embree (primID).
+    const vec3 faces[6][3] = {
+        { position, a, b }, { position + a + c, -a, b }, { position, c, a },
+        { position + b, a, c }, { position, b, c }, { position + a, c, b }
+    };
+    for (unsigned int i = 0; i < 6; ++i) {
+        lights.push_back(LightShape::quad(faces[i][0], faces[i][1], faces[i][2], table.emitted(mat, 0, 0, position), geomID, i));
+    }
+}
@@ -0,0 +1,73 @@
+#include "mesh_primitive.h"
+#include <stdexcept>
+
+MeshPrimitive::MeshPrimitive(MeshData mesh, std::vector<shared_ptr<material>> materials, RTCDevice device)
+        : Primitive(vec3(0, 0, 0), materials.empty() ? nullptr : materials[0], rtcNewGeometry(device, RTC_GEOMETRY_TYPE_TRIANGLE)),
+          materials{materials}, mesh{mesh} {
+    if (this->materials.empty()) throw std::invalid_argument("MeshPrimitive needs at least one material");
+
+    rtcSetSharedGeometryBuffer(geom, RTC_BUFFER_TYPE_VERTEX, 0, RTC_FORMAT_FLOAT3, this->mesh.vertices, 0, this->mesh.vertex_stride, this->mesh.vertex_count);
+    rtcSetSharedGeometryBuffer(geom, RTC_BUFFER_TYPE_INDEX, 0, RTC_FORMAT_UINT3, this->mesh.indices, 0, 3*sizeof(uint32_t), this->mesh.triangle_count);
+
+    rtcSetGeometryBuildQuality(geom, RTC_BUILD_QUALITY_HIGH);
+    rtcCommitGeometry(geom);
+}
+
+size_t MeshPrimitive::triangleCount() const { return mesh.triangle_count; }
+
+shared_ptr<material> MeshPrimitive::materialById(unsigned int geomID) const { return mat_ptr; }
+
+shared_ptr<material> MeshPrimitive::materialById(unsigned int geomID, unsigned int primID) const {
+    if (mesh.face_materials == nullptr || primID >= mesh.triangle_count) return mat_ptr;
+    uint32_t index = mesh.face_materials[primID];
+    return materials[index < materials.size() ? index : materials.size() - 1];
+}
+
+void MeshPrimitive::bindMaterials(MaterialTable& table, unsigned int geomID) const {
+    table.bindGeometry(geomID, materials, mesh.face_materials, mesh.triangle_count);
+}
+
+void MeshPrimitive::collectLights(const MaterialTable& table, unsigned int geomID, std::vector<LightShape>& lights) const {
+    for (uint32_t i = 0; i < mesh.triangle_count; ++i) {
+        uint32_t mat = table.lookup(geomID, i);
+        if (!table.isEmissive(mat)) continue;
+        const uint32_t* tri = mesh.indices + 3*i;
+        lights.push_back(LightShape::triangle(vertex(tri[0]), vertex(tri[1]), vertex(tri[2]), table.emitted(mat, 0, 0, position), geomID, i));
+    }
+}
+
+HitInfo MeshPrimitive::getHitInfo(const ray& r, const vec3& p, const float t, unsigned int geomID) const {
+    return getHitInfo(r, p, t, geomID, 0);
+}
+
+HitInfo MeshPrimitive::getHitInfo(const ray& r, const vec3& p, const float t, unsigned int geomID, unsigned int primID) const {
+    HitInfo record;
+    record.pos = p;
+    record.t = t;
+    record.u = 0;
+    record.v = 0;
+    if (primID >= mesh.triangle_count) return record;
+
+    const uint32_t* tri = mesh.indices + 3*primID;
+    vec3 a = vertex(tri[0]);
+    vec3 e1 = vertex(tri[1]) - a;
+    vec3 e2 = vertex(tri[2]) - a;
+    vec3 n = cross(e1, e2);
+    record.set_face_normal(r, n.unit_vector());
+
+    // Barycentric coordinates of p, used as the surface (u, v) like Embree's hit.u / hit.v.
+    vec3 ap = p - a;
+    double d00 = dot(e1, e1), d01 = dot(e1, e2), d11 = dot(e2, e2);
+    double d20 = dot(ap, e1), d21 = dot(ap, e2);
+    double denom = d00 * d11 - d01 * d01;
+    if (denom != 0) {
+        record.u = (d11 * d20 - d01 * d21) / denom;
+        record.v = (d00 * d21 - d01 * d20) / denom;
+    }
+    return record;
+}
+
+vec3 MeshPrimitive::vertex(uint32_t index) const {
+    const float* v = reinterpret_cast<const float*>(reinterpret_cast<const char*>(mesh.vertices) + index * mesh.vertex_stride);
+    return vec3(v[0], v[1], v[2]);
+}
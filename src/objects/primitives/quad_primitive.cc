@@ -26,6 +26,24 @@ QuadPrimitive::QuadPrimitive(const point3& position, const vec3& _u, const vec3&
     rtcCommitGeometry(geom);
 }
 
+QuadPrimitive::QuadPrimitive(const Vertex3f* shared_vertices, const Quad* shared_index, shared_ptr<material> mat_ptr, RTCDevice device):
+    Primitive{vec3(shared_vertices[0].x, shared_vertices[0].y, shared_vertices[0].z), mat_ptr, rtcNewGeometry(device, RTC_GEOMETRY_TYPE_QUAD)} {
+
+    this->u = vec3(shared_vertices[1].x, shared_vertices[1].y, shared_vertices[1].z) - this->position;
+    this->v = vec3(shared_vertices[3].x, shared_vertices[3].y, shared_vertices[3].z) - this->position;
+    vec3 n = cross(this->u,this->v);
+    this->normal = n.unit_vector();
+    this->w = n / dot(n, n);
+
+    rtcSetSharedGeometryBuffer(geom, RTC_BUFFER_TYPE_VERTEX, 0, RTC_FORMAT_FLOAT3, shared_vertices, 0, sizeof(Vertex3f), 4);
+    rtcSetSharedGeometryBuffer(geom, RTC_BUFFER_TYPE_INDEX, 0, RTC_FORMAT_UINT4, shared_index, 0, sizeof(Quad), 1);
+
+    rtcSetGeometryVertexAttributeCount(geom, 1);
+
+    rtcSetGeometryBuildQuality(geom, RTC_BUILD_QUALITY_HIGH);
+    rtcCommitGeometry(geom);
+}
+
 shared_ptr<material> QuadPrimitive::materialById(unsigned int geomID) const { return this->mat_ptr; }
 
 HitInfo QuadPrimitive::getHitInfo(const ray& r, const vec3& p, const float t, unsigned int geomID) const {
@@ -47,4 +65,8 @@ vec3 QuadPrimitive::getV() {
 
 vec3 QuadPrimitive::getU() {
     return u;
-}
\ No newline at end of file
+}
+void QuadPrimitive::collectLights(const MaterialTable& table, unsigned int geomID, std::vector<LightShape>& lights) const {
+    uint32_t mat = table.lookup(geomID, 0);
+    if (table.isEmissive(mat)) lights.push_back(LightShape::quad(position, u, v, table.emitted(mat, 0, 0, position), geomID));
+}
@@ -1,7 +1,7 @@
 #include "sphere_primitive.h"
 
 SpherePrimitive::SpherePrimitive(vec3 position, shared_ptr<material> mat_ptr, double radius, RTCDevice device) 
-        : radius{radius}, Primitive(position, mat_ptr, rtcNewGeometry(device, RTC_GEOMETRY_TYPE_SPHERE_POINT)) {
+        : Primitive(position, mat_ptr, rtcNewGeometry(device, RTC_GEOMETRY_TYPE_SPHERE_POINT)), radius{radius} {
     float* spherev = (float*)rtcSetNewGeometryBuffer(geom, RTC_BUFFER_TYPE_VERTEX, 0, RTC_FORMAT_FLOAT4, 4*sizeof(float), 1);
     if (spherev) {
         spherev[0] = position.x();
@@ -13,6 +13,26 @@ SpherePrimitive::SpherePrimitive(vec3 position, shared_ptr<material> mat_ptr, do
     rtcCommitGeometry(geom);
 }
 
+SpherePrimitive::SpherePrimitive(const float* shared_vertex, shared_ptr<material> mat_ptr, RTCDevice device)
+        : Primitive(vec3(shared_vertex[0], shared_vertex[1], shared_vertex[2]), mat_ptr, rtcNewGeometry(device, RTC_GEOMETRY_TYPE_SPHERE_POINT)),
+          radius{shared_vertex[3]} {
+    rtcSetSharedGeometryBuffer(geom, RTC_BUFFER_TYPE_VERTEX, 0, RTC_FORMAT_FLOAT4, shared_vertex, 0, 4*sizeof(float), 1);
+    rtcSetGeometryBuildQuality(geom, RTC_BUILD_QUALITY_HIGH);
+    rtcCommitGeometry(geom);
+}
+
+void SpherePrimitive::setCenter(const point3& center) {
+    float* spherev = (float*)rtcGetGeometryBufferData(geom, RTC_BUFFER_TYPE_VERTEX, 0);
+    spherev[0] = center.x();
+    spherev[1] = center.y();
+    spherev[2] = center.z();
+    position = center;
+
+    rtcUpdateGeometryBuffer(geom, RTC_BUFFER_TYPE_VERTEX, 0);
+    rtcSetGeometryBuildQuality(geom, RTC_BUILD_QUALITY_REFIT);
+    rtcCommitGeometry(geom);
+}
+
 shared_ptr<material> SpherePrimitive::materialById(unsigned int geomID) const {
     return mat_ptr;
 }
@@ -46,4 +66,8 @@ void SpherePrimitive::get_sphere_uv(const point3& p, double& u, double& v) {
 
     u = phi / (2*pi);
     v = theta / pi;
-}
\ No newline at end of file
+}
+void SpherePrimitive::collectLights(const MaterialTable& table, unsigned int geomID, std::vector<LightShape>& lights) const {
+    uint32_t mat = table.lookup(geomID, 0);
+    if (table.isEmissive(mat)) lights.push_back(LightShape::sphere(position, radius, table.emitted(mat, 0, 0, position), geomID));
+}
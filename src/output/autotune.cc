@@ -0,0 +1,162 @@
+#include "autotune.h"
+#include "output.h"
+#include "hash.hh"
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+// Most pixels of the pilot image, and the shortest pilot render the timings are trusted at.
+static const int PILOT_PIXELS = 65536;
+static const double MIN_PILOT_SECONDS = 0.02;
+
+// Cache entries are keyed by the scene file's hash, the host and its pool size, and the resolution.
+static std::string cacheKey(const RenderData& render_data, const Config& config) {
+    char host[256] = "unknown";
+    if (gethostname(host, sizeof(host)) != 0) std::snprintf(host, sizeof(host), "unknown");
+    host[sizeof(host) - 1] = '\0';
+    std::ostringstream key;
+    key << hashToHex(hashFile(config.inputFile)) << ' ' << host << ':' << ThreadPool::shared().size() << ' '
+        << render_data.image_width << 'x' << render_data.image_height;
+    return key.str();
+}
+
+// Latest entry for key in the cache file, if any. Lines are "<scene> <host>:<workers> <w>x<h> <vx> <mt> <threads> <tiles>".
+static bool readCache(const std::string& path, const std::string& key, TuneChoice& choice) {
+    std::ifstream in(path);
+    bool found = false;
+    std::string line;
+    while (std::getline(in, line)) {
+        // The key must be followed by a space: "100x100" is a prefix of "100x1000".
+        if (line.size() <= key.size() || line[0] == '#' || line.compare(0, key.size(), key) != 0 || line[key.size()] != ' ') continue;
+        std::istringstream values(line.substr(key.size()));
+        TuneChoice entry;
+        int multithreading;
+        if (values >> entry.vectorization >> multithreading >> entry.threads >> entry.tiles_per_thread) {
+            entry.multithreading = multithreading != 0;
+            entry.cached = true;
+            choice = entry;
+            found = true;
+        }
+    }
+    return found;
+}
+
+static void appendCache(const std::string& path, const std::string& key, const TuneChoice& choice) {
+    bool exists = std::ifstream(path).good();
+    std::ofstream out(path, std::ios::app);
+    if (!out.is_open()) throw std::runtime_error("Could not open file: " + path);
+    if (!exists) out << "# caitlyn --autotune: scene host:workers resolution vectorization multithreading threads tiles_per_thread\n";
+    out << key << ' ' << choice.vectorization << ' ' << (choice.multithreading ? 1 : 0) << ' '
+        << choice.threads << ' ' << choice.tiles_per_thread << '\n';
+}
+
+static void applyChoice(const TuneChoice& choice, Config& config) {
+    config.vectorization = choice.vectorization;
+    config.multithreading = choice.multithreading;
+    config.threads = choice.threads;
+    config.tilesPerThread = choice.tiles_per_thread;
+}
+
+static std::string describe(const TuneChoice& choice) {
+    std::ostringstream text;
+    text << "-Vx " << choice.vectorization << ", ";
+    if (choice.multithreading) {
+        text << choice.threads << " threads, " << choice.tiles_per_thread << (choice.tiles_per_thread == 1 ? " tile" : " tiles") << " per thread";
+    }
+    else text << "no multithreading";
+    return text.str();
+}
+
+TuneChoice autotune(RenderData& render_data, Camera& cam, std::shared_ptr<Scene> scene_ptr, Config& config) {
+    std::string key = config.autotuneCache.empty() ? "" : cacheKey(render_data, config);
+    TuneChoice best;
+    if (!key.empty() && readCache(config.autotuneCache, key, best)) {
+        applyChoice(best, config);
+        std::cerr << "Autotune: " << describe(best) << " (cached)" << std::endl;
+        return best;
+    }
+
+    // The pilot: the same view scaled down, rendered without the features that only change the result.
+    RenderData pilot = render_data;
+    double scale = std::min(1.0, std::sqrt(static_cast<double>(PILOT_PIXELS) / (static_cast<double>(render_data.image_width) * render_data.image_height)));
+    pilot.image_width = std::max(1, static_cast<int>(std::lround(render_data.image_width * scale)));
+    pilot.image_height = std::max(1, static_cast<int>(std::lround(render_data.image_height * scale)));
+    pilot.buffer.assign(static_cast<size_t>(pilot.image_width) * pilot.image_height, color(0, 0, 0));
+    pilot.aovs.clear();
+    pilot.pixel_samples.clear();
+    pilot.radiance_cache.reset();
+    pilot.path_guide.reset();
+    pilot.split = 1;
+    pilot.first_sample = 0;
+
+    Config quiet = config;
+    quiet.verbose = false;
+    quiet.timeBudget = 0;
+    quiet.noiseTarget = 0;
+    quiet.progressInterval = 0;
+
+    auto time = [&](const TuneChoice& candidate) {
+        Config trial = quiet;
+        applyChoice(candidate, trial);
+        double fastest = 0;
+        for (int run = 0; run < 2; ++run) {
+            auto start = std::chrono::steady_clock::now();
+            renderImage(pilot, cam, scene_ptr, trial);
+            double seconds = secondsSince(start);
+            if (run == 0 || seconds < fastest) fastest = seconds;
+        }
+        return fastest;
+    };
+    auto setSamples = [&](int samples) {
+        pilot.samples_per_pixel = samples;
+        pilot.sampler = Sampler::create(parseSamplerType(config.sampler), samples, pilot.image_width);
+    };
+
+    const int workers = ThreadPool::shared().size();
+    std::vector<TuneChoice> candidates;
+    bool scalar_only = config.split > 1 || config.radianceCache != "off" || config.guide;
+    for (int vectorization : { 0, 4, 8 }) {
+        if (scalar_only && vectorization != 0) continue;
+        TuneChoice serial;
+        serial.vectorization = vectorization;
+        candidates.push_back(serial);
+        for (int threads = 2; ; threads = std::min(threads * 2, workers)) {
+            if (threads > workers) break;
+            for (int tiles : { 1, 4, 16 }) {
+                TuneChoice parallel;
+                parallel.vectorization = vectorization;
+                parallel.multithreading = true;
+                parallel.threads = threads;
+                parallel.tiles_per_thread = tiles;
+                candidates.push_back(parallel);
+            }
+            if (threads == workers) break;
+        }
+    }
+
+    // More samples until the reference candidate (the last, all workers with the widest kernel) is measurable.
+    setSamples(1);
+    while (time(candidates.back()) < MIN_PILOT_SECONDS && pilot.samples_per_pixel < render_data.samples_per_pixel) {
+        setSamples(std::min(pilot.samples_per_pixel * 2, render_data.samples_per_pixel));
+    }
+
+    double slowest = 0;
+    for (TuneChoice& candidate : candidates) {
+        candidate.seconds = time(candidate);
+        slowest = std::max(slowest, candidate.seconds);
+        if (config.verbose) std::cerr << "Autotune: " << std::setw(52) << std::left << describe(candidate) << std::right
+                                      << candidate.seconds << " s" << std::endl;
+        if (best.seconds == 0 || candidate.seconds < best.seconds) best = candidate;
+    }
+
+    applyChoice(best, config);
+    std::cerr << "Autotune: " << describe(best) << " (" << pilot.image_width << "x" << pilot.image_height << " pilot at "
+              << pilot.samples_per_pixel << " spp, " << best.seconds << " s, " << (best.seconds > 0 ? slowest / best.seconds : 1)
+              << "x faster than the slowest)" << std::endl;
+    if (!key.empty()) appendCache(config.autotuneCache, key, best);
+    return best;
+}
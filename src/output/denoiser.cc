@@ -0,0 +1,223 @@
+#include "denoiser.h"
+#include "thread_pool.hh"
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <stdexcept>
+
+DenoiseQuality parseDenoiseQuality(const std::string& name) {
+    if (name == "off") return DenoiseQuality::Off;
+    if (name == "fast") return DenoiseQuality::Fast;
+    if (name == "balanced") return DenoiseQuality::Balanced;
+    if (name == "high") return DenoiseQuality::High;
+    throw std::invalid_argument("Unknown denoise quality '" + name + "' [off|fast|balanced|high]");
+}
+
+std::string denoiseQualityName(DenoiseQuality quality) {
+    switch (quality) {
+        case DenoiseQuality::Fast: return "fast";
+        case DenoiseQuality::Balanced: return "balanced";
+        case DenoiseQuality::High: return "high";
+        default: return "off";
+    }
+}
+
+// Added to the albedo before dividing by it, so black surfaces keep their (zero) lighting instead of blowing up.
+static const float ALBEDO_EPSILON = 0.01f;
+
+// Pixels handled by one pass of the tap loops.
+static const int LANES = 8;
+
+// B3 spline, the 1D kernel of every iteration.
+static const float KERNEL[5] = { 1.0f/16, 1.0f/4, 3.0f/8, 1.0f/4, 1.0f/16 };
+
+// Falloff of the edge-stopping weight, (1 + x/16)^-16: within a few percent of exp(-x) where the weight
+// matters, and only a division and multiplies, so the tap loop vectorizes without a vector exp.
+static inline float edgeWeight(float x) {
+    float r = 1.0f / (1.0f + x * (1.0f / 16));
+    r *= r;
+    r *= r;
+    r *= r;
+    r *= r;
+    return r;
+}
+
+// One row of every plane, starting at the same pixel.
+struct PlaneRows {
+    const float* light[3];
+    const float* albedo[3];
+    const float* normal[3];
+    const float* depth;
+};
+
+// Adds the tap at n (the neighbour rows, already shifted by the tap offset) with kernel weight h to the sums
+// of the columns centre pixels c. The sums are __restrict so the compiler does not have to assume they
+// alias the planes; columns is a multiple of LANES, so the loop needs no scalar remainder.
+static void accumulateTap(int columns, float h, const float inv_sigma[3], const PlaneRows& c, const PlaneRows& n,
+                            const float* inv_depth, float* __restrict sum_r, float* __restrict sum_g,
+                            float* __restrict sum_b, float* __restrict sum_w) {
+    for (int x0 = 0; x0 < columns; x0 += LANES) {
+        for (int k = 0; k < LANES; ++k) {
+            const int x = x0 + k;
+            float lr = c.light[0][x] - n.light[0][x], lg = c.light[1][x] - n.light[1][x], lb = c.light[2][x] - n.light[2][x];
+            float ar = c.albedo[0][x] - n.albedo[0][x], ag = c.albedo[1][x] - n.albedo[1][x], ab = c.albedo[2][x] - n.albedo[2][x];
+            float nx = c.normal[0][x] - n.normal[0][x], ny = c.normal[1][x] - n.normal[1][x], nz = c.normal[2][x] - n.normal[2][x];
+            float dz = c.depth[x] - n.depth[x];
+            float distance = (lr*lr + lg*lg + lb*lb) * inv_sigma[0]
+                           + (nx*nx + ny*ny + nz*nz) * inv_sigma[1]
+                           + (ar*ar + ag*ag + ab*ab) * inv_sigma[2]
+                           + dz*dz * inv_depth[x];
+            float w = h * edgeWeight(distance);
+            sum_r[x] += w * n.light[0][x];
+            sum_g[x] += w * n.light[1][x];
+            sum_b[x] += w * n.light[2][x];
+            sum_w[x] += w;
+        }
+    }
+}
+
+Denoiser::Denoiser(DenoiseQuality quality) {
+    switch (quality) {
+        case DenoiseQuality::Fast:  settings = { 3, 2.0f, 0.2f, 0.1f, 0.1f }; break;
+        case DenoiseQuality::High:  settings = { 5, 2.0f, 0.1f, 0.05f, 0.05f }; break;
+        case DenoiseQuality::Off:   settings = { 0, 1.0f, 1.0f, 1.0f, 1.0f }; break;
+        case DenoiseQuality::Balanced:
+        default:                    settings = { 4, 2.0f, 0.15f, 0.075f, 0.075f }; break;
+    }
+}
+
+void Denoiser::padRow(std::vector<float>& plane, int y) {
+    float* r = row(plane, y);
+    std::fill(r - pad, r, r[0]);
+    std::fill(r + width, r - pad + stride, r[width - 1]);
+}
+
+void Denoiser::filterRows(int first, int last, int step, float inv_sigma_color) {
+    const int columns = stride - 2 * pad;
+    const float inv_sigma[3] = { inv_sigma_color,
+                                 1.0f / (settings.sigma_normal * settings.sigma_normal),
+                                 1.0f / (settings.sigma_albedo * settings.sigma_albedo) };
+    std::vector<float> sum_r(columns), sum_g(columns), sum_b(columns), sum_w(columns), inv_depth(columns);
+
+    auto rowsAt = [&](int y, int offset) {
+        PlaneRows rows;
+        for (int c = 0; c < 3; ++c) {
+            rows.light[c] = row(light[c], y) + offset;
+            rows.albedo[c] = row(albedo[c], y) + offset;
+            rows.normal[c] = row(normal[c], y) + offset;
+        }
+        rows.depth = row(depth, y) + offset;
+        return rows;
+    };
+
+    for (int y = first; y < last; ++y) {
+        PlaneRows centre = rowsAt(y, 0);
+        for (int x = 0; x < columns; ++x) {
+            float sigma = settings.sigma_depth * centre.depth[x] + 1e-3f;
+            inv_depth[x] = 1.0f / (sigma * sigma);
+        }
+        std::fill(sum_r.begin(), sum_r.end(), 0.0f);
+        std::fill(sum_g.begin(), sum_g.end(), 0.0f);
+        std::fill(sum_b.begin(), sum_b.end(), 0.0f);
+        std::fill(sum_w.begin(), sum_w.end(), 0.0f);
+
+        for (int dy = -2; dy <= 2; ++dy) {
+            int yy = std::clamp(y + dy * step, 0, height - 1);
+            for (int dx = -2; dx <= 2; ++dx) {
+                accumulateTap(columns, KERNEL[dx + 2] * KERNEL[dy + 2], inv_sigma, centre, rowsAt(yy, dx * step),
+                                inv_depth.data(), sum_r.data(), sum_g.data(), sum_b.data(), sum_w.data());
+            }
+        }
+
+        // The centre tap always has weight h > 0, so sum_w is never zero.
+        float* out[3] = { row(filtered[0], y), row(filtered[1], y), row(filtered[2], y) };
+        for (int x = 0; x < columns; ++x) {
+            float inv = 1.0f / sum_w[x];
+            out[0][x] = sum_r[x] * inv;
+            out[1][x] = sum_g[x] * inv;
+            out[2][x] = sum_b[x] * inv;
+        }
+        for (int c = 0; c < 3; ++c) padRow(filtered[c], y);
+    }
+}
+
+void Denoiser::apply(RenderData& render_data, bool multithreaded) {
+    auto start = std::chrono::steady_clock::now();
+    seconds = 0;
+    if (settings.iterations == 0) return;
+    const AOVBuffers& guides = render_data.aovs;
+    if (!guides.has(AOV::Albedo) || !guides.has(AOV::Normal) || !guides.has(AOV::Depth) || guides.depth.size() != render_data.buffer.size()) {
+        throw std::invalid_argument("Denoiser needs the albedo, normal and depth layers of the render");
+    }
+
+    width = render_data.image_width;
+    height = render_data.image_height;
+    pad = ((2 << (settings.iterations - 1)) + LANES - 1) / LANES * LANES; // reach of the widest iteration
+    stride = pad + (width + LANES - 1) / LANES * LANES + pad;
+    const size_t plane_size = static_cast<size_t>(stride) * height;
+    for (int c = 0; c < 3; ++c) {
+        light[c].assign(plane_size, 0.0f);
+        filtered[c].assign(plane_size, 0.0f);
+        albedo[c].assign(plane_size, 0.0f);
+        normal[c].assign(plane_size, 0.0f);
+    }
+    depth.assign(plane_size, 0.0f);
+
+    // Average the sums and demodulate: light = colour / albedo.
+    const float inv_spp = 1.0f / render_data.samples_per_pixel;
+    double luminance = 0;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            size_t i = static_cast<size_t>(y) * width + x;
+            const color& pixel = render_data.buffer[i];
+            for (int c = 0; c < 3; ++c) {
+                float a = guides.albedo[c][i] * inv_spp;
+                row(albedo[c], y)[x] = a;
+                row(light[c], y)[x] = pixel[c] * inv_spp / (a + ALBEDO_EPSILON);
+                row(normal[c], y)[x] = guides.normal[c][i] * inv_spp;
+            }
+            row(depth, y)[x] = guides.depth[i] * inv_spp;
+            luminance += 0.2126*row(light[0], y)[x] + 0.7152*row(light[1], y)[x] + 0.0722*row(light[2], y)[x];
+        }
+        for (int c = 0; c < 3; ++c) {
+            padRow(light[c], y);
+            padRow(albedo[c], y);
+            padRow(normal[c], y);
+        }
+        padRow(depth, y);
+    }
+    float sigma_color = settings.sigma_color * std::max(static_cast<float>(luminance / (static_cast<double>(width) * height)), 1e-4f);
+
+    for (int i = 0; i < settings.iterations; ++i) {
+        float sigma = sigma_color / static_cast<float>(1 << i);
+        float inv_sigma_color = 1.0f / (sigma * sigma);
+        int step = 1 << i;
+        if (!multithreaded) {
+            filterRows(0, height, step, inv_sigma_color);
+        } else {
+            ThreadPool& pool = ThreadPool::shared();
+            const int num_blocks = std::min(height, pool.size() * 4);
+            std::vector<std::future<void>> blocks;
+            int first = 0;
+            for (int b = 0; b < num_blocks; ++b) {
+                int rows = height / num_blocks + (b < height % num_blocks ? 1 : 0);
+                blocks.push_back(pool.submit([=]() { filterRows(first, first + rows, step, inv_sigma_color); }));
+                first += rows;
+            }
+            for (auto& block : blocks) block.get();
+        }
+        for (int c = 0; c < 3; ++c) std::swap(light[c], filtered[c]);
+    }
+
+    // Remodulate and return to sums over samples.
+    const float spp = static_cast<float>(render_data.samples_per_pixel);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            size_t i = static_cast<size_t>(y) * width + x;
+            render_data.buffer[i] = spp * color(row(light[0], y)[x] * (row(albedo[0], y)[x] + ALBEDO_EPSILON),
+                                                row(light[1], y)[x] * (row(albedo[1], y)[x] + ALBEDO_EPSILON),
+                                                row(light[2], y)[x] * (row(albedo[2], y)[x] + ALBEDO_EPSILON));
+        }
+    }
+    seconds = secondsSince(start);
+}
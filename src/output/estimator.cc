@@ -0,0 +1,187 @@
+#include "estimator.h"
+#include "thread_pool.hh"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <iomanip>
+
+// Most pixels traced by the pilot, and samples per pilot pixel.
+static const int PILOT_PIXELS = 4096;
+static const int PILOT_SAMPLES = 4;
+
+// Rows rendered with each kernel to compare them under -Vx.
+static const int KERNEL_ROWS = 8;
+
+struct PilotPixel {
+    int i, j;
+};
+
+// One pixel in each cell of a grid of about count cells over the image, at a pseudo-random spot in the cell.
+static std::vector<PilotPixel> pilotPixels(int width, int height, int count) {
+    int columns = std::clamp(static_cast<int>(std::ceil(std::sqrt(static_cast<double>(count) * width / height))), 1, width);
+    int rows = std::clamp(count / columns, 1, height);
+    std::vector<PilotPixel> pixels;
+    pixels.reserve(static_cast<size_t>(columns) * rows);
+    uint32_t state = 0x9e3779b9u;
+    auto next = [&state]() { state = state * 1664525u + 1013904223u; return state >> 8; };
+    for (int r = 0; r < rows; ++r) {
+        int y0 = r * height / rows, y1 = (r + 1) * height / rows;
+        for (int c = 0; c < columns; ++c) {
+            int x0 = c * width / columns, x1 = (c + 1) * width / columns;
+            if (x1 <= x0 || y1 <= y0) continue;
+            pixels.push_back(PilotPixel{ x0 + static_cast<int>(next() % (x1 - x0)), y0 + static_cast<int>(next() % (y1 - y0)) });
+        }
+    }
+    return pixels;
+}
+
+// Traces the pilot samples of one pixel the way render_scanlines does.
+static void tracePixel(const PilotPixel& p, const RenderData& data, const Camera& cam, const std::shared_ptr<Scene>& scene_ptr) {
+    for (int s = 0; s < data.samples_per_pixel; ++s) {
+        ray r = cameraRay(cam, *data.sampler, p.i, p.j, s, data.image_width, data.image_height);
+        PathSample path = { data.sampler.get(), static_cast<uint32_t>(p.j * data.image_width + p.i), static_cast<uint32_t>(s), 0 };
+        colorize_ray(r, scene_ptr, data.max_depth, path);
+    }
+}
+
+static double percentile(const std::vector<double>& sorted, double q) {
+    if (sorted.empty()) return 0;
+    size_t index = static_cast<size_t>(std::lround(q * (sorted.size() - 1)));
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+RenderEstimate estimateRender(RenderData& render_data, Camera& cam, std::shared_ptr<Scene> scene_ptr, const Config& config) {
+    RenderEstimate estimate;
+    auto pilot_start = std::chrono::steady_clock::now();
+    const int width = render_data.image_width, height = render_data.image_height;
+
+    RenderData pilot = render_data;
+    pilot.samples_per_pixel = std::min(render_data.samples_per_pixel, PILOT_SAMPLES);
+    pilot.sampler = Sampler::create(parseSamplerType(config.sampler), pilot.samples_per_pixel, width);
+    pilot.aovs.clear();
+    pilot.split = 1;
+    pilot.radiance_cache.reset();
+    pilot.path_guide.reset();
+    pilot.pixel_samples.clear();
+    pilot.first_sample = 0;
+
+    std::vector<PilotPixel> pixels = pilotPixels(width, height, std::min(PILOT_PIXELS, width * height));
+    estimate.pilot_pixels = static_cast<int>(pixels.size());
+    estimate.pilot_samples = pilot.samples_per_pixel;
+
+    // Single thread, timing every pixel.
+    std::vector<double> costs(pixels.size());
+    auto serial_start = std::chrono::steady_clock::now();
+    for (size_t p = 0; p < pixels.size(); ++p) {
+        auto pixel_start = std::chrono::steady_clock::now();
+        tracePixel(pixels[p], pilot, cam, scene_ptr);
+        costs[p] = secondsSince(pixel_start) * 1e6 / pilot.samples_per_pixel;
+    }
+    double serial_seconds = secondsSince(serial_start);
+
+    // The same pixels over every pool worker.
+    ThreadPool& pool = ThreadPool::shared();
+    estimate.workers = pool.size();
+    if (estimate.workers > 1) {
+        const int blocks = std::min(static_cast<int>(pixels.size()), estimate.workers * 4);
+        std::vector<std::future<void>> futures;
+        auto parallel_start = std::chrono::steady_clock::now();
+        for (int b = 0; b < blocks; ++b) {
+            futures.push_back(pool.submit([&, b]() {
+                for (size_t p = b; p < pixels.size(); p += blocks) tracePixel(pixels[p], pilot, cam, scene_ptr);
+            }));
+        }
+        for (auto& f : futures) f.get();
+        double parallel_seconds = secondsSince(parallel_start);
+        estimate.measured_speedup = parallel_seconds > 0 ? serial_seconds / parallel_seconds : 1;
+
+        // Amdahl: speedup(n) = 1 / (f + (1 - f) / n), solved for f at the measured point.
+        double n = estimate.workers;
+        estimate.serial_fraction = std::clamp((n / estimate.measured_speedup - 1) / (n - 1), 0.0, 1.0);
+    }
+    estimate.threads = config.multithreading ? estimate.workers : 1;
+    estimate.thread_speedup = 1 / (estimate.serial_fraction + (1 - estimate.serial_fraction) / estimate.threads);
+
+    // Packet kernels against the scalar one on a few rows, unless a feature forces the scalar integrator.
+    bool scalar_only = config.split > 1 || config.radianceCache != "off" || config.guide;
+    if (config.vectorization != 0 && !scalar_only) {
+        auto kernel = config.vectorization == 4 ? render_scanlines_sse : render_scanlines_avx;
+        const int rows = std::min(KERNEL_ROWS, height);
+        double scalar_seconds = 0, packet_seconds = 0;
+        for (int r = 0; r < rows; ++r) {
+            int row = (2 * r + 1) * height / (2 * rows);
+            auto start = std::chrono::steady_clock::now();
+            render_scanlines(1, row, scene_ptr, pilot, cam);
+            scalar_seconds += secondsSince(start);
+            start = std::chrono::steady_clock::now();
+            kernel(1, row, scene_ptr, pilot, cam);
+            packet_seconds += secondsSince(start);
+        }
+        if (packet_seconds > 0) estimate.kernel_speedup = scalar_seconds / packet_seconds;
+    }
+
+    // Path cost distribution and the prediction.
+    double sum = 0, squares = 0;
+    for (double c : costs) { sum += c; squares += c * c; }
+    const double count = std::max<double>(costs.size(), 1);
+    estimate.path_mean_us = sum / count;
+    double variance = std::max(squares / count - estimate.path_mean_us * estimate.path_mean_us, 0.0);
+    estimate.path_stderr_us = std::sqrt(variance / count);
+    std::sort(costs.begin(), costs.end());
+    estimate.path_p50_us = percentile(costs, 0.5);
+    estimate.path_p90_us = percentile(costs, 0.9);
+    estimate.path_p99_us = percentile(costs, 0.99);
+    estimate.path_max_us = costs.empty() ? 0 : costs.back();
+
+    const double paths = static_cast<double>(width) * height * render_data.samples_per_pixel;
+    const double scale = paths * 1e-6 / (estimate.thread_speedup * estimate.kernel_speedup);
+    estimate.render_seconds = scale * estimate.path_mean_us;
+    estimate.render_low_seconds = scale * std::max(estimate.path_mean_us - 2 * estimate.path_stderr_us, 0.0);
+    estimate.render_high_seconds = scale * (estimate.path_mean_us + 2 * estimate.path_stderr_us);
+    estimate.setup_seconds = render_data.stats.parse_seconds + render_data.stats.commit_seconds;
+    estimate.pilot_seconds = secondsSince(pilot_start);
+    return estimate;
+}
+
+// Quotes text as a JSON string.
+static std::string jsonString(const std::string& text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') { quoted += '\\'; quoted += c; }
+        else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            quoted += escaped;
+        }
+        else quoted += c;
+    }
+    return quoted + "\"";
+}
+
+void writeEstimateJSON(std::ostream& out, const RenderEstimate& e, const RenderData& render_data, const Config& config) {
+    std::ios::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(3);
+    out << "{\n"
+        << "  \"scene\": " << jsonString(config.inputFile) << ",\n"
+        << "  \"width\": " << render_data.image_width << ",\n"
+        << "  \"height\": " << render_data.image_height << ",\n"
+        << "  \"samples_per_pixel\": " << render_data.samples_per_pixel << ",\n"
+        << "  \"max_depth\": " << render_data.max_depth << ",\n"
+        << "  \"threads\": " << e.threads << ",\n"
+        << "  \"vectorization\": " << config.vectorization << ",\n"
+        << "  \"pilot\": { \"pixels\": " << e.pilot_pixels << ", \"samples_per_pixel\": " << e.pilot_samples
+        << ", \"seconds\": " << e.pilot_seconds << " },\n"
+        << "  \"path_cost_us\": { \"mean\": " << e.path_mean_us << ", \"stderr\": " << e.path_stderr_us
+        << ", \"p50\": " << e.path_p50_us << ", \"p90\": " << e.path_p90_us << ", \"p99\": " << e.path_p99_us
+        << ", \"max\": " << e.path_max_us << " },\n"
+        << "  \"thread_scaling\": { \"workers\": " << e.workers << ", \"measured_speedup\": " << e.measured_speedup
+        << ", \"serial_fraction\": " << e.serial_fraction << ", \"predicted_speedup\": " << e.thread_speedup << " },\n"
+        << "  \"kernel_speedup\": " << e.kernel_speedup << ",\n"
+        << "  \"setup_seconds\": " << e.setup_seconds << ",\n"
+        << "  \"render_seconds\": " << e.render_seconds << ",\n"
+        << "  \"render_seconds_range\": [" << e.render_low_seconds << ", " << e.render_high_seconds << "],\n"
+        << "  \"total_seconds\": " << e.setup_seconds + e.render_seconds << "\n"
+        << "}" << std::endl;
+    out.flags(flags);
+}
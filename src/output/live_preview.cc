@@ -0,0 +1,205 @@
+#include "live_preview.h"
+#include "pfm_output.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+PreviewFormat parsePreviewFormat(const std::string& name) {
+    if (name == "rgb8") return PreviewFormat::RGB8;
+    if (name == "float") return PreviewFormat::Float;
+    throw std::invalid_argument("Unknown preview format '" + name + "' [rgb8|float]");
+}
+
+// POSIX shared memory names start with a single slash.
+static std::string shmName(const std::string& name) {
+    return name.empty() || name[0] != '/' ? "/" + name : name;
+}
+
+static size_t alignUp(size_t bytes) {
+    return (bytes + PREVIEW_ALIGN - 1) / PREVIEW_ALIGN * PREVIEW_ALIGN;
+}
+
+LivePreview::LivePreview(const std::string& name, int width, int height, PreviewFormat format, double rate)
+    : name(shmName(name)), width(width), height(height), format(format), rate(rate) {
+    if (!(rate > 0)) throw std::invalid_argument("Preview rate must be positive");
+    pixel_bytes = static_cast<size_t>(width) * height * 3 * (format == PreviewFormat::Float ? sizeof(float) : 1);
+    size_t slot_bytes = alignUp(PREVIEW_ALIGN + pixel_bytes);
+    mapped_bytes = PREVIEW_ALIGN + PREVIEW_SLOTS * slot_bytes;
+
+    int fd = shm_open(this->name.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd == -1) throw std::runtime_error("Could not create preview " + this->name + " (" + std::strerror(errno) + ")");
+    if (ftruncate(fd, 0) == -1 || ftruncate(fd, mapped_bytes) == -1) { // drop frames of an earlier render first
+        close(fd);
+        shm_unlink(this->name.c_str());
+        throw std::runtime_error("Could not size preview " + this->name + " (" + std::strerror(errno) + ")");
+    }
+    void* ptr = mmap(nullptr, mapped_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); // the mapping keeps its own reference
+    if (ptr == MAP_FAILED) {
+        shm_unlink(this->name.c_str());
+        throw std::runtime_error("Could not map preview " + this->name + " (" + std::strerror(errno) + ")");
+    }
+    mapped = static_cast<unsigned char*>(ptr);
+
+    // ftruncate zero filled the object, so every slot starts at sequence 0 (never written).
+    PreviewHeader& h = header();
+    h.width = width;
+    h.height = height;
+    h.format = static_cast<uint32_t>(format);
+    h.slots = PREVIEW_SLOTS;
+    h.slot_bytes = slot_bytes;
+    h.version = PREVIEW_VERSION;
+    std::atomic_thread_fence(std::memory_order_release);
+    h.magic = PREVIEW_MAGIC; // last, so a reader that sees it sees the rest
+    averages.resize(static_cast<size_t>(width) * height * 3);
+}
+
+LivePreview::~LivePreview() {
+    stop();
+    munmap(mapped, mapped_bytes);
+    shm_unlink(name.c_str());
+}
+
+void LivePreview::start(const RenderData& render_data) {
+    stop();
+    stopping = false;
+    publisher = std::thread([this, &render_data]() {
+        auto interval = std::chrono::duration<double>(1.0 / rate);
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!wake.wait_for(lock, interval, [this]() { return stopping; })) {
+            lock.unlock();
+            publish(render_data, false);
+            lock.lock();
+        }
+    });
+}
+
+void LivePreview::stop() {
+    if (!publisher.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    publisher.join();
+}
+
+void LivePreview::publish(const RenderData& render_data, bool final) {
+    // Average every pixel over its own sample count, flipping the buffer's bottom-up rows.
+    const std::vector<uint32_t>& counts = render_data.pixel_samples;
+    uint32_t most = 0;
+    for (int y = 0; y < height; ++y) {
+        const size_t source_row = static_cast<size_t>(height - 1 - y) * width;
+        for (int x = 0; x < width; ++x) {
+            size_t pixel = source_row + x;
+            uint32_t count = counts.empty() ? static_cast<uint32_t>(render_data.samples_per_pixel) : counts[pixel];
+            most = std::max(most, count);
+            color average = count > 0 ? render_data.buffer[pixel] / count : color(0, 0, 0);
+            float* out = &averages[(static_cast<size_t>(y) * width + x) * 3];
+            out[0] = average.x();
+            out[1] = average.y();
+            out[2] = average.z();
+        }
+    }
+
+    frame += 1;
+    PreviewHeader& h = header();
+    unsigned char* slot_start = mapped + PREVIEW_ALIGN + ((frame - 1) % PREVIEW_SLOTS) * h.slot_bytes;
+    PreviewSlot& slot = *reinterpret_cast<PreviewSlot*>(slot_start);
+    unsigned char* pixels = slot_start + PREVIEW_ALIGN;
+
+    slot.sequence.store(2 * frame + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.samples = most;
+    if (format == PreviewFormat::Float) {
+        std::memcpy(pixels, averages.data(), pixel_bytes);
+    } else {
+        // Same tone mapping as the 8-bit outputs (color_to_256): gamma 2, clamped.
+        for (size_t i = 0; i < averages.size(); ++i) {
+            pixels[i] = static_cast<unsigned char>(256 * std::clamp(std::sqrt(std::max(averages[i], 0.0f)), 0.0f, 0.999f));
+        }
+    }
+    slot.sequence.store(2 * frame + 2, std::memory_order_release);
+    h.frame.store(frame, std::memory_order_release);
+    if (final) h.done.store(1, std::memory_order_release);
+}
+
+int dumpPreview(const std::string& name, const std::string& path) {
+    const std::string shm = shmName(name);
+    int fd = shm_open(shm.c_str(), O_RDONLY, 0);
+    if (fd == -1) throw std::runtime_error("No preview named " + shm + " (" + std::strerror(errno) + ")");
+    struct stat st;
+    if (fstat(fd, &st) == -1 || static_cast<size_t>(st.st_size) < PREVIEW_ALIGN) {
+        close(fd);
+        throw std::runtime_error("Preview " + shm + " is not ready");
+    }
+    size_t size = st.st_size;
+    void* ptr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) throw std::runtime_error("Could not map preview " + shm + " (" + std::strerror(errno) + ")");
+    const unsigned char* mapped = static_cast<const unsigned char*>(ptr);
+    const PreviewHeader& h = *reinterpret_cast<const PreviewHeader*>(mapped);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const int width = h.width, height = h.height;
+    const bool floats = h.format == static_cast<uint32_t>(PreviewFormat::Float);
+    const size_t pixel_bytes = static_cast<size_t>(h.width) * h.height * 3 * (floats ? sizeof(float) : 1);
+    // Every slot must hold its PreviewSlot and a whole frame, and all of them must fit the mapping.
+    if (h.magic != PREVIEW_MAGIC || h.version != PREVIEW_VERSION || h.slots == 0 || h.slot_bytes < PREVIEW_ALIGN + pixel_bytes
+        || h.slots > (size - PREVIEW_ALIGN) / h.slot_bytes) {
+        munmap(ptr, size);
+        throw std::runtime_error(shm + " is not a caitlyn preview");
+    }
+    std::vector<unsigned char> copy(pixel_bytes);
+
+    // Renderers that died without a final frame leave the object behind; give up when frames stop coming.
+    const double IDLE_SECONDS = 10;
+    uint64_t last = 0;
+    int written = 0;
+    auto last_frame = std::chrono::steady_clock::now();
+    while (true) {
+        uint64_t frame = h.frame.load(std::memory_order_acquire);
+        bool done = h.done.load(std::memory_order_acquire) != 0;
+        if (frame > last) {
+            const unsigned char* slot_start = mapped + PREVIEW_ALIGN + ((frame - 1) % h.slots) * h.slot_bytes;
+            const PreviewSlot& slot = *reinterpret_cast<const PreviewSlot*>(slot_start);
+            uint64_t before = slot.sequence.load(std::memory_order_acquire);
+            std::memcpy(copy.data(), slot_start + PREVIEW_ALIGN, pixel_bytes);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            uint64_t after = slot.sequence.load(std::memory_order_relaxed);
+            if (before == after && before == 2 * frame + 2) { // else overwritten while copying: try the newest again
+                if (floats) {
+                    // PFM rows run bottom to top.
+                    std::vector<float> pixels(static_cast<size_t>(width) * height * 3);
+                    const float* rows = reinterpret_cast<const float*>(copy.data());
+                    for (int y = 0; y < height; ++y) {
+                        std::memcpy(&pixels[static_cast<size_t>(height - 1 - y) * width * 3], rows + static_cast<size_t>(y) * width * 3,
+                                    sizeof(float) * width * 3);
+                    }
+                    write_pfm(path, width, height, 3, pixels);
+                } else {
+                    std::ofstream out(path, std::ios::binary);
+                    if (!out.is_open()) throw std::runtime_error("Could not open file: " + path);
+                    out << "P6\n" << width << ' ' << height << "\n255\n";
+                    out.write(reinterpret_cast<const char*>(copy.data()), pixel_bytes);
+                }
+                last = frame;
+                written += 1;
+                last_frame = std::chrono::steady_clock::now();
+                continue;
+            }
+        } else if (done || secondsSince(last_frame) > IDLE_SECONDS) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    munmap(ptr, size);
+    return written;
+}
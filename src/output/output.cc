@@ -1,53 +1,153 @@
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "output.h"
+#include "denoiser.h"
+#include "pfm_output.h"
+#include "live_preview.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iomanip>
 
-void output(RenderData& render_data, Camera& cam, std::shared_ptr<Scene> scene_ptr, Config& config) {
-    int image_height = render_data.image_height;
-    int image_width = render_data.image_width;
-    int samples_per_pixel = render_data.samples_per_pixel;
+using RenderFunction = std::function<void(int, int, std::shared_ptr<Scene>, RenderData&, Camera)>;
 
-    auto start_time = std::chrono::high_resolution_clock::now();
-    render_data.completed_lines = 0;
+// Largest total size of the per-worker partial sums --schedule auto lets a sample-split pass allocate.
+static const size_t MAX_PARTIAL_BYTES = size_t(1) << 30;
 
-    std::function<void(int, int, std::shared_ptr<Scene>, RenderData&, Camera)> render_function;
+// Whether a pass over samples [first_sample, samples_per_pixel) on num_workers is split over samples, not rows.
+static bool scheduleBySamples(const RenderData& render_data, const Config& config, int num_workers) {
+    const int split = std::max(render_data.split, 1);
+    const int groups = (render_data.samples_per_pixel - render_data.first_sample + split - 1) / split;
+    if (config.schedule == "rows" || num_workers < 2 || groups < 2) return false;
+    if (config.schedule == "samples") return true;
+    const size_t partial_bytes = static_cast<size_t>(num_workers) * render_data.buffer.size() * sizeof(color);
+    return render_data.image_height < num_workers * std::max(config.tilesPerThread, 1) && partial_bytes <= MAX_PARTIAL_BYTES;
+}
 
-    if (config.vectorization == 0) { render_function = render_scanlines; }
-    else if (config.vectorization == 4) { render_function = render_scanlines_sse; }
-    else if (config.vectorization == 8) { render_function = render_scanlines_avx; }
-    else if (config.vectorization == 16) { render_function = render_scanlines_avx; } // replace with 16 batch render_scanlines when made
-    else { render_function = render_scanlines; }
-    if (!config.multithreading) {
-        render_function(image_height, image_height-1, scene_ptr, render_data, cam);
-    } else {
-        int num_threads;
-        if (config.threads == -1) {
-            // Threading approach? : Divide the scanlines into N blocks
-            num_threads = std::thread::hardware_concurrency() - 1;
-        } else {
-            num_threads = config.threads;
+// Renders the whole image once per range of samples, each worker summing its ranges into its own copy of the
+// framebuffer, then adds the copies into render_data. Sample ranges are whole camera rays under --split.
+// With a live preview the copies are also added into render_data at its frame rate while the ranges render,
+// so the preview (which reads render_data only) follows the pass. Progress is reported per finished range.
+static void renderSampleRanges(const RenderFunction& render_function, RenderData& render_data, Camera& cam,
+                               std::shared_ptr<Scene> scene_ptr, Config& config, int num_workers) {
+    ThreadPool& pool = ThreadPool::shared();
+    const int image_height = render_data.image_height;
+    const int first = render_data.first_sample, end = render_data.samples_per_pixel;
+    const int split = std::max(render_data.split, 1);
+    const int groups = (end - first + split - 1) / split;
+    const int num_tasks = std::min(groups, num_workers * std::max(config.tilesPerThread, 1));
+
+    std::vector<RenderData> partials(num_workers, render_data);
+    for (RenderData& partial : partials) {
+        partial.buffer.assign(render_data.buffer.size(), color(0, 0, 0));
+        if (!partial.pixel_samples.empty()) partial.pixel_samples.assign(render_data.pixel_samples.size(), 0);
+        if (partial.aovs.any()) partial.aovs.reset(render_data.buffer.size());
+        partial.stats.shading = ShadeStats();
+        partial.accumulate = true;
+    }
+
+    // What render_data held before the pass, which every merge starts from.
+    const bool adds = first > 0;
+    FrameBuffer base;
+    std::vector<uint32_t> base_counts;
+    if (adds) {
+        base = render_data.buffer;
+        base_counts = render_data.pixel_samples;
+    }
+    // Partial sums are added in worker order, so a run is reproducible for a given worker count. While the
+    // workers still run, this reads their sums unsynchronised, as the preview reads render_data.
+    auto merge = [&]() {
+        for (size_t p = 0; p < render_data.buffer.size(); ++p) {
+            color sum = adds ? base[p] : color(0, 0, 0);
+            for (const RenderData& partial : partials) sum += partial.buffer[p];
+            render_data.buffer[p] = sum;
         }
-        // Image height is the number of scanlines, suppose image_height = 800
-        const int lines_per_thread = image_height / num_threads;
-        const int leftOver = image_height % num_threads;
-        // The first <num_threads> threads are dedicated <lines_per_thread> lines, and the last thread is dedicated to <leftOver>
+        for (size_t p = 0; p < render_data.pixel_samples.size(); ++p) {
+            uint32_t count = adds ? base_counts[p] : 0;
+            for (const RenderData& partial : partials) count += partial.pixel_samples[p];
+            render_data.pixel_samples[p] = count;
+        }
+    };
+
+    std::atomic<long> completed_rows(0);
+    std::atomic<int> finished_ranges(0);
+    std::vector<std::future<void>> tasks;
+    for (int t = 0; t < num_tasks; ++t) {
+        const int range_first = first + static_cast<int>(static_cast<long>(t) * groups / num_tasks) * split;
+        const int range_end = std::min(end, first + static_cast<int>(static_cast<long>(t + 1) * groups / num_tasks) * split);
+        RenderData& partial = partials[t % num_workers];
+        tasks.push_back(pool.submitTo(t % num_workers, [=, &partial, &completed_rows, &finished_ranges]() {
+            partial.first_sample = range_first;
+            partial.samples_per_pixel = range_end;
+            partial.completed_lines = 0;
+            render_function(image_height, image_height - 1, scene_ptr, partial, cam);
+            completed_rows += partial.completed_lines;
+            int finished = ++finished_ranges;
+            std::cerr << "[" << 100 * finished / num_tasks << "%] completed" << std::endl;
+        }));
+    }
+    const bool previewing = !config.preview.empty() && config.previewRate > 0;
+    const auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                              std::chrono::duration<double>(previewing ? 1.0 / config.previewRate : 0.0));
+    for (auto& task : tasks) {
+        while (previewing && task.wait_for(interval) != std::future_status::ready) merge();
+        task.get();
+    }
 
-        std::vector<color> pixel_colors;
-        std::vector<std::thread> threads;
+    merge();
+    for (const RenderData& partial : partials) {
+        if (render_data.aovs.any()) render_data.aovs.merge(partial.aovs);
+        render_data.stats.shading.merge(partial.stats.shading);
+    }
+
+    // Rows finished per range: the whole image only if every range reached every row (a --time deadline can
+    // stop them part way).
+    render_data.completed_lines = static_cast<int>(completed_rows / num_tasks);
+    render_data.stats.sample_tasks = num_tasks;
+}
 
-        for (int i=0; i < num_threads; i++) {
-            // In the first thead, we want the first lines_per_thread lines to be rendered
-            threads.emplace_back(render_function,lines_per_thread,(image_height-1) - (i * lines_per_thread), scene_ptr, std::ref(render_data),cam);
+// Runs render_function over every row of the image, on the shared pool if multithreading.
+static void renderRows(const RenderFunction& render_function, RenderData& render_data, Camera& cam, std::shared_ptr<Scene> scene_ptr, Config& config) {
+    int image_height = render_data.image_height;
+    render_data.completed_lines = 0;
+    render_data.stats.sample_tasks = 0;
+    if (!config.multithreading) {
+        render_function(image_height, image_height-1, scene_ptr, render_data, cam);
+    } else {
+        // Rows are split into blocks and each block always goes to the same pool worker, so with pinned
+        // workers the framebuffer rows a worker writes first (and keeps writing) live on its NUMA node.
+        // A few blocks per worker (--tiles-per-thread), interleaved, keeps the load balanced when parts of the
+        // image are cheap. -T below the pool's size (as --autotune may pick) leaves the other workers idle.
+        // Images with fewer rows than that many blocks are split over samples instead (--schedule).
+        ThreadPool& pool = ThreadPool::shared();
+        const int num_workers = config.threads > 0 ? std::min(pool.size(), config.threads) : pool.size();
+        if (scheduleBySamples(render_data, config, num_workers)) {
+            renderSampleRanges(render_function, render_data, cam, scene_ptr, config, num_workers);
+            if (config.verbose) {std::cerr << "Joining all threads" << std::endl;}
+            return;
         }
-        threads.emplace_back(render_function,leftOver,(image_height-1) - (num_threads * lines_per_thread), scene_ptr, std::ref(render_data),cam);
+        const int num_blocks = std::min(image_height, num_workers * std::max(config.tilesPerThread, 1));
 
-        for (auto &thread : threads) {
-            thread.join();
+        std::vector<std::future<void>> blocks;
+        int first_row = 0;
+        for (int b = 0; b < num_blocks; ++b) {
+            int rows = image_height / num_blocks + (b < image_height % num_blocks ? 1 : 0);
+            int start_line = (image_height - 1) - first_row;
+            blocks.push_back(pool.submitTo(b % num_workers, [=, &render_data]() {
+                render_function(rows, start_line, scene_ptr, render_data, cam);
+            }));
+            first_row += rows;
         }
+        for (auto& block : blocks) block.get();
 
         if (config.verbose) {std::cerr << "Joining all threads" << std::endl;}
-        threads.clear();
     }
-    
+}
+
+// Writes render_data.buffer, holding sums of samples_per_pixel samples, to the output path in config.outputType.
+static void writeImage(const RenderData& render_data, const Config& config, int samples_per_pixel) {
+    int image_height = render_data.image_height;
+    int image_width = render_data.image_width;
+
     // PPM outputting. No current support for JPG and PNG.
     if (config.outputType == "ppm") {
         std::ofstream outFile(config.outputPath);
@@ -83,6 +183,15 @@ void output(RenderData& render_data, Camera& cam, std::shared_ptr<Scene> scene_p
         } else {
             stbi_write_jpg(config.outputPath.c_str(), image_width, image_height, 3, data, 100);
         }
+    } else if (config.outputType == "pfm") {
+        std::vector<float> pixels(render_data.buffer.size() * 3);
+        for (size_t i = 0; i < render_data.buffer.size(); ++i) {
+            color average = render_data.buffer[i] / samples_per_pixel;
+            pixels[3*i] = average.x();
+            pixels[3*i + 1] = average.y();
+            pixels[3*i + 2] = average.z();
+        }
+        write_pfm(config.outputPath == "image.ppm" ? "image.pfm" : config.outputPath, image_width, image_height, 3, pixels);
     } else if (config.outputType == "png") {
         if (config.outputPath == "image.ppm") {
             write_png("image.png", image_width, image_height, samples_per_pixel, render_data.buffer);
@@ -90,6 +199,235 @@ void output(RenderData& render_data, Camera& cam, std::shared_ptr<Scene> scene_p
             write_png(config.outputPath.c_str(), image_width, image_height, samples_per_pixel, render_data.buffer);
         }
     }
+}
+
+// Largest pass of a progressive render, in samples per pixel (times --split).
+static const int PROGRESSIVE_PASS = 16;
+
+static double luminance(const color& c) {
+    return 0.2126*c.x() + 0.7152*c.y() + 0.0722*c.z();
+}
+
+// Relative RMS error of the image in after (sums over end samples), from how far the pass alone
+// (after - before, samples [first, end)) strays from the image before it. The two are independent, so the
+// squared difference times first * (end - first) / end^2 estimates the variance of the average over end samples.
+static double estimateNoise(const FrameBuffer& before, const FrameBuffer& after, int first, int end) {
+    const double scale = static_cast<double>(first) * (end - first) / (static_cast<double>(end) * end);
+    double sum = 0;
+    for (size_t i = 0; i < after.size(); ++i) {
+        double earlier = luminance(before[i]) / first;
+        double pass = luminance(after[i] - before[i]) / (end - first);
+        double average = luminance(after[i]) / end;
+        double difference = earlier - pass;
+        sum += scale * difference * difference / ((average + 0.01) * (average + 0.01));
+    }
+    return after.empty() ? 0 : std::sqrt(sum / after.size());
+}
+
+// Scales every pixel of the buffer and the first-hit layers to the largest sample count in
+// render_data.pixel_samples, so the image can be averaged over one count. Pixels no pass reached are black.
+// Returns that count, which every pixel then has.
+static int normalizeSampleCounts(RenderData& render_data) {
+    std::vector<uint32_t>& counts = render_data.pixel_samples;
+    uint32_t reached = counts.empty() ? 0 : *std::max_element(counts.begin(), counts.end());
+    AOVBuffers& aovs = render_data.aovs;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        if (counts[i] == reached) continue;
+        float scale = counts[i] > 0 ? static_cast<float>(reached) / counts[i] : 0.0f;
+        render_data.buffer[i] = counts[i] > 0 ? render_data.buffer[i] * scale : color(0, 0, 0);
+        aovs.scale(i, scale);
+        counts[i] = reached;
+    }
+    return std::max<int>(reached, 1);
+}
+
+void renderImage(RenderData& render_data, Camera& cam, std::shared_ptr<Scene> scene_ptr, Config& config) {
+    RenderFunction render_function;
+
+    if (config.vectorization == 0) { render_function = render_scanlines; }
+    else if (config.vectorization == 4) { render_function = render_scanlines_sse; }
+    else if (config.vectorization == 8) { render_function = render_scanlines_avx; }
+    else if (config.vectorization == 16) { render_function = render_scanlines_avx; } // replace with 16 batch render_scanlines when made
+    else { render_function = render_scanlines; }
+
+    // Path splitting, the radiance cache and path guiding work on the recursive path of the scalar integrator only.
+    if ((render_data.split > 1 || render_data.radiance_cache || render_data.path_guide) && config.vectorization != 0) {
+        if (config.verbose) std::cerr << "--split, --radiance-cache and --guide render with the scalar integrator" << std::endl;
+        render_function = render_scanlines;
+    }
+
+    render_data.stats.time_to_first_ray = secondsSince(render_data.stats.start);
+    const bool progressive = config.timeBudget > 0 || config.noiseTarget > 0;
+    if (!render_data.radiance_cache && !render_data.path_guide && !progressive) {
+        renderRows(render_function, render_data, cam, scene_ptr, config);
+        return;
+    }
+
+    // The samples of every pixel are rendered in passes, each adding to the image, so no samples are thrown away.
+    // => The radiance cache trains over its first part of the samples and is queried by the rest.
+    // => The path guide trains in passes of 1, 2, 4, ... samples (times split) while the last pass keeps at
+    //    least half the samples, and learns from each pass before the next one starts.
+    // => Progressive renders pass 1, 2, 4, ... up to PROGRESSIVE_PASS samples at a time, then that many per pass,
+    //    until the time budget runs out, the noise estimate reaches its target or -s samples are done.
+    const int samples_per_pixel = render_data.samples_per_pixel;
+    const int split = std::max(render_data.split, 1);
+    std::vector<int> pass_ends = { samples_per_pixel };
+    int cache_training = 0;
+    if (render_data.radiance_cache) {
+        cache_training = static_cast<int>(std::lround(samples_per_pixel * render_data.radiance_cache->trainingFraction() / split)) * split;
+        cache_training = std::clamp(cache_training, split, samples_per_pixel);
+        pass_ends.push_back(cache_training);
+    }
+    if (render_data.path_guide) {
+        for (int end = split, size = split; 2 * end <= samples_per_pixel; size *= 2, end += size) pass_ends.push_back(end);
+    }
+    if (progressive) {
+        for (int end = split, size = split; end < samples_per_pixel; size = std::min(2 * size, PROGRESSIVE_PASS * split), end += size) {
+            pass_ends.push_back(end);
+        }
+    }
+    std::sort(pass_ends.begin(), pass_ends.end());
+    pass_ends.erase(std::unique(pass_ends.begin(), pass_ends.end()), pass_ends.end());
+
+    // Every pixel's sample count is kept, so a pass cut short still averages each pixel over its own samples.
+    // The live preview may be reading counts output() allocated for it, so they are reset, never reallocated.
+    std::vector<uint32_t>& counts = render_data.pixel_samples;
+    if (counts.size() != render_data.buffer.size()) counts.assign(render_data.buffer.size(), 0);
+    else std::fill(counts.begin(), counts.end(), 0);
+    if (config.timeBudget > 0) {
+        render_data.deadline = render_data.stats.start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                    std::chrono::duration<double>(config.timeBudget));
+    }
+    render_data.stats.progressive_passes = 0;
+    render_data.stats.noise_estimate = 0;
+    auto last_write = std::chrono::steady_clock::now();
+    FrameBuffer before;
+    bool cut_short = false;
+
+    for (int end : pass_ends) {
+        if (progressive && std::chrono::steady_clock::now() >= render_data.deadline) break;
+        if (render_data.radiance_cache) render_data.radiance_cache->training = end <= cache_training;
+        if (render_data.path_guide) render_data.path_guide->training = end < samples_per_pixel;
+        if (config.noiseTarget > 0) before = render_data.buffer;
+        const int first = render_data.first_sample;
+        render_data.samples_per_pixel = end;
+        renderRows(render_function, render_data, cam, scene_ptr, config);
+        if (render_data.completed_lines < render_data.image_height) { // out of time part way through the pass
+            cut_short = true;
+            break;
+        }
+        render_data.first_sample = end;
+        render_data.stats.progressive_passes += 1;
+        if (render_data.path_guide && end < samples_per_pixel) render_data.path_guide->update();
+
+        if (config.noiseTarget > 0 && first > 0) {
+            render_data.stats.noise_estimate = estimateNoise(before, render_data.buffer, first, end);
+            if (config.verbose) std::cerr << "Pass to " << end << " spp: noise " << render_data.stats.noise_estimate << std::endl;
+            if (render_data.stats.noise_estimate <= config.noiseTarget) break;
+        }
+        if (config.progressInterval > 0 && end < samples_per_pixel && secondsSince(last_write) >= config.progressInterval) {
+            writeImage(render_data, config, end);
+            last_write = std::chrono::steady_clock::now();
+        }
+    }
+    render_data.first_sample = 0;
+    render_data.deadline = std::chrono::steady_clock::time_point::max();
+    if (cut_short && !progressive) {
+        std::cerr << "Warning: a render pass stopped part way; pixels are averaged over the samples they reached" << std::endl;
+    }
+    if (progressive || cut_short) {
+        render_data.samples_per_pixel = normalizeSampleCounts(render_data);
+    } else {
+        render_data.samples_per_pixel = samples_per_pixel;
+    }
+}
+
+// Bounds of the scene's geometry, or the unit cube if it has none.
+static void sceneBounds(const Scene& scene, point3& lower, point3& upper) {
+    RTCBounds bounds;
+    rtcGetSceneBounds(scene.rtc_scene, &bounds);
+    lower = point3(bounds.lower_x, bounds.lower_y, bounds.lower_z);
+    upper = point3(bounds.upper_x, bounds.upper_y, bounds.upper_z);
+    double length = (upper - lower).length();
+    if (!std::isfinite(length) || !(length > 0)) {
+        lower = point3(0, 0, 0);
+        upper = point3(1, 1, 1);
+    }
+}
+
+void output(RenderData& render_data, Camera& cam, std::shared_ptr<Scene> scene_ptr, Config& config) {
+    int image_height = render_data.image_height;
+    int image_width = render_data.image_width;
+    int samples_per_pixel = render_data.samples_per_pixel;
+
+    auto start_time = std::chrono::high_resolution_clock::now();
+    render_data.stats.shading = ShadeStats();
+    render_data.reorder_rays = config.reorderRays;
+    render_data.sampler = Sampler::create(parseSamplerType(config.sampler), samples_per_pixel, image_width);
+    render_data.split = std::min(config.split, samples_per_pixel);
+    render_data.primary_sampler.reset();
+    if (render_data.split > 1) {
+        int camera_rays = (samples_per_pixel + render_data.split - 1) / render_data.split;
+        render_data.primary_sampler = Sampler::create(parseSamplerType(config.sampler), camera_rays, image_width);
+    }
+    render_data.radiance_cache.reset();
+    CacheQuality cache_quality = parseCacheQuality(config.radianceCache);
+    if (cache_quality != CacheQuality::Off) {
+        double cell_size = config.cacheCellSize;
+        if (cell_size <= 0) { // a fraction of the scene's diagonal, coarser for previews
+            point3 lower, upper;
+            sceneBounds(*scene_ptr, lower, upper);
+            cell_size = (upper - lower).length() / (cache_quality == CacheQuality::Preview ? 64 : 128);
+        }
+        render_data.radiance_cache = std::make_shared<RadianceCache>(cache_quality, cell_size);
+    }
+    render_data.path_guide.reset();
+    if (config.guide) {
+        point3 lower, upper;
+        sceneBounds(*scene_ptr, lower, upper);
+        render_data.path_guide = std::make_shared<PathGuide>(lower, upper);
+    }
+
+    DenoiseQuality denoise = parseDenoiseQuality(config.denoise);
+    render_data.aovs.clear();
+    for (AOV layer : parseAOVList(config.aovs)) render_data.aovs.request(layer);
+    if (denoise != DenoiseQuality::Off) {
+        render_data.aovs.request(AOV::Albedo);
+        render_data.aovs.request(AOV::Normal);
+        render_data.aovs.request(AOV::Depth);
+    }
+    render_data.aovs.reset(render_data.buffer.size());
+
+    // Sample counts per pixel, for progressive renders and the live preview; allocated once here, as the
+    // preview's publisher reads them while rendering.
+    const bool progressive = config.timeBudget > 0 || config.noiseTarget > 0;
+    if (progressive || !config.preview.empty()) render_data.pixel_samples.assign(render_data.buffer.size(), 0);
+    else render_data.pixel_samples.clear();
+    std::unique_ptr<LivePreview> preview;
+    if (!config.preview.empty()) {
+        preview = std::make_unique<LivePreview>(config.preview, image_width, image_height,
+                                                parsePreviewFormat(config.previewFormat), config.previewRate);
+        preview->start(render_data);
+    }
+
+    renderImage(render_data, cam, scene_ptr, config);
+    samples_per_pixel = render_data.samples_per_pixel; // progressive renders may stop early
+    if (preview) preview->stop();
+    writeAOVs(render_data, config);
+
+    render_data.stats.denoise_seconds = 0;
+    if (denoise != DenoiseQuality::Off) {
+        Denoiser denoiser(denoise);
+        denoiser.apply(render_data, config.multithreading);
+        render_data.stats.denoise_seconds = denoiser.seconds;
+    }
+    if (preview) {
+        preview->publish(render_data, true);
+        if (config.verbose) std::cerr << "Live preview: " << preview->frames() << " frames published to " << config.preview << std::endl;
+    }
+    render_data.pixel_samples.clear();
+    
+    writeImage(render_data, config, samples_per_pixel);
 
     if (config.verbose) {
         auto current_time = std::chrono::high_resolution_clock::now();
@@ -101,5 +439,135 @@ void output(RenderData& render_data, Camera& cam, std::shared_ptr<Scene> scene_p
         outputRenderInfo(debugFile, config, render_data, time_seconds);
 
         std::cerr << "\nCompleted render of scene. Render time: " << time_seconds << " seconds" << "\n";
+        if (denoise != DenoiseQuality::Off) {
+            std::cerr << "Denoise: " << render_data.stats.denoise_seconds << " seconds (" << config.denoise << ", included above)\n";
+        }
+        std::cerr << "Time to first ray: " << render_data.stats.time_to_first_ray << " seconds"
+                  << " (parse " << render_data.stats.parse_seconds << "s, commit " << render_data.stats.commit_seconds << "s)\n";
+        if (render_data.stats.mesh_triangles > 0) {
+            std::cerr << "Mesh load: " << render_data.stats.mesh_load_seconds << " seconds for " << render_data.stats.mesh_triangles << " triangles\n";
+        }
+        std::cerr << "BVH build: " << render_data.stats.bvh_build_seconds << " seconds, "
+                  << render_data.stats.bvh_bytes / (1024.0 * 1024.0) << " MB\n";
+        if (render_data.stats.lights > 0) {
+            std::cerr << "Light BVH: " << render_data.stats.lights << " lights in " << render_data.stats.light_bvh_seconds << " seconds, "
+                      << render_data.stats.light_bvh_bytes / 1024.0 << " KB\n";
+        }
+        std::cerr << "Peak RSS: " << peakResidentMB() << " MB\n";
+        std::cerr << "Sampler: " << config.sampler << "\n";
+        if (config.timeBudget > 0 || config.noiseTarget > 0) {
+            std::cerr << "Progressive: " << render_data.stats.progressive_passes << " passes, " << samples_per_pixel << " spp reached";
+            if (config.noiseTarget > 0) std::cerr << ", noise " << render_data.stats.noise_estimate;
+            std::cerr << "\n";
+        }
+        if (render_data.split > 1) std::cerr << "Path splitting: " << render_data.split << " paths per camera ray\n";
+        if (render_data.radiance_cache) {
+            const RadianceCache& cache = *render_data.radiance_cache;
+            std::cerr << "Radiance cache: " << cache.cells() << " cells of " << cache.cellSize() << ", hit rate "
+                      << (cache.lookups() > 0 ? 100.0 * cache.hits() / cache.lookups() : 0.0) << "% of " << cache.lookups() << " lookups\n";
+        }
+        if (render_data.path_guide) {
+            std::cerr << "Path guiding: " << render_data.path_guide->regionCount() << " regions, "
+                      << render_data.path_guide->iterations() << " training passes\n";
+        }
+        const ShadeStats& shading = render_data.stats.shading;
+        if (shading.batches > 0) {
+            std::cerr << "Shading: " << (double)shading.unique_materials / shading.batches << " materials per batch sorted, "
+                      << (double)shading.lane_switches / shading.batches << " in lane order\n";
+        }
+    }
+}
+
+std::string aovOutputPath(const Config& config, AOV layer) {
+    std::string path = config.outputPath;
+    if (path == "image.ppm") path = "image." + config.outputType; // same default naming as output()
+
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of('/');
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) path = path.substr(0, dot);
+    return path + "_" + aovName(layer) + ".pfm";
+}
+
+void writeAOVs(const RenderData& render_data, const Config& config) {
+    const AOVBuffers& aovs = render_data.aovs;
+    const size_t pixels = render_data.buffer.size();
+    const float inv_spp = 1.0f / render_data.samples_per_pixel;
+    for (AOV layer : parseAOVList(config.aovs)) {
+        std::vector<float> out;
+        int channels = 1;
+        if (layer == AOV::Albedo || layer == AOV::Normal) {
+            const std::vector<float>* planes = layer == AOV::Albedo ? aovs.albedo : aovs.normal;
+            channels = 3;
+            out.resize(pixels * 3);
+            for (size_t i = 0; i < pixels; ++i) {
+                for (int c = 0; c < 3; ++c) out[3*i + c] = planes[c][i] * inv_spp;
+            }
+        } else if (layer == AOV::Depth) {
+            out.resize(pixels);
+            for (size_t i = 0; i < pixels; ++i) out[i] = aovs.depth[i] * inv_spp;
+        } else {
+            out.assign(aovs.object_id.begin(), aovs.object_id.end());
+        }
+        write_pfm(aovOutputPath(config, layer), render_data.image_width, render_data.image_height, channels, out);
+    }
+}
+
+void reportSamplerError(RenderData& render_data, Camera& cam, std::shared_ptr<Scene> scene_ptr, Config& config, std::ostream& out) {
+    const int spp = render_data.samples_per_pixel;
+    const int reference_spp = spp * 16;
+    const int width = render_data.image_width;
+    Config quiet = config;
+    quiet.verbose = false;
+
+    RenderData probe = render_data;
+    probe.reorder_rays = config.reorderRays;
+    probe.aovs.clear();
+    probe.split = 1;
+    probe.radiance_cache.reset();
+    probe.path_guide.reset();
+    quiet.timeBudget = 0;
+    quiet.noiseTarget = 0;
+
+    // Reference: 16x the samples with the random sampler. A Sobol reference would share its first spp samples
+    // with the Sobol estimate (its scramble depends only on pixel and dimension), understating that error.
+    probe.samples_per_pixel = reference_spp;
+    probe.sampler = Sampler::create(SamplerType::Random, reference_spp, width);
+    renderImage(probe, cam, scene_ptr, quiet);
+    std::vector<color> reference(probe.buffer.size());
+    for (size_t i = 0; i < reference.size(); ++i) reference[i] = probe.buffer[i] / reference_spp;
+
+    out << "Sampler error at " << spp << " spp (RMSE against a " << reference_spp << " spp random reference):" << std::endl;
+    double random_rmse = 0;
+    for (SamplerType type : { SamplerType::Random, SamplerType::Stratified, SamplerType::Sobol, SamplerType::BlueNoise }) {
+        probe.samples_per_pixel = spp;
+        probe.sampler = Sampler::create(type, spp, width);
+        auto render_start = std::chrono::steady_clock::now();
+        renderImage(probe, cam, scene_ptr, quiet);
+        double seconds = secondsSince(render_start);
+
+        double squared = 0;
+        for (size_t i = 0; i < reference.size(); ++i) {
+            color difference = probe.buffer[i] / spp - reference[i];
+            squared += dot(difference, difference) / 3.0;
+        }
+        double rmse = std::sqrt(squared / reference.size());
+        if (type == SamplerType::Random) random_rmse = rmse;
+
+        out << "  " << std::left << std::setw(12) << samplerName(type) << std::right
+            << " RMSE " << std::setw(10) << rmse
+            << "  x" << std::setw(6) << std::setprecision(3) << (rmse > 0 ? random_rmse / rmse : 0) << std::setprecision(6)
+            << " vs random  (" << seconds << " s)" << std::endl;
     }
 }
+
+std::string frameOutputPath(const Config& config, int frame) {
+    std::string path = config.outputPath;
+    if (path == "image.ppm") path = "image." + config.outputType; // same default naming as output()
+
+    char number[16];
+    snprintf(number, sizeof(number), "_%04d", frame);
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return path + number;
+    return path.substr(0, dot) + number + path.substr(dot);
+}
@@ -0,0 +1,17 @@
+#include "pfm_output.h"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+void write_pfm(const std::string& path, int width, int height, int channels, const std::vector<float>& pixels) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open()) throw std::runtime_error("Could not open file: " + path);
+
+    // The sign of the scale gives the byte order of the samples: negative for little endian.
+    const uint16_t probe = 1;
+    uint8_t first_byte;
+    std::memcpy(&first_byte, &probe, 1);
+    out << (channels == 3 ? "PF" : "Pf") << "\n" << width << " " << height << "\n" << (first_byte == 1 ? "-1.0" : "1.0") << "\n";
+    out.write(reinterpret_cast<const char*>(pixels.data()), static_cast<std::streamsize>(pixels.size() * sizeof(float)));
+}
@@ -4,7 +4,7 @@ uint8_t to_byte(float value) {
     return static_cast<uint8_t>(value);
 }
 
-void write_png(const char* filename, int width, int height, int samples_per_pixel, const std::vector<color>& buffer) {
+void write_png(const char* filename, int width, int height, int samples_per_pixel, const FrameBuffer& buffer) {
     FILE *fp = fopen(filename, "wb");
     if(!fp) return;
 
@@ -1,4 +1,8 @@
 #include "cli_parser.hh"
+#include "denoiser.h"
+#include "live_preview.h"
+#include "texture_cache.hh"
+#include "thread_pool.hh"
 
 void outputHelpGuide(std::ostream& out) {
     out << "Usage: ./caitlyn [options]\n"
@@ -8,13 +12,47 @@ void outputHelpGuide(std::ostream& out) {
         << " -i,  --input <filepath>               Input file path for the scene.\n"
         << " -o,  --output <path>                  Output path for the rendered image.\n"
         << " -r,  --resolution <width> <height>    Resolution of the output image.\n"
-        << " -t,  --type <image_type>              Type of the output image [png|jpg|ppm].\n"
+        << " -t,  --type <image_type>              Type of the output image [png|jpg|ppm|pfm]. pfm keeps the float radiance.\n"
         << " -mt, --multithreading                 Enable multithreading.\n"
         << " -v,  --version                        Show the current version.\n"
         << " -h,  --help                           Show this help message.\n"
         << " -V,  --verbose                        Enables more descriptive messages of scenes and rendering process.\n"
         << " -T,  --threads <amt>                  If multithreading is enabled, sets amount of threads used.\n"
-        << " -Vx, --vectorization <batch_size>     Set SIMD vectorization batch size [0|4|8|16]. If NONE = 0, do not enable the flag.\n";
+        << "      --pin-threads                    Pin worker threads to cores, spread evenly over NUMA nodes.\n"
+        << " -Vx, --vectorization <batch_size>     Set SIMD vectorization batch size [0|4|8|16]. If NONE = 0, do not enable the flag.\n"
+        << "      --reorder-rays                   With -Vx, regroup secondary rays into coherent packets before tracing.\n"
+        << "      --tiles-per-thread <number>      Blocks of rows each worker renders when multithreading (default: 4).\n"
+        << "      --schedule <mode>                Split multithreaded work over rows or sample ranges [auto|rows|samples].\n"
+        << "      --autotune                       Time short pilot renders and use the fastest -Vx, thread count and tiles per thread.\n"
+        << "      --autotune-cache <filepath>      Remember --autotune choices per scene, host and resolution in this file.\n"
+        << "      --sampler <type>                 Sample sequence for pixels, lens and bounces [random|stratified|sobol|bluenoise].\n"
+        << "      --sampler-report                 Also render with every sampler at the same spp and report each one's error.\n"
+        << "      --split <number>                 Trace one camera ray per <number> samples and continue it with that many paths.\n"
+        << "      --radiance-cache <quality>       End diffuse paths in a radiance cache trained by the first samples [off|preview|final].\n"
+        << "      --cache-cell <size>              Radiance cache cell size in world units (default: from the scene bounds).\n"
+        << "      --guide                          Learn where light comes from over doubling passes and guide diffuse bounces there.\n"
+        << "      --time <duration>                Render progressively until this much time has passed (e.g. 120s, 2m); -s is the cap.\n"
+        << "      --noise <target>                 Render progressively until the estimated relative error is below target (e.g. 0.02).\n"
+        << "      --progress-interval <duration>   In progressive renders, rewrite the output image this often.\n"
+        << "      --preview <name>                 Publish the image while it renders to shared memory /dev/shm/<name>.\n"
+        << "      --preview-format <format>        Live preview pixels [rgb8|float] (default: rgb8, tone mapped).\n"
+        << "      --preview-fps <rate>             Live preview frames per second (default: 10).\n"
+        << "      --preview-dump <name>            Write every frame of a running preview to --output until it finishes, then exit.\n"
+        << "      --estimate                       Predict the render time from a short pilot pass, print it as JSON and exit.\n"
+        << "      --aov <layers>                   Also write first-hit layers as <output>_<layer>.pfm [albedo,normal,depth,id].\n"
+        << "      --denoise <quality>              Filter the image guided by first-hit albedo, normal and depth [off|fast|balanced|high].\n"
+        << "      --compile <filepath>             Compile a CSR scene to the binary .csrb format (written to --output) and exit.\n"
+        << "      --serve <socket_path>            Run as a render server accepting jobs on a Unix domain socket.\n"
+        << "      --cache-size <number>            Max number of parsed scenes the render server keeps in memory.\n"
+        << "      --frames <number>                Frames to render for a keyframed scene (default: up to the last keyframe).\n"
+        << "      --build-quality <quality>        BVH build quality [low|medium|high]. Overrides the scene's Build block.\n"
+        << "      --scene-flags <flags>            Comma separated Embree scene flags [compact|robust|dynamic|none].\n"
+        << "      --embree-threads <amt>           Threads Embree uses to build the BVH.\n"
+        << "      --isa <isa>                      Embree instruction set [sse2|sse4.2|avx|avx2|avx512].\n"
+        << "      --hugepages                      Let Embree allocate BVH memory in huge pages.\n"
+        << "      --set-affinity                   Let Embree pin its build threads to cores.\n"
+        << "      --device-config <config>         Extra Embree device configuration, passed through as is.\n"
+        << "      --texture-cache <directory>      Store decoded textures in this directory and reuse them across runs.\n";
     exit(0);
 }
 
@@ -23,10 +61,92 @@ void outputRenderInfo(std::ostream& out, Config& config, RenderData& render_data
     out << "Samples: " << render_data.samples_per_pixel << std::endl;
     out << "Depth: " << render_data.max_depth << std::endl;
     out << "Time: " << time << " seconds" << std::endl;
-    if (config.multithreading) out << "Multithreading: YES" << std::endl;
+    if (!config.aovs.empty()) out << "AOVs: " << config.aovs << std::endl;
+    if (config.denoise != "off") out << "Denoise: " << render_data.stats.denoise_seconds << " seconds (" << config.denoise << ")" << std::endl;
+    out << "Parse: " << render_data.stats.parse_seconds << " seconds" << std::endl;
+    out << "Commit: " << render_data.stats.commit_seconds << " seconds" << std::endl;
+    out << "Time to first ray: " << render_data.stats.time_to_first_ray << " seconds" << std::endl;
+    out << "BVH build: " << render_data.stats.bvh_build_seconds << " seconds" << std::endl;
+    out << "BVH memory: " << render_data.stats.bvh_bytes / (1024.0 * 1024.0) << " MB (peak "
+        << render_data.stats.bvh_peak_bytes / (1024.0 * 1024.0) << " MB)" << std::endl;
+    if (render_data.stats.lights > 0) {
+        out << "Light BVH: " << render_data.stats.lights << " lights, " << render_data.stats.light_bvh_seconds << " seconds, "
+            << render_data.stats.light_bvh_bytes / 1024.0 << " KB" << std::endl;
+    }
+    if (render_data.stats.mesh_triangles > 0) {
+        out << "Mesh load: " << render_data.stats.mesh_load_seconds << " seconds (" << render_data.stats.mesh_triangles << " triangles)" << std::endl;
+    }
+    out << "Peak RSS: " << peakResidentMB() << " MB" << std::endl;
+    const ShadeStats& shading = render_data.stats.shading;
+    if (shading.batches > 0) {
+        out << "Shading: " << shading.hits << " hits in " << shading.batches << " batches, "
+            << (double)shading.unique_materials / shading.batches << " unique materials per batch (sorted), "
+            << (double)shading.lane_switches / shading.batches << " material switches per batch in lane order" << std::endl;
+        out << "Packet intersect: " << shading.intersect_seconds << " seconds (summed over workers)" << std::endl;
+        out << "Cache misses: ";
+        if (shading.cache_misses >= 0) out << shading.cache_misses << std::endl;
+        else out << "unavailable" << std::endl;
+    }
+    auto textures = TextureCache::shared().stats();
+    out << "Textures: " << textures.requests << " requested, " << textures.shared << " shared, "
+        << textures.disk_hits << " from disk cache, " << textures.decodes << " decoded" << std::endl;
+    if (config.multithreading) {
+        ThreadPool& pool = ThreadPool::shared();
+        out << "Multithreading: YES (" << pool.size() << " workers on " << pool.nodeCount() << " NUMA node(s)"
+            << (pool.pinned() ? ", pinned" : "") << ")" << std::endl;
+        if (render_data.stats.sample_tasks > 0) out << "Schedule: samples (" << render_data.stats.sample_tasks << " ranges per pass)" << std::endl;
+        else out << "Schedule: rows" << std::endl;
+    }
     else out << "Multithreading: NO" << std::endl;
     if (config.vectorization == 0) out << "Vectorization: NONE" << std::endl;
     else out << "Vectorization: " << config.vectorization << std::endl;
+    out << "Sampler: " << config.sampler << std::endl;
+    if (render_data.radiance_cache) {
+        const RadianceCache& cache = *render_data.radiance_cache;
+        out << "Radiance cache: " << config.radianceCache << ", " << cache.cells() << " cells of " << cache.cellSize() << ", "
+            << cache.memoryBytes() / (1024.0 * 1024.0) << " MB, " << cache.hits() << " hits in " << cache.lookups() << " lookups ("
+            << (cache.lookups() > 0 ? 100.0 * cache.hits() / cache.lookups() : 0.0) << "%)" << std::endl;
+    }
+    if (config.timeBudget > 0 || config.noiseTarget > 0) {
+        out << "Progressive: " << render_data.stats.progressive_passes << " passes";
+        if (config.timeBudget > 0) out << ", time budget " << config.timeBudget << " seconds";
+        if (config.noiseTarget > 0) out << ", noise " << render_data.stats.noise_estimate << " (target " << config.noiseTarget << ")";
+        out << std::endl;
+    }
+    if (render_data.path_guide) {
+        const PathGuide& guide = *render_data.path_guide;
+        out << "Path guiding: " << guide.regionCount() << " regions after " << guide.iterations() << " training passes, "
+            << guide.memoryBytes() / 1024.0 << " KB" << std::endl;
+    }
+    if (render_data.split > 1) {
+        out << "Path splitting: " << render_data.split << " paths per camera ray, "
+            << (render_data.samples_per_pixel + render_data.split - 1) / render_data.split << " camera rays per pixel" << std::endl;
+    }
+    if (config.vectorization != 0) out << "Ray reordering: " << (config.reorderRays ? "YES" : "NO") << std::endl;
+}
+
+std::string deviceConfigString(const Config& config) {
+    std::string result;
+    auto add = [&](const std::string& option) { result += (result.empty() ? "" : ",") + option; };
+    if (config.embreeThreads > 0) {
+        add("threads=" + std::to_string(config.embreeThreads));
+    } else {
+        // BVH builds are joined by every shared pool worker plus the committing thread (Scene::commitScene),
+        // so let Embree's task scheduler use those instead of starting as many threads again.
+        int joiners = ThreadPool::shared().size() + 1;
+        add("threads=" + std::to_string(joiners) + ",user_threads=" + std::to_string(joiners));
+    }
+    if (!config.isa.empty()) add("isa=" + config.isa);
+    if (config.hugepages) add("hugepages=1");
+    if (config.setAffinity) add("set_affinity=1");
+    if (!config.deviceConfig.empty()) add(config.deviceConfig);
+    return result;
+}
+
+BuildSettings buildSettings(const Config& config, BuildSettings scene_settings) {
+    if (!config.buildQuality.empty()) scene_settings.quality = parseBuildQuality(config.buildQuality);
+    if (!config.sceneFlags.empty()) scene_settings.flags = parseSceneFlags(config.sceneFlags);
+    return scene_settings;
 }
 
 int checkValidIntegerInput(int& i, int argc, char* argv[], std::string flagName) {
@@ -48,6 +168,46 @@ int checkValidIntegerInput(int& i, int argc, char* argv[], std::string flagName)
     return result;
 }
 
+double checkValidDoubleInput(int& i, int argc, char* argv[], std::string flagName) {
+    double result;
+    if(i + 1 < argc) {
+        try {
+            result = std::stod(argv[++i]);
+            if (!(result > 0)) {
+                throw std::invalid_argument("Input must be a positive number.");
+            }
+        } catch (const std::invalid_argument& e) {
+            throw std::invalid_argument("Invalid argument for "+flagName+": Argument must be a positive number.");
+        } catch (const std::out_of_range& e) {
+            throw std::out_of_range("Invalid argument for "+flagName+": Argument is out of range.");
+        }
+    } else {
+        throw std::invalid_argument("Missing argument for "+flagName+".");
+    }
+    return result;
+}
+
+double checkValidDurationInput(int& i, int argc, char* argv[], std::string flagName) {
+    if (i + 1 >= argc) throw std::invalid_argument("Missing argument for "+flagName+".");
+    std::string text = argv[++i];
+    double unit = 1;
+    if (!text.empty() && (text.back() == 's' || text.back() == 'm' || text.back() == 'h')) {
+        unit = text.back() == 'h' ? 3600 : (text.back() == 'm' ? 60 : 1);
+        text.pop_back();
+    }
+    size_t used = 0;
+    double result = 0;
+    try {
+        result = std::stod(text, &used);
+    } catch (const std::exception& e) {
+        used = 0;
+    }
+    if (used == 0 || used != text.size() || !(result > 0)) {
+        throw std::invalid_argument("Invalid argument for "+flagName+": Argument must be a positive duration such as 90, 90s or 1.5m.");
+    }
+    return result * unit;
+}
+
 Config parseArguments(int argc, char* argv[]) {
     
     Config config;
@@ -82,8 +242,8 @@ Config parseArguments(int argc, char* argv[]) {
         else if(arg == "-t" || arg == "--type") {
             if(i + 1 < argc) {
                 std::string type(argv[++i]);
-                if (type == "ppm" || type == "png" || type == "jpg") config.outputType = type;
-                else throw std::invalid_argument("Invalid argument for -t/--type [ppm]");
+                if (type == "ppm" || type == "png" || type == "jpg" || type == "pfm") config.outputType = type;
+                else throw std::invalid_argument("Invalid argument for -t/--type [png|jpg|ppm|pfm]");
             }
         } 
 
@@ -101,6 +261,130 @@ Config parseArguments(int argc, char* argv[]) {
             else throw std::invalid_argument("Error: Invalid option for --vectorization [1|4|8|16]. Use '--help' for more information.");
         } 
 
+        else if(arg == "--compile") {
+            if(i + 1 < argc) config.compileFile = argv[++i];
+            else throw std::invalid_argument("Missing argument for --compile.");
+        }
+
+        else if(arg == "--serve") {
+            if(i + 1 < argc) config.serverSocket = argv[++i];
+            else throw std::invalid_argument("Missing argument for --serve.");
+        }
+
+        else if(arg == "--cache-size") {
+            config.serverCacheSize = checkValidIntegerInput(i, argc, argv, "--cache-size");
+        }
+
+        else if(arg == "--frames") {
+            config.frames = checkValidIntegerInput(i, argc, argv, "--frames");
+            if (config.frames < 1) throw std::invalid_argument("Error: --frames must be at least 1.");
+        }
+
+        else if(arg == "--build-quality") {
+            if(i + 1 < argc) config.buildQuality = argv[++i];
+            else throw std::invalid_argument("Missing argument for --build-quality.");
+            parseBuildQuality(config.buildQuality);
+        }
+
+        else if(arg == "--scene-flags") {
+            if(i + 1 < argc) config.sceneFlags = argv[++i];
+            else throw std::invalid_argument("Missing argument for --scene-flags.");
+            parseSceneFlags(config.sceneFlags);
+        }
+
+        else if(arg == "--embree-threads") {
+            config.embreeThreads = checkValidIntegerInput(i, argc, argv, "--embree-threads");
+        }
+
+        else if(arg == "--isa") {
+            if(i + 1 < argc) config.isa = argv[++i];
+            else throw std::invalid_argument("Missing argument for --isa.");
+            if (config.isa != "sse2" && config.isa != "sse4.2" && config.isa != "avx" && config.isa != "avx2" && config.isa != "avx512") {
+                throw std::invalid_argument("Error: Invalid option for --isa [sse2|sse4.2|avx|avx2|avx512].");
+            }
+        }
+
+        else if(arg == "--pin-threads") config.pinThreads = true;
+
+        else if(arg == "--reorder-rays") config.reorderRays = true;
+
+        else if(arg == "--tiles-per-thread") config.tilesPerThread = checkValidIntegerInput(i, argc, argv, "--tiles-per-thread");
+        else if(arg == "--schedule") {
+            if(i + 1 < argc) config.schedule = argv[++i];
+            else throw std::invalid_argument("Missing argument for --schedule.");
+            if (config.schedule != "auto" && config.schedule != "rows" && config.schedule != "samples") {
+                throw std::invalid_argument("Error: Invalid option for --schedule [auto|rows|samples].");
+            }
+        }
+        else if(arg == "--autotune") config.autotune = true;
+        else if(arg == "--autotune-cache") {
+            if(i + 1 < argc) config.autotuneCache = argv[++i];
+            else throw std::invalid_argument("Missing argument for --autotune-cache.");
+        }
+
+        else if(arg == "--sampler") {
+            if(i + 1 < argc) config.sampler = argv[++i];
+            else throw std::invalid_argument("Missing argument for --sampler.");
+            parseSamplerType(config.sampler);
+        }
+
+        else if(arg == "--sampler-report") config.samplerReport = true;
+        else if(arg == "--split") {
+            config.split = checkValidIntegerInput(i, argc, argv, "--split");
+            if (config.split < 1) throw std::invalid_argument("Error: --split must be at least 1.");
+        }
+        else if(arg == "--radiance-cache") {
+            if(i + 1 < argc) config.radianceCache = argv[++i];
+            else throw std::invalid_argument("Missing argument for --radiance-cache.");
+            parseCacheQuality(config.radianceCache);
+        }
+        else if(arg == "--cache-cell") {
+            config.cacheCellSize = checkValidDoubleInput(i, argc, argv, "--cache-cell");
+        }
+        else if(arg == "--guide") config.guide = true;
+        else if(arg == "--time") config.timeBudget = checkValidDurationInput(i, argc, argv, "--time");
+        else if(arg == "--noise") config.noiseTarget = checkValidDoubleInput(i, argc, argv, "--noise");
+        else if(arg == "--progress-interval") config.progressInterval = checkValidDurationInput(i, argc, argv, "--progress-interval");
+        else if(arg == "--preview") {
+            if(i + 1 < argc) config.preview = argv[++i];
+            else throw std::invalid_argument("Missing argument for --preview.");
+        }
+        else if(arg == "--preview-format") {
+            if(i + 1 < argc) config.previewFormat = argv[++i];
+            else throw std::invalid_argument("Missing argument for --preview-format.");
+            parsePreviewFormat(config.previewFormat);
+        }
+        else if(arg == "--preview-fps") config.previewRate = checkValidDoubleInput(i, argc, argv, "--preview-fps");
+        else if(arg == "--estimate") config.estimate = true;
+        else if(arg == "--preview-dump") {
+            if(i + 1 < argc) config.previewDump = argv[++i];
+            else throw std::invalid_argument("Missing argument for --preview-dump.");
+        }
+        else if(arg == "--aov") {
+            if(i + 1 < argc) config.aovs = argv[++i];
+            else throw std::invalid_argument("Missing argument for --aov.");
+            parseAOVList(config.aovs);
+        }
+        else if(arg == "--denoise") {
+            if(i + 1 < argc) config.denoise = argv[++i];
+            else throw std::invalid_argument("Missing argument for --denoise.");
+            parseDenoiseQuality(config.denoise);
+        }
+
+        else if(arg == "--hugepages") config.hugepages = true;
+
+        else if(arg == "--set-affinity") config.setAffinity = true;
+
+        else if(arg == "--device-config") {
+            if(i + 1 < argc) config.deviceConfig = argv[++i];
+            else throw std::invalid_argument("Missing argument for --device-config.");
+        }
+
+        else if(arg == "--texture-cache") {
+            if(i + 1 < argc) config.textureCacheDir = argv[++i];
+            else throw std::invalid_argument("Missing argument for --texture-cache.");
+        }
+
         else if(arg == "-v" || arg == "--version") {
             config.showVersion = true;
             std::cout << "caitlyn version 0.1.3" << std::endl;
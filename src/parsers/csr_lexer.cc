@@ -0,0 +1,92 @@
+#include "csr_lexer.hh"
+
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+
+CSRLexer::CSRLexer(const char* data, size_t size) : cursor{data}, end{data + size} {}
+
+static bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+bool CSRLexer::next(CSRLine& line) {
+    while (cursor < end) {
+        const char* newline = static_cast<const char*>(std::memchr(cursor, '\n', end - cursor));
+        const char* line_end = newline ? newline : end;
+        const char* comment = static_cast<const char*>(std::memchr(cursor, '#', line_end - cursor));
+        const char* content_end = comment ? comment : line_end;
+        const char* p = cursor;
+
+        cursor = newline ? newline + 1 : end;
+        ++line_number;
+
+        line.argc = -1; // the first token is the key, not an argument
+        while (p < content_end) {
+            while (p < content_end && isSpace(*p)) ++p;
+            if (p == content_end) break;
+            const char* token_start = p;
+            while (p < content_end && !isSpace(*p)) ++p;
+            std::string_view token(token_start, p - token_start);
+
+            if (line.argc == -1) line.key = token;
+            else if (line.argc < CSR_MAX_ARGS) line.args[line.argc] = token;
+            else throw std::runtime_error(csrError(line_number, "too many values on one line"));
+            ++line.argc;
+        }
+
+        if (line.argc >= 0) {
+            line.number = line_number;
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t CSRIdTable::define(std::string_view id) {
+    uint32_t handle = next_handle++;
+    handles[id] = handle;
+    return handle;
+}
+
+uint32_t CSRIdTable::lookup(std::string_view id, const char* kind, int line_number) const {
+    auto found = handles.find(id);
+    if (found == handles.end()) throw std::runtime_error(csrError(line_number, std::string("undefined ") + kind + " id '" + std::string(id) + "'"));
+    return found->second;
+}
+
+float parseFloat(std::string_view token, int line_number) {
+    float value;
+    const char* first = token.data();
+    const char* last = token.data() + token.size();
+    if (first != last && *first == '+') ++first; // from_chars does not accept a leading '+'
+    auto result = std::from_chars(first, last, value);
+    if (result.ec != std::errc() || result.ptr != last) {
+        throw std::runtime_error(csrError(line_number, "expected a number, got '" + std::string(token) + "'"));
+    }
+    return value;
+}
+
+size_t parseIndex(std::string_view token, int line_number) {
+    size_t value;
+    const char* last = token.data() + token.size();
+    auto result = std::from_chars(token.data(), last, value);
+    if (result.ec != std::errc() || result.ptr != last) {
+        throw std::runtime_error(csrError(line_number, "expected a non-negative integer, got '" + std::string(token) + "'"));
+    }
+    return value;
+}
+
+bool parseBool(std::string_view token, int line_number) {
+    if (token == "true") return true;
+    if (token == "false") return false;
+    throw std::runtime_error(csrError(line_number, "expected true or false, got '" + std::string(token) + "'"));
+}
+
+double parseRatio(std::string_view token, int line_number) {
+    auto slash = token.find('/');
+    if (slash == std::string_view::npos) return parseFloat(token, line_number);
+    return static_cast<double>(parseFloat(token.substr(0, slash), line_number)) / parseFloat(token.substr(slash + 1), line_number);
+}
+
+std::string csrError(int line_number, const std::string& message) {
+    return "CSR line " + std::to_string(line_number) + ": " + message;
+}
@@ -1,237 +1,562 @@
 #include "csr_parser.hh"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include "render.h"
+#include "thread_pool.hh"
 
 std::shared_ptr<Scene> CSRParser::parseCSR(std::string& filePath, RTCDevice device)  {
+    try {
+        if (filePath.size() > 5 && filePath.compare(filePath.size() - 5, 5, ".csrb") == 0) {
+            return parseCSRB(filePath, device);
+        }
 
-    isCSR(filePath);
+        isCSR(filePath);
 
-    file = std::ifstream(filePath);
-    std::string line;
-    std::map<std::string, std::shared_ptr<material>> materials;
-    std::map<std::string, std::shared_ptr<texture>> textures;
-    std::map<std::string, std::shared_ptr<Primitive>> primitives;
-    
-    if (!file.is_open() || !file.good()) {
+        MappedFile text(filePath);
+        auto image = compileText(text.data(), text.size());
+        return buildScene(image->data(), image->size(), image, filePath, device);
+    } catch (...) {
         rtcReleaseDevice(device);
-        throw std::runtime_error("Could not open file: " + filePath);
+        throw;
     }
+}
+
+std::shared_ptr<Scene> CSRParser::parseCSRB(const std::string& filePath, RTCDevice device) {
+    auto mapping = std::make_shared<MappedFile>(filePath);
+    return buildScene(mapping->data(), mapping->size(), mapping, filePath, device);
+}
+
+void CSRParser::compileCSR(const std::string& csrPath, const std::string& csrbPath) {
+
+    isCSR(csrPath);
+
+    MappedFile text(csrPath);
+    auto image = compileText(text.data(), text.size());
+
+    std::ofstream out(csrbPath, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) throw std::runtime_error("Could not open file: " + csrbPath);
+    out.write(image->data(), image->size());
+    if (!out.good()) throw std::runtime_error("Could not write file: " + csrbPath);
+}
+
+std::shared_ptr<std::vector<char>> CSRParser::compileText(const char* data, size_t size) {
+    CSRLexer lexer(data, size);
+    CSRLine line;
 
     // Read in version
-    getNextLine(file, line);
-    if (trim(line) != "version 0.1.5") {
-        rtcReleaseDevice(device);
+    if (!lexer.next(line) || line.key != "version" || line.argc != 1 || line.args[0] != "0.1.5") {
         throw std::runtime_error("Unsupported version or missing version marker");
     }
 
-    Camera cam = readCamera();
-    auto scene_ptr = make_shared<Scene>(device, cam);
+    CSRBHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, CSRB_MAGIC, 4);
+    header.version = CSRB_VERSION;
+    header.section_count = CSRB_SECTION_COUNT;
+    header.build_quality = CSRB_BUILD_DEFAULT;
+    header.build_flags = CSRB_BUILD_DEFAULT;
+    header.environment = CSRB_NO_ENVIRONMENT;
+    header.environment_intensity = 1;
+    header.camera = readCamera(lexer);
+
+    std::string strings;
+    std::vector<CSRBTexture> textures;
+    std::vector<CSRBMaterial> materials;
+    std::vector<float> sphere_vertices;
+    std::vector<uint32_t> sphere_materials;
+    std::vector<Vertex3f> quad_vertices;
+    std::vector<uint32_t> quad_materials;
+    std::vector<CSRBInstance> instances;
+    std::vector<CSRBMesh> meshes;
+    std::vector<uint32_t> mesh_materials;
+    std::vector<CSRBKeyframe> keyframes;
+
+    // Handles from these tables are the record indices in the matching sections.
+    CSRIdTable texture_ids, material_ids, sphere_ids, quad_ids;
 
-    while (getNextLine(file, line)) {
-        line = trim(line);
-        if (startsWith(line, "Material")) {
-            // Extract material ID from brackets (e.g., Material[Lambertian] -> Lambertian)
-            auto idStart = line.find('[') + 1;
-            auto idEnd = line.find(']');
-            std::string materialType = line.substr(idStart, idEnd - idStart);
+    while (lexer.next(line)) {
+        if (startsWith(line.key, "Material")) {
+            std::string_view materialType = blockType(line.key);
+            CSRBMaterial m;
+            std::memset(&m, 0, sizeof(m));
+            m.texture = CSRB_NO_TEXTURE;
+            std::string_view materialId = readStringProperty(lexer, "id");
             if (materialType == "Lambertian") {
-                std::string materialId, texture;
-                getNextLine(file, materialId); getNextLine(file, texture);
-                std::string texture_id = readStringProperty(texture);
-                if (texture_id == "no") {
-                    std::string albedo;
-                    getNextLine(file, albedo);
-                    materials[readStringProperty(materialId)] = std::make_shared<lambertian>(readXYZProperty(albedo));  
+                CSRLine texture = expectLine(lexer, "texture", 1);
+                m.type = CSRB_MATERIAL_LAMBERTIAN;
+                if (texture.args[0] == "no") {
+                    point3 a = readXYZProperty(lexer, "albedo");
+                    m.albedo[0] = a.x(); m.albedo[1] = a.y(); m.albedo[2] = a.z();
                 } else {
-                    std::shared_ptr<PixelImageTexture> plamb = std::dynamic_pointer_cast<PixelImageTexture>(textures[texture_id]);
-                    if (plamb) { // texture is a pixel lambert
-                        materials[readStringProperty(materialId)] = std::make_shared<pixel_lambertian>(plamb);
-                    } else { // texture is a normal lambert
-                        materials[readStringProperty(materialId)] = std::make_shared<lambertian>(textures[texture_id]);
-                    }
+                    m.texture = texture_ids.lookup(texture.args[0], "texture", texture.number);
                 }
             } else if (materialType == "Metal") {
-                std::string materialId, albedo, fuzz;
-                getNextLine(file, materialId); getNextLine(file, albedo); getNextLine(file, fuzz);
-                materials[readStringProperty(materialId)] = std::make_shared<metal>(readXYZProperty(albedo), readDoubleProperty(fuzz));
+                m.type = CSRB_MATERIAL_METAL;
+                point3 a = readXYZProperty(lexer, "albedo");
+                m.albedo[0] = a.x(); m.albedo[1] = a.y(); m.albedo[2] = a.z();
+                m.param = readDoubleProperty(lexer, "fuzz");
             } else if (materialType == "Dielectric") {
-                std::string materialId, ir;
-                getNextLine(file, materialId); getNextLine(file, ir);
-                materials[readStringProperty(materialId)] = std::make_shared<dielectric>(readDoubleProperty(ir));
+                m.type = CSRB_MATERIAL_DIELECTRIC;
+                m.param = readDoubleProperty(lexer, "ir");
             } else if (materialType == "Emissive") {
-                std::string materialId, rgb, strength;
-                getNextLine(file, materialId); getNextLine(file, rgb); getNextLine(file, strength);
-                materials[readStringProperty(materialId)] = std::make_shared<emissive>( (readDoubleProperty(strength) * readXYZProperty(rgb)) );
+                m.type = CSRB_MATERIAL_EMISSIVE;
+                point3 rgb = readXYZProperty(lexer, "rgb");
+                point3 e = readDoubleProperty(lexer, "strength") * rgb;
+                m.albedo[0] = e.x(); m.albedo[1] = e.y(); m.albedo[2] = e.z();
             } else {
-                rtcReleaseDevice(device);
-                throw std::runtime_error("Material type UNDEFINED: Material[Lambertian|Metal|Dielectric|Emissive]");
+                throw std::runtime_error(csrError(line.number, "Material type UNDEFINED: Material[Lambertian|Metal|Dielectric|Emissive]"));
             }
-        } else if (startsWith(line, "Texture")) {
-            auto idStart = line.find('[') + 1;
-            auto idEnd = line.find(']');
-            std::string textureType = line.substr(idStart, idEnd - idStart);
+            material_ids.define(materialId);
+            materials.push_back(m);
+        } else if (startsWith(line.key, "Texture")) {
+            std::string_view textureType = blockType(line.key);
+            CSRBTexture t;
+            std::memset(&t, 0, sizeof(t));
+            std::string_view textureId = readStringProperty(lexer, "id");
             if (textureType == "Checker") {
-                std::string textureId, scale, c1, c2;
-                getNextLine(file, textureId); getNextLine(file, scale); getNextLine(file, c1); getNextLine(file, c2);
-                textures[readStringProperty(textureId)] = std::make_shared<checker_texture>(readDoubleProperty(scale), readXYZProperty(c1), readXYZProperty(c2));
+                t.type = CSRB_TEXTURE_CHECKER;
+                t.scale = readDoubleProperty(lexer, "scale");
+                point3 a = readXYZProperty(lexer, "c1");
+                point3 b = readXYZProperty(lexer, "c2");
+                for (int i = 0; i < 3; ++i) { t.c1[i] = a[i]; t.c2[i] = b[i]; }
             } else if (textureType == "Image") {
-                std::string textureId, transparency, path;
-                getNextLine(file, textureId); getNextLine(file, transparency); getNextLine(file, path);
-                if (readBooleanProperty(transparency)) textures[readStringProperty(textureId)] = std::make_shared<PixelImageTexture>(readStringProperty(path).c_str());
-                else textures[readStringProperty(textureId)] = std::make_shared<image_texture>(readStringProperty(path).c_str());
+                t.type = CSRB_TEXTURE_IMAGE;
+                t.transparency = readBooleanProperty(lexer, "transparency");
+                t.path = strings.size();
+                strings += readStringProperty(lexer, "path");
+                strings.push_back('\0');
             } else if (textureType == "Noise") {
-                std::string textureId, scale;
-                getNextLine(file, textureId); getNextLine(file, scale);
-                textures[readStringProperty(textureId)] = std::make_shared<noise_texture>(readDoubleProperty(scale));
+                t.type = CSRB_TEXTURE_NOISE;
+                t.scale = readDoubleProperty(lexer, "scale");
             } else {
-                rtcReleaseDevice(device);
-                throw std::runtime_error("Texture type UNDEFINED: Texture[Checker|Image|Noise]");
+                throw std::runtime_error(csrError(line.number, "Texture type UNDEFINED: Texture[Checker|Image|Noise]"));
             }
-        } else if (startsWith(line, "Sphere")) {
-            std::string id, position, material, radius;
-            getNextLine(file, id); getNextLine(file, position); getNextLine(file, material); getNextLine(file, radius);
-            auto sphere = make_shared<SpherePrimitive>(readXYZProperty(position), materials[readStringProperty(material)], readDoubleProperty(radius), device);
-            primitives[readStringProperty(id)] = sphere;
-            scene_ptr->add_primitive(sphere);
-        } else if (startsWith(line, "Quad")) {
-            std::string id, position, u, v, material;
-            getNextLine(file, id); getNextLine(file, position); getNextLine(file, u); getNextLine(file, v); getNextLine(file, material);
-            auto quad = make_shared<QuadPrimitive>(readXYZProperty(position), readXYZProperty(u), readXYZProperty(v), materials[readStringProperty(material)], device);
-            primitives[readStringProperty(id)] = quad;
-            scene_ptr->add_primitive(quad);
-        } else if (startsWith(line, "Instance")) {
-            auto idStart = line.find('[') + 1;
-            auto idEnd = line.find(']');
-            std::string instanceType = line.substr(idStart, idEnd - idStart);
+            texture_ids.define(textureId);
+            textures.push_back(t);
+        } else if (line.key == "Sphere") {
+            std::string_view id = readStringProperty(lexer, "id");
+            point3 p = readXYZProperty(lexer, "position");
+            CSRLine material = expectLine(lexer, "material", 1);
+            float radius = readDoubleProperty(lexer, "radius");
+            sphere_ids.define(id);
+            sphere_vertices.insert(sphere_vertices.end(), { p.x(), p.y(), p.z(), radius });
+            sphere_materials.push_back(material_ids.lookup(material.args[0], "material", material.number));
+        } else if (line.key == "Quad") {
+            std::string_view id = readStringProperty(lexer, "id");
+            point3 p = readXYZProperty(lexer, "position");
+            vec3 u = readXYZProperty(lexer, "u");
+            vec3 v = readXYZProperty(lexer, "v");
+            CSRLine material = expectLine(lexer, "material", 1);
+            const point3 corners[] = { p, p + u, p + u + v, p + v }; // same winding as QuadPrimitive
+            quad_ids.define(id);
+            for (const point3& corner : corners) quad_vertices.push_back(Vertex3f{ corner.x(), corner.y(), corner.z() });
+            quad_materials.push_back(material_ids.lookup(material.args[0], "material", material.number));
+        } else if (startsWith(line.key, "Instance")) {
+            std::string_view instanceType = blockType(line.key);
+            CSRLine prim_id = expectLine(lexer, "prim_id", 1);
+            vec3 t = readXYZProperty(lexer, "translate");
+            CSRBInstance inst;
             if (instanceType == "SpherePrimitive") {
-                std::string prim_id, translate;
-                getNextLine(file, prim_id); getNextLine(file, translate);
-                vec3 translateVector = readXYZProperty(translate);
-                float transform[12] = {
-                    1, 0, 0, translateVector.x(),
-                    0, 1, 0, translateVector.y(),
-                    0, 0, 1, translateVector.z()
-                };
-                std::shared_ptr<SpherePrimitive> instance_ptr = std::dynamic_pointer_cast<SpherePrimitive>(primitives[readStringProperty(prim_id)]);
-                if (!instance_ptr) {
-                    rtcReleaseDevice(device);
-                    throw std::runtime_error("Instance key ERROR: " + readStringProperty(prim_id) + " is not a SpherePrimitive!");
-                }
-                auto instance = make_shared<SpherePrimitiveInstance>(instance_ptr, transform, device);
-                scene_ptr->add_primitive_instance(instance, device);
+                inst.type = CSRB_INSTANCE_SPHERE;
+                inst.prim = sphere_ids.lookup(prim_id.args[0], "SpherePrimitive", prim_id.number);
             } else if (instanceType == "QuadPrimitive") {
-                std::string prim_id, translate;
-                getNextLine(file, prim_id); getNextLine(file, translate);
-                vec3 translateVector = readXYZProperty(translate);
-                float transform[12] = {
-                    1, 0, 0, translateVector.x(),
-                    0, 1, 0, translateVector.y(),
-                    0, 0, 1, translateVector.z()
-                };
-                std::shared_ptr<QuadPrimitive> instance_ptr = std::dynamic_pointer_cast<QuadPrimitive>(primitives[readStringProperty(prim_id)]);
-                if (!instance_ptr) {
-                    rtcReleaseDevice(device);
-                    throw std::runtime_error("Instance key ERROR: " + readStringProperty(prim_id) + " is not a QuadPrimitive!");
+                inst.type = CSRB_INSTANCE_QUAD;
+                inst.prim = quad_ids.lookup(prim_id.args[0], "QuadPrimitive", prim_id.number);
+            } else {
+                throw std::runtime_error(csrError(line.number, "Instance type UNDEFINED: Instance[SpherePrimitive|QuadPrimitive]"));
+            }
+            inst.translate[0] = t.x(); inst.translate[1] = t.y(); inst.translate[2] = t.z();
+            instances.push_back(inst);
+        } else if (line.key == "Mesh") {
+            readStringProperty(lexer, "id");
+            std::string_view path = readStringProperty(lexer, "path");
+            CSRLine material_line = expectLine(lexer, "materials", 1);
+            CSRBMesh mesh;
+            mesh.path = strings.size();
+            strings += path;
+            strings.push_back('\0');
+            mesh.first_material = mesh_materials.size();
+            mesh.material_count = material_line.argc;
+            mesh.material_names = strings.size();
+            for (int i = 0; i < material_line.argc; ++i) {
+                mesh_materials.push_back(material_ids.lookup(material_line.args[i], "material", material_line.number));
+                if (i > 0) strings.push_back(' ');
+                strings += material_line.args[i];
+            }
+            strings.push_back('\0');
+            meshes.push_back(mesh);
+        } else if (line.key == "Build") {
+            CSRLine quality = expectLine(lexer, "quality", 1);
+            CSRLine flags = expectLine(lexer, "flags", 1);
+            std::string flag_list;
+            for (int i = 0; i < flags.argc; ++i) flag_list += std::string(flags.args[i]) + " ";
+            try {
+                header.build_quality = parseBuildQuality(std::string(quality.args[0]));
+                header.build_flags = parseSceneFlags(flag_list);
+            } catch (const std::invalid_argument& e) {
+                throw std::runtime_error(csrError(line.number, e.what()));
+            }
+        } else if (startsWith(line.key, "Environment")) {
+            std::string_view environmentType = blockType(line.key);
+            if (environmentType == "Image") {
+                header.environment = strings.size();
+                strings += readStringProperty(lexer, "path");
+                strings.push_back('\0');
+                header.environment_intensity = readDoubleProperty(lexer, "intensity");
+            } else if (environmentType == "Gradient") {
+                header.environment = CSRB_NO_ENVIRONMENT;
+            } else {
+                throw std::runtime_error(csrError(line.number, "Environment type UNDEFINED: Environment[Image|Gradient]"));
+            }
+        } else if (startsWith(line.key, "Keyframe")) {
+            std::string_view keyframeType = blockType(line.key);
+            CSRBKeyframe k;
+            std::memset(&k, 0, sizeof(k));
+            k.frame = readDoubleProperty(lexer, "frame");
+            vec3 p;
+            if (keyframeType == "Camera") {
+                k.type = CSRB_KEYFRAME_CAMERA;
+                point3 lookfrom = readXYZProperty(lexer, "lookfrom");
+                point3 lookat = readXYZProperty(lexer, "lookat");
+                vec3 vup = readXYZProperty(lexer, "vup");
+                for (int i = 0; i < 3; ++i) {
+                    k.camera.lookfrom[i] = lookfrom[i];
+                    k.camera.lookat[i] = lookat[i];
+                    k.camera.vup[i] = vup[i];
                 }
-                auto instance = make_shared<QuadPrimitiveInstance>(instance_ptr, transform, device);
-                scene_ptr->add_primitive_instance(instance, device);
+                k.camera.vfov = readDoubleProperty(lexer, "vfov");
+                k.camera.aperture = readDoubleProperty(lexer, "aperture");
+                k.camera.focus_dist = readDoubleProperty(lexer, "focus_dist");
+            } else if (keyframeType == "Sphere") {
+                CSRLine id = expectLine(lexer, "id", 1);
+                k.type = CSRB_KEYFRAME_SPHERE;
+                k.target = sphere_ids.lookup(id.args[0], "Sphere", id.number);
+                p = readXYZProperty(lexer, "position");
+            } else if (keyframeType == "Instance") {
+                CSRLine index = expectLine(lexer, "instance", 1);
+                k.type = CSRB_KEYFRAME_INSTANCE;
+                size_t target = parseIndex(index.args[0], index.number);
+                if (target >= instances.size()) throw std::runtime_error(csrError(index.number, "instance index out of range (instances are numbered from 0 in file order)"));
+                k.target = static_cast<uint32_t>(target);
+                p = readXYZProperty(lexer, "translate");
             } else {
-                rtcReleaseDevice(device);
-                throw std::runtime_error("Instance type UNDEFINED: Instance[SpherePrimitive|QuadPrimitive]");
+                throw std::runtime_error(csrError(line.number, "Keyframe type UNDEFINED: Keyframe[Camera|Sphere|Instance]"));
             }
+            k.position[0] = p.x(); k.position[1] = p.y(); k.position[2] = p.z();
+            keyframes.push_back(k);
         }
     }
 
-    return scene_ptr;
-}
+    const Quad quad_index = { 0, 1, 2, 3 };
 
-bool CSRParser::getNextLine(std::ifstream& file, std::string& holder) {
-    if (!getline(file, holder)) {return false;};
-    while (startsWith(holder, "#")) { // if line still is a comment
-        if (!getline(file, holder)) {return false;};
+    // Lay the sections out back to back, each aligned, after the header.
+    struct Blob { const void* data; size_t record_size; size_t count; };
+    const Blob blobs[CSRB_SECTION_COUNT] = {
+        { strings.data(), 1, strings.size() },
+        { textures.data(), sizeof(CSRBTexture), textures.size() },
+        { materials.data(), sizeof(CSRBMaterial), materials.size() },
+        { sphere_vertices.data(), 4*sizeof(float), sphere_vertices.size() / 4 },
+        { sphere_materials.data(), sizeof(uint32_t), sphere_materials.size() },
+        { quad_vertices.data(), 4*sizeof(Vertex3f), quad_vertices.size() / 4 },
+        { quad_materials.data(), sizeof(uint32_t), quad_materials.size() },
+        { &quad_index, sizeof(Quad), quad_vertices.empty() ? 0u : 1u },
+        { instances.data(), sizeof(CSRBInstance), instances.size() },
+        { meshes.data(), sizeof(CSRBMesh), meshes.size() },
+        { mesh_materials.data(), sizeof(uint32_t), mesh_materials.size() },
+        { keyframes.data(), sizeof(CSRBKeyframe), keyframes.size() },
+    };
+    auto align = [](uint64_t offset) { return (offset + CSRB_ALIGNMENT - 1) / CSRB_ALIGNMENT * CSRB_ALIGNMENT; };
+    uint64_t offset = align(sizeof(CSRBHeader));
+    for (uint32_t i = 0; i < CSRB_SECTION_COUNT; ++i) {
+        header.sections[i].offset = offset;
+        header.sections[i].count = blobs[i].count;
+        offset = align(offset + blobs[i].record_size * blobs[i].count);
     }
-    std::vector<std::string> tokens = split(holder, '#');
-    holder = trim(tokens[0]);
-    return true;
+
+    // Embree may read a full 16 bytes at the last float3 vertex, so always end on padding.
+    auto image = std::make_shared<std::vector<char>>(offset + CSRB_ALIGNMENT, 0);
+    std::memcpy(image->data(), &header, sizeof(header));
+    for (uint32_t i = 0; i < CSRB_SECTION_COUNT; ++i) {
+        if (blobs[i].count > 0) std::memcpy(image->data() + header.sections[i].offset, blobs[i].data, blobs[i].record_size * blobs[i].count);
+    }
+    return image;
 }
 
-std::vector<std::string> CSRParser::split(const std::string &s, char delimiter) {
-    std::vector<std::string> tokens;
+std::shared_ptr<Scene> CSRParser::buildScene(const char* base, size_t size, std::shared_ptr<const void> keepalive,
+                                             const std::string& name, RTCDevice device) {
+    if (size < sizeof(CSRBHeader)) throw std::runtime_error("Not a CSRB file: " + name);
+    const CSRBHeader* header = reinterpret_cast<const CSRBHeader*>(base);
+    if (std::memcmp(header->magic, CSRB_MAGIC, 4) != 0) throw std::runtime_error("Not a CSRB file: " + name);
+    if (header->version != CSRB_VERSION || header->section_count != CSRB_SECTION_COUNT) {
+        throw std::runtime_error("Unsupported CSRB version in " + name + ", recompile it with --compile");
+    }
 
-    if (s.empty()) {
-        // Return a vector with a single, empty string
-        tokens.push_back("");
-        return tokens;
+    // Bounds-check every section once, so the loops below can index freely.
+    auto section = [&](CSRBSectionId id, size_t record_size) {
+        const CSRBSection& sec = header->sections[id];
+        if (sec.offset % CSRB_ALIGNMENT != 0 || sec.offset > size || sec.count > (size - sec.offset) / record_size) {
+            throw std::runtime_error("Corrupt CSRB section in " + name);
+        }
+        return base + sec.offset;
+    };
+    auto count = [&](CSRBSectionId id) { return header->sections[id].count; };
+
+    const char* strings = section(CSRB_SECTION_STRINGS, 1);
+    const char* strings_end = strings + count(CSRB_SECTION_STRINGS);
+    auto string_at = [&](uint32_t offset) {
+        if (offset >= count(CSRB_SECTION_STRINGS)) throw std::runtime_error("Corrupt CSRB string in " + name);
+        // The terminator must lie inside the section, or a corrupt file would be read past its end.
+        const char* terminator = static_cast<const char*>(std::memchr(strings + offset, '\0', strings_end - (strings + offset)));
+        if (!terminator) throw std::runtime_error("Corrupt CSRB string in " + name);
+        return std::string(strings + offset, terminator);
+    };
+    const CSRBTexture* tex_records = reinterpret_cast<const CSRBTexture*>(section(CSRB_SECTION_TEXTURES, sizeof(CSRBTexture)));
+    const CSRBMaterial* mat_records = reinterpret_cast<const CSRBMaterial*>(section(CSRB_SECTION_MATERIALS, sizeof(CSRBMaterial)));
+    const float* sphere_vertices = reinterpret_cast<const float*>(section(CSRB_SECTION_SPHERE_VERTICES, 4*sizeof(float)));
+    const uint32_t* sphere_materials = reinterpret_cast<const uint32_t*>(section(CSRB_SECTION_SPHERE_MATERIALS, sizeof(uint32_t)));
+    const Vertex3f* quad_vertices = reinterpret_cast<const Vertex3f*>(section(CSRB_SECTION_QUAD_VERTICES, 4*sizeof(Vertex3f)));
+    const uint32_t* quad_materials = reinterpret_cast<const uint32_t*>(section(CSRB_SECTION_QUAD_MATERIALS, sizeof(uint32_t)));
+    const Quad* quad_index = reinterpret_cast<const Quad*>(section(CSRB_SECTION_QUAD_INDEX, sizeof(Quad)));
+    const CSRBInstance* instances = reinterpret_cast<const CSRBInstance*>(section(CSRB_SECTION_INSTANCES, sizeof(CSRBInstance)));
+    const CSRBMesh* meshes = reinterpret_cast<const CSRBMesh*>(section(CSRB_SECTION_MESHES, sizeof(CSRBMesh)));
+    const uint32_t* mesh_materials = reinterpret_cast<const uint32_t*>(section(CSRB_SECTION_MESH_MATERIALS, sizeof(uint32_t)));
+    const CSRBKeyframe* keyframes = reinterpret_cast<const CSRBKeyframe*>(section(CSRB_SECTION_KEYFRAMES, sizeof(CSRBKeyframe)));
+
+    if (count(CSRB_SECTION_SPHERE_MATERIALS) != count(CSRB_SECTION_SPHERE_VERTICES)
+        || count(CSRB_SECTION_QUAD_MATERIALS) != count(CSRB_SECTION_QUAD_VERTICES)
+        || (count(CSRB_SECTION_QUAD_VERTICES) > 0 && count(CSRB_SECTION_QUAD_INDEX) != 1)) {
+        throw std::runtime_error("Corrupt CSRB section counts in " + name);
     }
-    std::istringstream tokenStream(s);
-    std::string token;
-    while (std::getline(tokenStream, token, delimiter)) {
-        tokens.push_back(token);
+
+    const CSRBCamera& c = header->camera;
+    Camera cam(point3(c.lookfrom[0], c.lookfrom[1], c.lookfrom[2]), point3(c.lookat[0], c.lookat[1], c.lookat[2]),
+               vec3(c.vup[0], c.vup[1], c.vup[2]), c.vfov, c.aspect_ratio, c.aperture, c.focus_dist);
+    auto scene_ptr = make_shared<Scene>(device, cam);
+    scene_ptr->shared_buffers.push_back(keepalive);
+
+    BuildSettings build;
+    if (header->build_quality != CSRB_BUILD_DEFAULT) build.quality = static_cast<RTCBuildQuality>(header->build_quality);
+    if (header->build_flags != CSRB_BUILD_DEFAULT) build.flags = static_cast<RTCSceneFlags>(header->build_flags);
+    if (build.quality > RTC_BUILD_QUALITY_HIGH || build.flags > (RTC_SCENE_FLAG_DYNAMIC | RTC_SCENE_FLAG_COMPACT | RTC_SCENE_FLAG_ROBUST)) {
+        throw std::runtime_error("Corrupt CSRB build settings in " + name);
     }
+    scene_ptr->setBuildSettings(build);
 
-    if (tokens.empty()) {
-        tokens.push_back(s);
+    if (header->environment != CSRB_NO_ENVIRONMENT) {
+        // Decoded and tabulated on the shared pool like image textures; commitScene() waits for it.
+        std::string path = string_at(header->environment);
+        scene_ptr->asset_paths.push_back(path);
+        auto environment = std::make_shared<ImageEnvironment>(header->environment_intensity);
+        scene_ptr->pending_loads.push_back(ThreadPool::shared().submit([environment, path]() { environment->load(path); }));
+        scene_ptr->environment = environment;
     }
-    return tokens;
-}
 
-std::string CSRParser::trim(const std::string& str) {
-    // Include '\r' and '\n' in the character set for trimming
-    size_t first = str.find_first_not_of(" \r\n");
-    if (std::string::npos == first) {
-        // Return an empty string if only whitespace characters are found
-        return "";
+    std::vector<std::shared_ptr<texture>> textures;
+    for (uint64_t i = 0; i < count(CSRB_SECTION_TEXTURES); ++i) {
+        const CSRBTexture& t = tex_records[i];
+        if (t.type == CSRB_TEXTURE_CHECKER) {
+            textures.push_back(std::make_shared<checker_texture>(t.scale, color(t.c1[0], t.c1[1], t.c1[2]), color(t.c2[0], t.c2[1], t.c2[2])));
+        } else if (t.type == CSRB_TEXTURE_IMAGE) {
+            // Decode on the shared pool while the materials and geometry below are built.
+            // The task holds its own reference, so it is safe even if building fails.
+            std::string path = string_at(t.path);
+            scene_ptr->asset_paths.push_back(path);
+            if (t.transparency) {
+                auto tex = std::make_shared<PixelImageTexture>();
+                scene_ptr->pending_loads.push_back(ThreadPool::shared().submit([tex, path]() { tex->load(path.c_str()); }));
+                textures.push_back(tex);
+            } else {
+                auto tex = std::make_shared<image_texture>();
+                scene_ptr->pending_loads.push_back(ThreadPool::shared().submit([tex, path]() { tex->load(path.c_str()); }));
+                textures.push_back(tex);
+            }
+        } else if (t.type == CSRB_TEXTURE_NOISE) {
+            textures.push_back(std::make_shared<noise_texture>(t.scale));
+        } else {
+            throw std::runtime_error("Corrupt CSRB texture type in " + name);
+        }
     }
-    size_t last = str.find_last_not_of(" \r\n");
-    return str.substr(first, (last - first + 1));
-}
 
-bool CSRParser::startsWith(const std::string& str, const std::string& prefix) {
-    return str.size() >= prefix.size() &&
-        str.compare(0, prefix.size(), prefix) == 0;
+    std::vector<std::shared_ptr<material>> materials;
+    for (uint64_t i = 0; i < count(CSRB_SECTION_MATERIALS); ++i) {
+        const CSRBMaterial& m = mat_records[i];
+        color albedo(m.albedo[0], m.albedo[1], m.albedo[2]);
+        if (m.type == CSRB_MATERIAL_LAMBERTIAN) {
+            if (m.texture == CSRB_NO_TEXTURE) {
+                materials.push_back(std::make_shared<lambertian>(albedo));
+            } else {
+                if (m.texture >= textures.size()) throw std::runtime_error("Corrupt CSRB texture index in " + name);
+                std::shared_ptr<PixelImageTexture> plamb = std::dynamic_pointer_cast<PixelImageTexture>(textures[m.texture]);
+                if (plamb) materials.push_back(std::make_shared<pixel_lambertian>(plamb)); // texture is a pixel lambert
+                else materials.push_back(std::make_shared<lambertian>(textures[m.texture])); // texture is a normal lambert
+            }
+        } else if (m.type == CSRB_MATERIAL_METAL) {
+            materials.push_back(std::make_shared<metal>(albedo, m.param));
+        } else if (m.type == CSRB_MATERIAL_DIELECTRIC) {
+            materials.push_back(std::make_shared<dielectric>(m.param));
+        } else if (m.type == CSRB_MATERIAL_EMISSIVE) {
+            materials.push_back(std::make_shared<emissive>(albedo));
+        } else {
+            throw std::runtime_error("Corrupt CSRB material type in " + name);
+        }
+    }
+    auto material_at = [&](uint32_t index) {
+        if (index >= materials.size()) throw std::runtime_error("Corrupt CSRB material index in " + name);
+        return materials[index];
+    };
+
+    for (uint64_t i = 0; i < count(CSRB_SECTION_KEYFRAMES); ++i) {
+        const CSRBKeyframe& k = keyframes[i];
+        vec3 p(k.position[0], k.position[1], k.position[2]);
+        if (k.type == CSRB_KEYFRAME_CAMERA) {
+            const CSRBCamera& kc = k.camera;
+            scene_ptr->camera_keys.push_back(CameraKeyframe{ k.frame, point3(kc.lookfrom[0], kc.lookfrom[1], kc.lookfrom[2]),
+                point3(kc.lookat[0], kc.lookat[1], kc.lookat[2]), vec3(kc.vup[0], kc.vup[1], kc.vup[2]), kc.vfov, kc.aperture, kc.focus_dist });
+        } else if (k.type == CSRB_KEYFRAME_SPHERE && k.target < count(CSRB_SECTION_SPHERE_VERTICES)) {
+            scene_ptr->sphere_keys[k.target].push_back(PositionKeyframe{ k.frame, p });
+        } else if (k.type == CSRB_KEYFRAME_INSTANCE && k.target < count(CSRB_SECTION_INSTANCES)) {
+            scene_ptr->instance_keys[k.target].push_back(PositionKeyframe{ k.frame, p });
+        } else {
+            throw std::runtime_error("Corrupt CSRB keyframe in " + name);
+        }
+    }
+    auto by_frame = [](const auto& a, const auto& b) { return a.frame < b.frame; };
+    std::stable_sort(scene_ptr->camera_keys.begin(), scene_ptr->camera_keys.end(), by_frame);
+    for (auto& track : scene_ptr->sphere_keys) std::stable_sort(track.second.begin(), track.second.end(), by_frame);
+    for (auto& track : scene_ptr->instance_keys) std::stable_sort(track.second.begin(), track.second.end(), by_frame);
+
+    std::vector<std::shared_ptr<SpherePrimitive>> spheres;
+    for (uint64_t i = 0; i < count(CSRB_SECTION_SPHERE_VERTICES); ++i) {
+        std::shared_ptr<SpherePrimitive> sphere;
+        const float* v = sphere_vertices + 4*i;
+        if (scene_ptr->sphere_keys.count(i)) {
+            // Keyframed spheres are rewritten between frames, so they get a buffer of their own.
+            sphere = make_shared<SpherePrimitive>(vec3(v[0], v[1], v[2]), material_at(sphere_materials[i]), v[3], device);
+            scene_ptr->animated_spheres[i] = sphere;
+        } else {
+            sphere = make_shared<SpherePrimitive>(v, material_at(sphere_materials[i]), device);
+        }
+        spheres.push_back(sphere);
+        scene_ptr->add_primitive(sphere);
+    }
+
+    std::vector<std::shared_ptr<QuadPrimitive>> quads;
+    for (uint64_t i = 0; i < count(CSRB_SECTION_QUAD_VERTICES); ++i) {
+        auto quad = make_shared<QuadPrimitive>(quad_vertices + 4*i, quad_index, material_at(quad_materials[i]), device);
+        quads.push_back(quad);
+        scene_ptr->add_primitive(quad);
+    }
+
+    for (uint64_t i = 0; i < count(CSRB_SECTION_INSTANCES); ++i) {
+        const CSRBInstance& inst = instances[i];
+        float transform[12] = {
+            1, 0, 0, inst.translate[0],
+            0, 1, 0, inst.translate[1],
+            0, 0, 1, inst.translate[2]
+        };
+        if (inst.type == CSRB_INSTANCE_SPHERE && inst.prim < spheres.size()) {
+            scene_ptr->add_primitive_instance(make_shared<SpherePrimitiveInstance>(spheres[inst.prim], transform, device), device);
+        } else if (inst.type == CSRB_INSTANCE_QUAD && inst.prim < quads.size()) {
+            scene_ptr->add_primitive_instance(make_shared<QuadPrimitiveInstance>(quads[inst.prim], transform, device), device);
+        } else {
+            throw std::runtime_error("Corrupt CSRB instance in " + name);
+        }
+    }
+
+    // Meshes are mapped from their own files; only their paths and material lists live in the image.
+    MeshParser mesh_parser;
+    auto mesh_start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < count(CSRB_SECTION_MESHES); ++i) {
+        const CSRBMesh& m = meshes[i];
+        if (m.material_count == 0 || m.first_material > count(CSRB_SECTION_MESH_MATERIALS)
+            || m.material_count > count(CSRB_SECTION_MESH_MATERIALS) - m.first_material) {
+            throw std::runtime_error("Corrupt CSRB mesh in " + name);
+        }
+        std::vector<std::shared_ptr<material>> mesh_mats;
+        for (uint32_t k = 0; k < m.material_count; ++k) mesh_mats.push_back(material_at(mesh_materials[m.first_material + k]));
+
+        std::vector<std::string> material_names;
+        std::string names = string_at(m.material_names);
+        for (size_t start = 0, end; start < names.size(); start = end + 1) {
+            end = names.find(' ', start);
+            if (end == std::string::npos) end = names.size();
+            material_names.push_back(names.substr(start, end - start));
+        }
+
+        std::string mesh_path = string_at(m.path);
+        scene_ptr->asset_paths.push_back(mesh_path);
+        auto mesh = make_shared<MeshPrimitive>(mesh_parser.load(mesh_path, material_names), mesh_mats, device);
+        scene_ptr->mesh_triangles += mesh->triangleCount();
+        scene_ptr->add_primitive(mesh);
+    }
+    scene_ptr->mesh_load_seconds = secondsSince(mesh_start);
+
+    return scene_ptr;
 }
 
-bool CSRParser::readBooleanProperty(std::string line) {
-    auto tokens = split(line);
-    bool value;
-    std::istringstream(tokens[1]) >> std::boolalpha >> value;
-    return value;
+CSRLine CSRParser::expectLine(CSRLexer& lexer, std::string_view key, int argc) {
+    CSRLine line;
+    if (!lexer.next(line)) throw std::runtime_error("CSR: unexpected end of file, expected '" + std::string(key) + "'");
+    if (line.key != key) {
+        throw std::runtime_error(csrError(line.number, "expected '" + std::string(key) + "', got '" + std::string(line.key) + "'"));
+    }
+    if (line.argc < argc) throw std::runtime_error(csrError(line.number, "missing values for '" + std::string(key) + "'"));
+    return line;
 }
 
-point3 CSRParser::readXYZProperty(std::string line) {
-    auto tokens = split(line);
-    point3 p(std::stof(tokens[1]), std::stof(tokens[2]), std::stof(tokens[3]));
-    return p;
+bool CSRParser::readBooleanProperty(CSRLexer& lexer, std::string_view key) {
+    CSRLine line = expectLine(lexer, key, 1);
+    return parseBool(line.args[0], line.number);
 }
 
+point3 CSRParser::readXYZProperty(CSRLexer& lexer, std::string_view key) {
+    CSRLine line = expectLine(lexer, key, 3);
+    return point3(parseFloat(line.args[0], line.number), parseFloat(line.args[1], line.number), parseFloat(line.args[2], line.number));
+}
 
-double CSRParser::readDoubleProperty(std::string line) {
-    auto tokens = split(line);
-    return std::stod(tokens[1]);
+double CSRParser::readDoubleProperty(CSRLexer& lexer, std::string_view key) {
+    CSRLine line = expectLine(lexer, key, 1);
+    return parseFloat(line.args[0], line.number);
 }
 
-std::string CSRParser::readStringProperty(std::string line) {
-    auto tokens = split(line);
-    return tokens[1];
+std::string_view CSRParser::readStringProperty(CSRLexer& lexer, std::string_view key) {
+    return expectLine(lexer, key, 1).args[0];
 }
 
-double CSRParser::readRatioProperty(std::string line) {
-    auto tokens = split(line);
-    auto ratio_tokens = split(tokens[1], '/');
-    return std::stod(ratio_tokens[0]) / std::stod(ratio_tokens[1]);
+double CSRParser::readRatioProperty(CSRLexer& lexer, std::string_view key) {
+    CSRLine line = expectLine(lexer, key, 1);
+    return parseRatio(line.args[0], line.number);
 }
 
-Camera CSRParser::readCamera() {
-    std::string line;
-    std::string lookfrom, lookat, vup, vfov, aspect_ratio, aperture, focus_dist;
-    while (getNextLine(file, line)) {
-        if (startsWith(line, "Camera")) {
-            getNextLine(file, lookfrom); getNextLine(file, lookat); getNextLine(file, vup);
-            getNextLine(file, vfov); getNextLine(file, aspect_ratio); getNextLine(file, aperture); getNextLine(file, focus_dist);
-            break;
-        }
+CSRBCamera CSRParser::readCamera(CSRLexer& lexer) {
+    CSRLine line;
+    while (lexer.next(line) && line.key != "Camera") {}
+    if (line.key != "Camera") throw std::runtime_error("CSR: missing Camera block");
+
+    CSRBCamera cam;
+    point3 lookfrom = readXYZProperty(lexer, "lookfrom");
+    point3 lookat = readXYZProperty(lexer, "lookat");
+    vec3 vup = readXYZProperty(lexer, "vup");
+    for (int i = 0; i < 3; ++i) {
+        cam.lookfrom[i] = lookfrom[i];
+        cam.lookat[i] = lookat[i];
+        cam.vup[i] = vup[i];
     }
-    Camera cam(readXYZProperty(lookfrom), readXYZProperty(lookat),
-        readXYZProperty(vup), readDoubleProperty(vfov),
-        readRatioProperty(aspect_ratio), readDoubleProperty(aperture),
-        readDoubleProperty(focus_dist));
+    cam.vfov = readDoubleProperty(lexer, "vfov");
+    cam.aspect_ratio = readRatioProperty(lexer, "aspect_ratio");
+    cam.aperture = readDoubleProperty(lexer, "aperture");
+    cam.focus_dist = readDoubleProperty(lexer, "focus_dist");
     return cam;
-}
\ No newline at end of file
+}
+
+std::string_view CSRParser::blockType(std::string_view key) {
+    auto idStart = key.find('[');
+    auto idEnd = key.find(']');
+    if (idStart == std::string_view::npos || idEnd == std::string_view::npos || idEnd < idStart) return std::string_view();
+    return key.substr(idStart + 1, idEnd - idStart - 1);
+}
+
+bool CSRParser::startsWith(std::string_view str, std::string_view prefix) {
+    return str.size() >= prefix.size() && str.compare(0, prefix.size(), prefix) == 0;
+}
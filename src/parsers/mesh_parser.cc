@@ -0,0 +1,360 @@
+#include "mesh_parser.hh"
+
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+#include "mapped_file.hh"
+
+namespace {
+
+    struct PLYProperty {
+        std::string name;
+        int size = 0;           // scalar size, or the item size of a list
+        bool is_float = false;
+        bool is_signed = false;
+        bool is_list = false;
+        int count_size = 0;     // size of the list length prefix
+    };
+
+    struct PLYElement {
+        std::string name;
+        size_t count = 0;
+        std::vector<PLYProperty> properties;
+
+        /** @brief Record size in bytes, or 0 if the element has a list property (variable size). */
+        size_t fixedSize() const {
+            size_t size = 0;
+            for (const PLYProperty& p : properties) {
+                if (p.is_list) return 0;
+                size += p.size;
+            }
+            return size;
+        }
+    };
+
+    void plyType(std::string_view type, PLYProperty& p, const std::string& path) {
+        if (type == "char" || type == "int8") { p.size = 1; p.is_signed = true; }
+        else if (type == "uchar" || type == "uint8") { p.size = 1; }
+        else if (type == "short" || type == "int16") { p.size = 2; p.is_signed = true; }
+        else if (type == "ushort" || type == "uint16") { p.size = 2; }
+        else if (type == "int" || type == "int32") { p.size = 4; p.is_signed = true; }
+        else if (type == "uint" || type == "uint32") { p.size = 4; }
+        else if (type == "float" || type == "float32") { p.size = 4; p.is_float = true; }
+        else if (type == "double" || type == "float64") { p.size = 8; p.is_float = true; }
+        else throw std::runtime_error("Unknown PLY property type '" + std::string(type) + "' in " + path);
+    }
+
+    // Reads one little-endian value of the given layout as an integer (used for counts and indices).
+    int64_t readInteger(const char* data, int size, bool is_signed, bool is_float) {
+        if (is_float) {
+            if (size == 4) { float f; std::memcpy(&f, data, 4); return static_cast<int64_t>(f); }
+            double d; std::memcpy(&d, data, 8); return static_cast<int64_t>(d);
+        }
+        switch (size) {
+            case 1: return is_signed ? int64_t(*reinterpret_cast<const int8_t*>(data)) : int64_t(*reinterpret_cast<const uint8_t*>(data));
+            case 2: { uint16_t v; std::memcpy(&v, data, 2); return is_signed ? int64_t(int16_t(v)) : int64_t(v); }
+            default: { uint32_t v; std::memcpy(&v, data, 4); return is_signed ? int64_t(int32_t(v)) : int64_t(v); }
+        }
+    }
+
+    float readFloat(const char* data, const PLYProperty& p) {
+        if (p.is_float && p.size == 4) { float f; std::memcpy(&f, data, 4); return f; }
+        if (p.is_float) { double d; std::memcpy(&d, data, 8); return static_cast<float>(d); }
+        return static_cast<float>(readInteger(data, p.size, p.is_signed, false));
+    }
+
+    std::string_view nextToken(std::string_view& line) {
+        size_t start = line.find_first_not_of(" \t\r");
+        if (start == std::string_view::npos) { line = std::string_view(); return line; }
+        size_t end = line.find_first_of(" \t\r", start);
+        if (end == std::string_view::npos) end = line.size();
+        std::string_view token = line.substr(start, end - start);
+        line.remove_prefix(end);
+        return token;
+    }
+
+    bool endsWith(const std::string& str, const char* suffix) {
+        size_t n = std::strlen(suffix);
+        if (str.size() < n) return false;
+        for (size_t i = 0; i < n; ++i) {
+            if (std::tolower(static_cast<unsigned char>(str[str.size() - n + i])) != suffix[i]) return false;
+        }
+        return true;
+    }
+
+    // Wraps an owned array so it can be kept alive next to the mapping.
+    template <typename T>
+    std::shared_ptr<const void> keep(std::shared_ptr<std::vector<T>> vec) { return vec; }
+}
+
+MeshData MeshParser::load(const std::string& path, const std::vector<std::string>& material_names) {
+    if (endsWith(path, ".ply")) return loadPLY(path);
+    if (endsWith(path, ".obj")) return loadOBJ(path, material_names);
+    throw std::runtime_error("Unsupported mesh format (expected .ply or .obj): " + path);
+}
+
+MeshData MeshParser::loadPLY(const std::string& path) {
+    auto mapping = std::make_shared<MappedFile>(path);
+    const char* data = mapping->data();
+    const size_t size = mapping->size();
+
+    // Header: plain text lines up to "end_header".
+    std::vector<PLYElement> elements;
+    size_t pos = 0;
+    bool first = true, header_done = false;
+    while (pos < size && !header_done) {
+        const char* newline = static_cast<const char*>(std::memchr(data + pos, '\n', size - pos));
+        if (!newline) break;
+        std::string_view line(data + pos, newline - (data + pos));
+        pos = newline - data + 1;
+        std::string_view keyword = nextToken(line);
+
+        if (first) {
+            if (keyword != "ply") throw std::runtime_error("Not a PLY file: " + path);
+            first = false;
+        } else if (keyword == "format") {
+            if (nextToken(line) != "binary_little_endian") throw std::runtime_error("Only binary_little_endian PLY is supported: " + path);
+        } else if (keyword == "element") {
+            PLYElement element;
+            element.name = std::string(nextToken(line));
+            std::string_view count = nextToken(line);
+            if (std::from_chars(count.data(), count.data() + count.size(), element.count).ec != std::errc()) {
+                throw std::runtime_error("Malformed PLY element count in " + path);
+            }
+            elements.push_back(element);
+        } else if (keyword == "property") {
+            if (elements.empty()) throw std::runtime_error("PLY property outside an element in " + path);
+            PLYProperty p;
+            std::string_view type = nextToken(line);
+            if (type == "list") {
+                PLYProperty count;
+                plyType(nextToken(line), count, path);
+                if (count.is_float) throw std::runtime_error("PLY list counts must be integers in " + path);
+                p.is_list = true;
+                p.count_size = count.size;
+                type = nextToken(line);
+            }
+            plyType(type, p, path);
+            p.name = std::string(nextToken(line));
+            elements.back().properties.push_back(p);
+        } else if (keyword == "end_header") {
+            header_done = true;
+        }
+        // comment and obj_info lines are ignored
+    }
+    if (!header_done) throw std::runtime_error("Missing PLY end_header in " + path);
+
+    MeshData mesh;
+    mesh.keepalive.push_back(mapping);
+    bool have_vertices = false, have_faces = false;
+
+    // Whether count records of at least record_bytes each fit in what is left of the file. Divides
+    // instead of multiplying, so a huge count from the header cannot overflow.
+    auto fits = [&](size_t count, size_t record_bytes) { return pos <= size && count <= (size - pos) / record_bytes; };
+
+    for (const PLYElement& element : elements) {
+        const size_t fixed = element.fixedSize();
+
+        if (element.name == "vertex") {
+            int x = -1, offset = 0, offset_x = 0;
+            for (size_t i = 0; i < element.properties.size(); ++i) {
+                if (element.properties[i].name == "x") { x = i; offset_x = offset; }
+                offset += element.properties[i].size;
+            }
+            if (fixed == 0 || x < 0 || x + 2 >= (int)element.properties.size()
+                || element.properties[x + 1].name != "y" || element.properties[x + 2].name != "z") {
+                throw std::runtime_error("PLY vertices need consecutive x, y, z properties in " + path);
+            }
+            if (!fits(element.count, fixed)) throw std::runtime_error("Truncated PLY vertex data in " + path);
+
+            const PLYProperty& px = element.properties[x];
+            bool plain_floats = px.is_float && px.size == 4 && element.properties[x + 1].size == 4 && element.properties[x + 2].size == 4
+                                && element.properties[x + 1].is_float && element.properties[x + 2].is_float;
+            // Embree needs 4-byte aligned shared buffers and may read 16 bytes at the last vertex.
+            bool shareable = plain_floats && fixed % 4 == 0 && (pos + offset_x) % 4 == 0
+                             && (element.count == 0 || pos + offset_x + (element.count - 1) * fixed + 16 <= size);
+            if (shareable) {
+                mesh.vertices = reinterpret_cast<const float*>(data + pos + offset_x);
+                mesh.vertex_stride = fixed;
+                mesh.mapped_vertices = true;
+            } else {
+                auto vertices = std::make_shared<std::vector<float>>(element.count * 3 + 1, 0.0f); // +1 for the 16 byte read
+                for (size_t v = 0; v < element.count; ++v) {
+                    const char* record = data + pos + v * fixed + offset_x;
+                    (*vertices)[3*v]     = readFloat(record, px);
+                    (*vertices)[3*v + 1] = readFloat(record + px.size, element.properties[x + 1]);
+                    (*vertices)[3*v + 2] = readFloat(record + px.size + element.properties[x + 1].size, element.properties[x + 2]);
+                }
+                mesh.vertices = vertices->data();
+                mesh.vertex_stride = 3*sizeof(float);
+                mesh.keepalive.push_back(keep(vertices));
+            }
+            mesh.vertex_count = element.count;
+            have_vertices = true;
+            pos += element.count * fixed;
+
+        } else if (element.name == "face") {
+            // Every face takes at least its fixed properties and list lengths, which bounds the count.
+            size_t min_face = 0;
+            for (const PLYProperty& p : element.properties) min_face += p.is_list ? p.count_size : p.size;
+            if (element.count > 0 && (min_face == 0 || !fits(element.count, min_face))) throw std::runtime_error("Truncated PLY face data in " + path);
+
+            auto indices = std::make_shared<std::vector<uint32_t>>();
+            auto materials = std::make_shared<std::vector<uint32_t>>();
+            indices->reserve(element.count * 3);
+            bool has_material = false;
+            for (const PLYProperty& p : element.properties) {
+                if (!p.is_list && (p.name == "material_index" || p.name == "material" || p.name == "mat")) has_material = true;
+            }
+            if (has_material) materials->reserve(element.count);
+
+            for (size_t f = 0; f < element.count; ++f) {
+                uint32_t face_material = 0;
+                int corners = 0;
+                uint32_t v0 = 0, prev = 0;
+                for (const PLYProperty& p : element.properties) {
+                    if (!p.is_list) {
+                        if (pos + p.size > size) throw std::runtime_error("Truncated PLY face data in " + path);
+                        if (p.name == "material_index" || p.name == "material" || p.name == "mat") {
+                            face_material = static_cast<uint32_t>(readInteger(data + pos, p.size, p.is_signed, p.is_float));
+                        }
+                        pos += p.size;
+                        continue;
+                    }
+                    if (pos + p.count_size > size) throw std::runtime_error("Truncated PLY face data in " + path);
+                    int64_t n = readInteger(data + pos, p.count_size, false, false);
+                    pos += p.count_size;
+                    if (pos + n * p.size > size) throw std::runtime_error("Truncated PLY face data in " + path);
+                    if (p.name != "vertex_indices" && p.name != "vertex_index") { pos += n * p.size; continue; }
+
+                    // Fan-triangulate: (v0, v1, v2), (v0, v2, v3), ...
+                    for (int64_t k = 0; k < n; ++k, pos += p.size) {
+                        uint32_t index = static_cast<uint32_t>(readInteger(data + pos, p.size, p.is_signed, p.is_float));
+                        if (k == 0) v0 = index;
+                        else if (k >= 2) indices->insert(indices->end(), { v0, prev, index });
+                        prev = index;
+                    }
+                    corners = n;
+                }
+                if (has_material) {
+                    size_t triangles = corners >= 3 ? corners - 2 : 0;
+                    materials->insert(materials->end(), triangles, face_material);
+                }
+            }
+
+            mesh.triangle_count = indices->size() / 3;
+            mesh.indices = indices->data();
+            mesh.keepalive.push_back(keep(indices));
+            if (has_material) {
+                mesh.face_materials = materials->data();
+                mesh.keepalive.push_back(keep(materials));
+            }
+            have_faces = true;
+
+        } else if (fixed > 0) {
+            if (!fits(element.count, fixed)) throw std::runtime_error("Truncated PLY data in " + path);
+            pos += element.count * fixed; // some other element (e.g. edge) we do not use
+        } else {
+            // Variable-sized element we do not use: walk its records to skip it.
+            for (size_t r = 0; r < element.count; ++r) {
+                for (const PLYProperty& p : element.properties) {
+                    if (pos + (p.is_list ? p.count_size : p.size) > size) throw std::runtime_error("Truncated PLY data in " + path);
+                    if (!p.is_list) { pos += p.size; continue; }
+                    int64_t n = readInteger(data + pos, p.count_size, false, false);
+                    pos += p.count_size + n * p.size;
+                }
+            }
+        }
+    }
+
+    if (!have_vertices || !have_faces) throw std::runtime_error("PLY file needs vertex and face elements: " + path);
+    for (size_t i = 0; i < mesh.triangle_count * 3; ++i) {
+        if (mesh.indices[i] >= mesh.vertex_count) throw std::runtime_error("PLY face index out of range in " + path);
+    }
+    return mesh;
+}
+
+MeshData MeshParser::loadOBJ(const std::string& path, const std::vector<std::string>& material_names) {
+    MappedFile text(path);
+    const char* cursor = text.data();
+    const char* end = text.data() + text.size();
+
+    auto vertices = std::make_shared<std::vector<float>>();
+    auto indices = std::make_shared<std::vector<uint32_t>>();
+    auto materials = std::make_shared<std::vector<uint32_t>>();
+    uint32_t current_material = 0;
+    bool any_material = false;
+    int line_number = 0;
+
+    auto fail = [&](const char* message) {
+        return std::runtime_error("OBJ line " + std::to_string(line_number) + " of " + path + ": " + message);
+    };
+
+    std::vector<uint32_t> polygon;
+    while (cursor < end) {
+        const char* newline = static_cast<const char*>(std::memchr(cursor, '\n', end - cursor));
+        std::string_view line(cursor, (newline ? newline : end) - cursor);
+        cursor = newline ? newline + 1 : end;
+        ++line_number;
+
+        size_t comment = line.find('#');
+        if (comment != std::string_view::npos) line = line.substr(0, comment);
+        std::string_view keyword = nextToken(line);
+
+        if (keyword == "v") {
+            for (int i = 0; i < 3; ++i) {
+                std::string_view token = nextToken(line);
+                float value;
+                if (!token.empty() && token[0] == '+') token.remove_prefix(1);
+                if (token.empty() || std::from_chars(token.data(), token.data() + token.size(), value).ec != std::errc()) {
+                    throw fail("malformed vertex");
+                }
+                vertices->push_back(value);
+            }
+        } else if (keyword == "f") {
+            polygon.clear();
+            const long vertex_count = vertices->size() / 3;
+            for (std::string_view token = nextToken(line); !token.empty(); token = nextToken(line)) {
+                token = token.substr(0, token.find('/')); // only the position index of v/vt/vn
+                long index;
+                if (std::from_chars(token.data(), token.data() + token.size(), index).ec != std::errc() || index == 0) {
+                    throw fail("malformed face");
+                }
+                index = index > 0 ? index - 1 : vertex_count + index; // negative indices count back from the last vertex
+                if (index < 0 || index >= vertex_count) throw fail("face index out of range");
+                polygon.push_back(static_cast<uint32_t>(index));
+            }
+            if (polygon.size() < 3) throw fail("face needs at least 3 vertices");
+            for (size_t k = 2; k < polygon.size(); ++k) {
+                indices->insert(indices->end(), { polygon[0], polygon[k - 1], polygon[k] });
+                materials->push_back(current_material);
+            }
+        } else if (keyword == "usemtl") {
+            std::string_view name = nextToken(line);
+            current_material = 0;
+            for (size_t i = 0; i < material_names.size(); ++i) {
+                if (material_names[i] == name) current_material = i;
+            }
+            any_material = true;
+        }
+        // vt, vn, o, g, s, mtllib and everything else are ignored
+    }
+
+    if (indices->empty()) throw std::runtime_error("OBJ file has no faces: " + path);
+
+    vertices->push_back(0.0f); // Embree may read 16 bytes at the last float3 vertex
+    MeshData mesh;
+    mesh.vertices = vertices->data();
+    mesh.vertex_count = (vertices->size() - 1) / 3;
+    mesh.indices = indices->data();
+    mesh.triangle_count = indices->size() / 3;
+    mesh.keepalive.push_back(keep(vertices));
+    mesh.keepalive.push_back(keep(indices));
+    if (any_material) {
+        mesh.face_materials = materials->data();
+        mesh.keepalive.push_back(keep(materials));
+    }
+    return mesh;
+}
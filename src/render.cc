@@ -1,4 +1,132 @@
 #include "render.h"
+#include "perf_counter.hh"
+#include "ray_binner.hh"
+#include <algorithm>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <sys/resource.h>
+
+double secondsSince(std::chrono::steady_clock::time_point t) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+}
+
+double peakResidentMB() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+    return usage.ru_maxrss / 1024.0; // ru_maxrss is in kilobytes on Linux
+}
+
+void ShadeStats::record(const ShadeHit* batch, int count, int unique) {
+    if (count == 0) return;
+    batches += 1;
+    hits += count;
+    unique_materials += unique;
+    lane_switches += 1;
+    for (int i = 1; i < count; ++i) {
+        if (batch[i].mat != batch[i-1].mat) lane_switches += 1;
+    }
+}
+
+void ShadeStats::merge(const ShadeStats& other) {
+    batches += other.batches;
+    hits += other.hits;
+    unique_materials += other.unique_materials;
+    lane_switches += other.lane_switches;
+    intersect_seconds += other.intersect_seconds;
+    if (other.cache_misses >= 0) cache_misses = (cache_misses < 0 ? 0 : cache_misses) + other.cache_misses;
+}
+
+int sortByMaterial(const ShadeHit* hits, int count, ShadeHit* sorted, std::vector<uint32_t>& counts) {
+    // Only the materials present in the batch are touched, so the pass costs O(count) however many
+    // materials the scene has. Buckets are laid out in first-seen order.
+    uint32_t keys[16];
+    int distinct = 0;
+    for (int i = 0; i < count; ++i) {
+        if (counts[hits[i].mat]++ == 0) keys[distinct++] = hits[i].mat;
+    }
+    uint32_t offset = 0;
+    for (int k = 0; k < distinct; ++k) {
+        uint32_t bucket = counts[keys[k]];
+        counts[keys[k]] = offset;
+        offset += bucket;
+    }
+    for (int i = 0; i < count; ++i) sorted[counts[hits[i].mat]++] = hits[i];
+    for (int k = 0; k < distinct; ++k) counts[keys[k]] = 0;
+    return distinct;
+}
+
+AOV parseAOV(const std::string& name) {
+    if (name == "albedo") return AOV::Albedo;
+    if (name == "normal") return AOV::Normal;
+    if (name == "depth") return AOV::Depth;
+    if (name == "id") return AOV::ObjectID;
+    throw std::invalid_argument("Unknown AOV '" + name + "' [albedo|normal|depth|id]");
+}
+
+std::string aovName(AOV layer) {
+    switch (layer) {
+        case AOV::Albedo: return "albedo";
+        case AOV::Normal: return "normal";
+        case AOV::Depth: return "depth";
+        default: return "id";
+    }
+}
+
+std::vector<AOV> parseAOVList(const std::string& names) {
+    std::vector<AOV> layers;
+    std::stringstream stream(names);
+    std::string name;
+    while (std::getline(stream, name, ',')) {
+        if (!name.empty()) layers.push_back(parseAOV(name));
+    }
+    return layers;
+}
+
+void AOVBuffers::reset(size_t pixels) {
+    allocated = requested;
+    for (int c = 0; c < 3; ++c) {
+        if (has(AOV::Albedo)) albedo[c].assign(pixels, 0.0f);
+        else std::vector<float>().swap(albedo[c]);
+        if (has(AOV::Normal)) normal[c].assign(pixels, 0.0f);
+        else std::vector<float>().swap(normal[c]);
+    }
+    if (has(AOV::Depth)) depth.assign(pixels, 0.0f);
+    else std::vector<float>().swap(depth);
+    if (has(AOV::ObjectID)) object_id.assign(pixels, -1);
+    else std::vector<int32_t>().swap(object_id);
+}
+
+void AOVBuffers::clear() {
+    requested = 0;
+    reset(0);
+}
+
+void AOVBuffers::merge(const AOVBuffers& other) {
+    auto add = [](std::vector<float>& into, const std::vector<float>& from) {
+        if (into.size() != from.size()) return;
+        for (size_t i = 0; i < into.size(); ++i) into[i] += from[i];
+    };
+    for (int c = 0; c < 3; ++c) {
+        add(albedo[c], other.albedo[c]);
+        add(normal[c], other.normal[c]);
+    }
+    add(depth, other.depth);
+    if (object_id.size() == other.object_id.size()) {
+        for (size_t i = 0; i < object_id.size(); ++i) {
+            if (other.object_id[i] != -1) object_id[i] = other.object_id[i];
+        }
+    }
+}
+
+// Render workers each merge their ShadeStats once, when their block of rows is done.
+static std::mutex shade_stats_mutex;
+
+static void mergeShadeStats(RenderData& data, const ShadeStats& stats) {
+    std::lock_guard<std::mutex> lock(shade_stats_mutex);
+    data.stats.shading.merge(stats);
+}
 
 void setRenderData(RenderData& render_data, const float aspect_ratio, const int image_width, const int samples_per_pixel, const int max_depth) {
     const int image_height = static_cast<int>(image_width / aspect_ratio);
@@ -6,10 +134,113 @@ void setRenderData(RenderData& render_data, const float aspect_ratio, const int
     render_data.image_height = image_height;
     render_data.samples_per_pixel = samples_per_pixel;
     render_data.max_depth = max_depth;
-    render_data.buffer = std::vector<color>(image_width * image_height);
+    // Left uninitialised, so the pages are first touched (and, on NUMA machines, placed) by the render
+    // worker that owns each row rather than by this thread.
+    render_data.buffer = FrameBuffer(static_cast<size_t>(image_width) * image_height);
+    render_data.sampler = Sampler::create(SamplerType::Random, samples_per_pixel, image_width);
+}
+
+ray cameraRay(const Camera& cam, const Sampler& sampler, int i, int j, int s, int image_width, int image_height) {
+    uint32_t pixel = j * image_width + i;
+    double jitter_u, jitter_v, lens_u, lens_v;
+    sampler.get2D(pixel, s, DIM_PIXEL, jitter_u, jitter_v);
+    sampler.get2D(pixel, s, DIM_LENS, lens_u, lens_v);
+    auto u = (i + jitter_u) / (image_width-1);
+    auto v = (j + jitter_v) / (image_height-1);
+    return cam.get_ray(u, v, lens_u, lens_v);
+}
+
+// Power heuristic (beta = 2) weight of a sample drawn with density a, against a strategy with density b.
+static double powerHeuristic(double a, double b) {
+    return a*a / (a*a + b*b);
+}
+
+// True if nothing blocks the unit direction from p up to distance tfar.
+static bool unoccluded(const Scene& scene, const point3& p, const vec3& direction, float tfar, double time) {
+    RTCRay shadow;
+    setupShadowRay1(shadow, ray(p, direction, time), tfar);
+    rtcOccluded1(scene.rtc_scene, &shadow);
+    return shadow.tfar >= 0; // Embree sets tfar to -inf on occlusion
+}
+
+static double luminance(const color& c) {
+    return 0.2126*c.x() + 0.7152*c.y() + 0.0722*c.z();
+}
+
+// Density of the diffuse bounce drawing the unit direction: Lambertian scatter() draws normal + unit vector,
+// i.e. cos(theta) / pi, mixed with the path guide's distribution if guide_region is set (path_guide.hh).
+static double diffusePdf(const PathSample& path, int guide_region, const vec3& direction, const vec3& normal) {
+    double cosine_pdf = std::max(static_cast<double>(dot(direction, normal)), 0.0) / pi;
+    if (guide_region < 0) return cosine_pdf;
+    return PathGuide::GUIDE_FRACTION * path.guide->pdf(guide_region, direction) + (1 - PathGuide::GUIDE_FRACTION) * cosine_pdf;
+}
+
+color directLight(const Scene& scene, uint32_t mat, const HitInfo& rec, const ray& scattered, const PathSample& path, double& scatter_pdf,
+                    int guide_region) {
+    scatter_pdf = 0;
+    bool sample_environment = scene.environment->canSample();
+    if (!scene.materials.isDiffuse(mat) || (!sample_environment && scene.lights.empty())) return color(0, 0, 0);
+
+    scatter_pdf = diffusePdf(path, guide_region, scattered.direction().unit_vector(), rec.normal);
+    color result(0, 0, 0);
+
+    if (sample_environment) {
+        double u, v, light_pdf;
+        vec3 direction;
+        path.sampler->light(path.pixel, path.index, path.bounce, u, v);
+        color radiance = scene.environment->sample(u, v, direction, light_pdf);
+        double cosine = dot(direction, rec.normal);
+        if (light_pdf > 0 && cosine > 0 && unoccluded(scene, rec.pos, direction, std::numeric_limits<float>::infinity(), scattered.time())) {
+            double bsdf_pdf = cosine / pi;
+            result += radiance * (bsdf_pdf / light_pdf * powerHeuristic(light_pdf, diffusePdf(path, guide_region, direction, rec.normal)));
+        }
+    }
+
+    if (!scene.lights.empty()) {
+        double u, v, remapped, pmf;
+        path.sampler->emitter(path.pixel, path.index, path.bounce, u, v);
+        const LightShape* light = scene.lights.pick(rec.pos, rec.normal, u, remapped, pmf);
+        if (light != nullptr) {
+            vec3 light_normal;
+            vec3 to_light = light->sample(remapped, v, light_normal) - rec.pos;
+            double distance = to_light.length();
+            vec3 direction = to_light / distance;
+            double cosine = dot(direction, rec.normal);
+            double light_cosine = -dot(direction, light_normal);
+            if (light->type != LightShape::Sphere) light_cosine = std::fabs(light_cosine); // planar emitters emit from both faces
+            if (cosine > 0 && light_cosine > 0 && unoccluded(scene, rec.pos, direction, distance - 0.001, scattered.time())) {
+                double light_pdf = pmf * distance * distance / (light_cosine * light->area());
+                double bsdf_pdf = cosine / pi;
+                result += light->emission * (bsdf_pdf / light_pdf * powerHeuristic(light_pdf, diffusePdf(path, guide_region, direction, rec.normal)));
+            }
+        }
+    }
+    return result;
+}
+
+color environmentRadiance(const Scene& scene, const ray& r, double scatter_pdf) {
+    color radiance = scene.environment->radiance(r.direction());
+    if (scatter_pdf <= 0) return radiance;
+    return radiance * powerHeuristic(scatter_pdf, scene.environment->pdf(r.direction().unit_vector()));
 }
 
-color colorize_ray(const ray& r, std::shared_ptr<Scene> scene, int depth) {
+color hitEmission(const Scene& scene, uint32_t mat, const HitInfo& rec, const ray& r, unsigned int geomID, unsigned int primID,
+                    double scatter_pdf, const vec3& scatter_normal) {
+    color emission = scene.materials.emitted(mat, rec.u, rec.v, rec.pos);
+    if (scatter_pdf <= 0 || !scene.materials.isEmissive(mat)) return emission;
+
+    double pmf;
+    const LightShape* light = scene.lights.find(geomID, primID, r.origin(), scatter_normal, pmf);
+    if (light == nullptr) return emission;
+    vec3 direction = r.direction().unit_vector();
+    double distance = rec.t * r.direction().length();
+    double light_cosine = std::fabs(dot(direction, rec.normal));
+    if (light_cosine <= 0) return emission;
+    double light_pdf = pmf * distance * distance / (light_cosine * light->area());
+    return emission * powerHeuristic(scatter_pdf, light_pdf);
+}
+
+color colorize_ray(const ray& r, std::shared_ptr<Scene> scene, int depth, PathSample path, int splits) {
     HitInfo record;
 
     // end of recursion
@@ -29,30 +260,103 @@ color colorize_ray(const ray& r, std::shared_ptr<Scene> scene, int depth) {
     } else if (rayhit.hit.geomID != RTC_INVALID_GEOMETRY_ID) {
         targetID = rayhit.hit.geomID;
     } else {
-        // Sky background (gradient blue-white)
-        vec3 unit_direction = r.direction().unit_vector();
-        auto t = 0.5*(unit_direction.y() + 1.0);
-
-        return (1.0-t)*color(1.0, 1.0, 1.0) + t*color(0.5, 0.7, 1.0); // lerp formula (1.0-t)*start + t*endval
+        color radiance = environmentRadiance(*scene, r, path.scatter_pdf);
+        if (path.bounce == 0 && path.aovs) {
+            for (int m = 0; m < splits; ++m) path.aovs->add(path.pixel, path.index + m, radiance, vec3(0, 0, 0), 0.0f, -1);
+        }
+        return splits * radiance;
     }
 
     // Hit is found
-    ray scattered;
-    color attenuation;
 
     // get the material of the thing we just hit
     std::shared_ptr<Geometry> geomhit = scene->geom_map[targetID];
-    std::shared_ptr<material> mat_ptr = geomhit->materialById(targetID);
-    record = geomhit->getHitInfo(r, r.at(rayhit.ray.tfar), rayhit.ray.tfar, targetID);
+    uint32_t mat = scene->materials.lookup(targetID, rayhit.hit.primID);
+    record = geomhit->getHitInfo(r, r.at(rayhit.ray.tfar), rayhit.ray.tfar, targetID, rayhit.hit.primID);
 
-    color color_from_emission = mat_ptr->emitted(record.u, record.v, record.pos);
-    if (!mat_ptr->scatter(r, record, attenuation, scattered)) {
-        return color_from_emission;
-    } 
+    color color_from_emission = hitEmission(*scene, mat, record, r, targetID, rayhit.hit.primID, path.scatter_pdf, path.scatter_normal);
 
-    color color_from_scatter = attenuation * colorize_ray(scattered, scene, depth-1);
+    // A trained radiance cache ends the path here if the cell has seen enough samples (radiance_cache.hh).
+    bool cacheable = path.cache && path.bounce >= 1 && scene->materials.isDiffuse(mat);
+    if (cacheable && !path.cache->training && path.bounce >= static_cast<uint32_t>(path.cache->firstBounce())) {
+        color cached;
+        if (path.cache->lookup(record.pos, record.normal, cached)) return splits * (color_from_emission + cached);
+    }
+
+    // Diffuse bounces that go on train the path guide's region here, and sample from it once it is trained.
+    int guide_region = -1, sampling_region = -1;
+    if (path.guide && depth > 1 && scene->materials.isDiffuse(mat)) {
+        guide_region = path.guide->regionAt(record.pos);
+        if (path.guide->canSample(guide_region)) sampling_region = guide_region;
+    }
+
+    // Each split continues the path with the numbers of its own sample index, everything above is shared.
+    color total(0, 0, 0);
+    for (int m = 0; m < splits; ++m) {
+        PathSample branch = path;
+        branch.index = path.index + m;
+        ray scattered;
+        color attenuation;
+        ScatterSample sample = path.sampler->scatter(branch.pixel, branch.index, branch.bounce);
+        bool scatters = scene->materials.scatter(mat, r, record, sample, attenuation, scattered);
+        if (branch.bounce == 0 && branch.aovs) {
+            branch.aovs->add(branch.pixel, branch.index, scatters ? attenuation : color(1, 1, 1), record.normal,
+                            rayhit.ray.tfar * r.direction().length(), targetID);
+        }
+        if (!scatters) {
+            total += color_from_emission;
+            continue;
+        }
 
-    return color_from_emission + color_from_scatter;
+        // A guided bounce draws its direction from the guide or the BSDF as sample.w picks, and is weighted by
+        // the cosine over the mixture density; attenuation already holds albedo * cos / pi over cos / pi.
+        double guide_weight = 1, guide_pdf = 0;
+        vec3 direction;
+        if (guide_region >= 0) {
+            if (sampling_region >= 0 && sample.w < PathGuide::GUIDE_FRACTION) {
+                scattered = ray(record.pos, path.guide->sample(sampling_region, sample.u, sample.v), r.time());
+            }
+            direction = scattered.direction().unit_vector();
+            guide_pdf = diffusePdf(path, sampling_region, direction, record.normal);
+            double cosine_pdf = std::max(static_cast<double>(dot(direction, record.normal)), 0.0) / pi;
+            guide_weight = guide_pdf > 0 ? cosine_pdf / guide_pdf : 0;
+        }
+
+        color color_from_light(0, 0, 0);
+        branch.scatter_pdf = 0;
+        if (depth > 1) color_from_light = directLight(*scene, mat, record, scattered, branch, branch.scatter_pdf, sampling_region);
+        branch.scatter_normal = record.normal;
+
+        branch.bounce += 1;
+        color incoming(0, 0, 0);
+        if (guide_weight > 0) incoming = colorize_ray(scattered, scene, depth-1, branch);
+        if (guide_region >= 0 && path.guide->training) path.guide->record(guide_region, direction, luminance(incoming), guide_pdf);
+        color color_from_scatter = attenuation * (color_from_light + guide_weight * incoming);
+
+        total += color_from_emission + color_from_scatter;
+    }
+    if (cacheable && path.cache->training) path.cache->insert(record.pos, record.normal, total / splits - color_from_emission);
+    return total;
+}
+
+// True once data.deadline has passed. Row j is then left as it was, or zeroed if this pass would have been
+// the first to write it, so no pixel stays uninitialised.
+static bool rowExpired(RenderData& data, int j) {
+    if (data.deadline == std::chrono::steady_clock::time_point::max() || std::chrono::steady_clock::now() < data.deadline) return false;
+    if (data.first_sample == 0 && !data.accumulate) {
+        auto row = data.buffer.begin() + static_cast<size_t>(j) * data.image_width;
+        std::fill(row, row + data.image_width, color(0, 0, 0));
+    }
+    return true;
+}
+
+// Records that row j of buffer now also sums samples [first_sample, samples_per_pixel).
+static void countRowSamples(RenderData& data, int j) {
+    if (data.pixel_samples.empty()) return;
+    const uint32_t added = static_cast<uint32_t>(data.samples_per_pixel - data.first_sample);
+    const bool adds = data.first_sample > 0 || data.accumulate;
+    auto row = data.pixel_samples.begin() + static_cast<size_t>(j) * data.image_width;
+    for (auto count = row; count != row + data.image_width; ++count) *count = (adds ? *count : 0) + added;
 }
 
 void render_scanlines(int lines, int start_line, std::shared_ptr<Scene> scene_ptr, RenderData& data, Camera cam) {
@@ -61,38 +365,51 @@ void render_scanlines(int lines, int start_line, std::shared_ptr<Scene> scene_pt
     int image_height        = data.image_height;
     int samples_per_pixel   = data.samples_per_pixel;
     int max_depth           = data.max_depth;
+    int split               = std::max(data.split, 1);
+    const Sampler& sampler  = *data.sampler;
 
     for (int j=start_line; j>=start_line - (lines - 1); --j) {
+        if (rowExpired(data, j)) continue;
 
         for (int i=0; i<image_width; ++i) {
 
             color pixel_color(0, 0, 0);
 
-            for (int s=0; s < samples_per_pixel; s++) {
-                auto u = (i + random_double()) / (image_width-1);
-                auto v = (j + random_double()) / (image_height-1);
-                ray r = cam.get_ray(u, v);
-                pixel_color += colorize_ray(r, scene_ptr, max_depth);
+            // With --split, camera ray k (drawn from primary_sampler) is traced once and continued by the
+            // paths of samples k * split up to k * split + split - 1.
+            for (int s=data.first_sample, k=data.first_sample / split; s < samples_per_pixel; s += split, k++) {
+                int splits = std::min(split, samples_per_pixel - s);
+                ray r = split > 1 ? cameraRay(cam, *data.primary_sampler, i, j, k, image_width, image_height)
+                                  : cameraRay(cam, sampler, i, j, s, image_width, image_height);
+                PathSample path = { &sampler, static_cast<uint32_t>(j * image_width + i), static_cast<uint32_t>(s), 0 };
+                if (data.aovs.any()) path.aovs = &data.aovs;
+                path.cache = data.radiance_cache.get();
+                path.guide = data.path_guide.get();
+                pixel_color += colorize_ray(r, scene_ptr, max_depth, path, splits);
             }
 
             int buffer_index = j * image_width + i;
             color buffer_pixel(pixel_color.x(), pixel_color.y(), pixel_color.z());
-            data.buffer[buffer_index] = buffer_pixel;
+            if (data.first_sample > 0 || data.accumulate) data.buffer[buffer_index] += buffer_pixel;
+            else data.buffer[buffer_index] = buffer_pixel;
         }
-        data.completed_lines += 1;
+        countRowSamples(data, j);
+        int completed_lines = (data.completed_lines += 1);
 
-        float percentage_completed = ((float)data.completed_lines / (float)data.image_height)*100.00;
-        std::cerr << "[" <<int(percentage_completed) << "%] completed" << std::endl;
+        float percentage_completed = ((float)completed_lines / (float)data.image_height)*100.00;
+        if (!data.accumulate) std::cerr << "[" <<int(percentage_completed) << "%] completed" << std::endl;
     }
 }
 
 void completeRayQueueTask(std::vector<RayQueue>& current, std::vector<color>& temp_buffer,
                             std::vector<color>& full_buffer, std::vector<RayQueue>& queue,
-                            int mask[], int i, int current_index) {
+                            int mask[], int i, int current_index, RayBinner* binner) {
     // check if theres even any more to do, if not then break out.
     // this pixel is done so we can update the full buffer.
     full_buffer[current_index] += temp_buffer[current_index];
-    if (queue.empty()) {
+    if (binner) {
+        mask[i] = 0; // the binner refills the lane once the whole packet is shaded
+    } else if (queue.empty()) {
         mask[i] = 0; // disable this part of the packet from running
     } else {
         // replace finished RayQueue with next
@@ -107,6 +424,9 @@ void render_scanlines_sse(int lines, int start_line, std::shared_ptr<Scene> scen
     int image_height        = data.image_height;
     int samples_per_pixel   = data.samples_per_pixel;
     int max_depth           = data.max_depth;
+    const Sampler& sampler  = *data.sampler;
+    const MaterialTable& materials = scene_ptr->materials;
+    AOVBuffers* aovs = data.aovs.any() ? &data.aovs : nullptr;
 
     std::vector<color> full_buffer(image_width);
 
@@ -117,18 +437,29 @@ void render_scanlines_sse(int lines, int start_line, std::shared_ptr<Scene> scen
     std::vector<color> attenuation_buffer(image_width);
     std::vector<RayQueue> current(4); // size = 4 only
 
+    ShadeHit hits[4], sorted[4];
+    std::vector<uint32_t> material_counts(materials.materialCount(), 0);
+    ShadeStats shade;
+    CacheMissCounter cache_misses;
+
+    std::unique_ptr<RayBinner> binner;
+    if (data.reorder_rays) {
+        RTCBounds bounds;
+        rtcGetSceneBounds(scene_ptr->rtc_scene, &bounds);
+        binner = std::make_unique<RayBinner>(bounds, 4);
+    }
+
     int mask[4] = {-1, -1, -1, -1};
     
     for (int j=start_line; j>=start_line - (lines - 1); --j) {
+        if (rowExpired(data, j)) continue;
         std::fill(full_buffer.begin(), full_buffer.end(), color(0, 0, 0));
-        for (int s=0; s < samples_per_pixel; s++) {
+        for (int s=data.first_sample; s < samples_per_pixel; s++) {
             std::fill(temp_buffer.begin(), temp_buffer.end(), color(0, 0, 0));
             std::fill(attenuation_buffer.begin(), attenuation_buffer.end(), color(0, 0, 0));
             queue.clear();
             for (int i=image_width-1; i>=0; --i) {
-                auto u = (i + random_double()) / (image_width-1);
-                auto v = (j + random_double()) / (image_height-1);
-                ray r = cam.get_ray(u, v);
+                ray r = cameraRay(cam, sampler, i, j, s, image_width, image_height);
                 RayQueue q = { i, 0, r };
                 queue.push_back(q);
             }
@@ -148,9 +479,12 @@ void render_scanlines_sse(int lines, int start_line, std::shared_ptr<Scene> scen
                     rays.push_back(current[i].r);
                 }
                 setupRayHit4(rayhit, rays);
+                auto intersect_start = std::chrono::steady_clock::now();
                 rtcIntersect4(mask, scene_ptr->rtc_scene, &rayhit);
+                shade.intersect_seconds += secondsSince(intersect_start);
 
                 HitInfo record;
+                int hit_count = 0;
 
                 for (int i=0; i<4; i++) {
                     if (mask[i] == 0) { continue; }
@@ -164,55 +498,86 @@ void render_scanlines_sse(int lines, int start_line, std::shared_ptr<Scene> scen
                     else if (rayhit.hit.geomID[i] != RTC_INVALID_GEOMETRY_ID) {
                         targetID = rayhit.hit.geomID[i]; }
                     else { // no hit
-                        // Sky background (gradient blue-white)
-                        vec3 unit_direction = current_ray.direction().unit_vector();
-                        auto t = 0.5*(unit_direction.y() + 1.0);
-
-                        color multiplier = (1.0-t)*color(1.0, 1.0, 1.0) + t*color(0.5, 0.7, 1.0); // lerp formula (1.0-t)*start + t*endval
+                        color multiplier = environmentRadiance(*scene_ptr, current_ray, current[i].scatter_pdf);
+                        if (current[i].depth == 0 && aovs) aovs->add(j * image_width + current_index, s, multiplier, vec3(0, 0, 0), 0.0f, -1);
                         if (current[i].depth == 0) { temp_buffer[current_index] = multiplier; }
                         else { temp_buffer[current_index] = temp_buffer[current_index] + (attenuation_buffer[current_index] * multiplier); }
-                        completeRayQueueTask(current, temp_buffer, full_buffer, queue, mask, i, current_index);
+                        completeRayQueueTask(current, temp_buffer, full_buffer, queue, mask, i, current_index, binner.get());
                     }
                     if (targetID != -1) {
-                        ray scattered;
-                        color attenuation;
-                        std::shared_ptr<Geometry> geomhit = scene_ptr->geom_map[targetID];
-                        std::shared_ptr<material> mat_ptr = geomhit->materialById(targetID);
-                        record = geomhit->getHitInfo(current_ray, current_ray.at(rayhit.ray.tfar[i]), rayhit.ray.tfar[i], targetID);
-                        
-                        color color_from_emission = mat_ptr->emitted(record.u, record.v, record.pos);
-                        if (!mat_ptr->scatter(current_ray, record, attenuation, scattered)) {
-                            if (current[i].depth == 0) { temp_buffer[current_index] = color_from_emission; }
-                            else { temp_buffer[current_index] = temp_buffer[current_index] + (attenuation_buffer[current_index] * color_from_emission); }
-                            completeRayQueueTask(current, temp_buffer, full_buffer, queue, mask, i, current_index);
-                        } else {
-                            if (current[i].depth == 0) {
-                                temp_buffer[current_index] = color_from_emission;
-                                attenuation_buffer[current_index] = attenuation;
-                            }
-                            else {
-                                temp_buffer[current_index] = temp_buffer[current_index] + (attenuation_buffer[current_index] * color_from_emission);
-                                attenuation_buffer[current_index] = attenuation_buffer[current_index] * attenuation;
-                            }
-                            if (current[i].depth + 1 == max_depth) { // reached max depth, replace with next in queue
-                                completeRayQueueTask(current, temp_buffer, full_buffer, queue, mask, i, current_index);
-                            } else { // not finished depth wise
-                                current[i].depth += 1;
-                                current[i].r = scattered;
-                            }
+                        hits[hit_count++] = ShadeHit{ i, targetID, materials.lookup(targetID, rayhit.hit.primID[i]) };
+                    }
+                }
+
+                // Shade the hits grouped by material, so lanes that share a material (and so its texture) run back to back.
+                int unique_materials = sortByMaterial(hits, hit_count, sorted, material_counts);
+                shade.record(hits, hit_count, unique_materials);
+                for (int h=0; h<hit_count; h++) {
+                    int i = sorted[h].lane;
+                    int targetID = sorted[h].targetID;
+                    uint32_t mat = sorted[h].mat;
+                    ray current_ray = current[i].r;
+                    int current_index = current[i].index;
+                    ray scattered;
+                    color attenuation;
+                    std::shared_ptr<Geometry> geomhit = scene_ptr->geom_map[targetID];
+                    record = geomhit->getHitInfo(current_ray, current_ray.at(rayhit.ray.tfar[i]), rayhit.ray.tfar[i], targetID, rayhit.hit.primID[i]);
+                    
+                    color color_from_emission = hitEmission(*scene_ptr, mat, record, current_ray, targetID, rayhit.hit.primID[i],
+                                                            current[i].scatter_pdf, current[i].scatter_normal);
+                    ScatterSample sample = sampler.scatter(j * image_width + current_index, s, current[i].depth);
+                    bool scatters = materials.scatter(mat, current_ray, record, sample, attenuation, scattered);
+                    if (current[i].depth == 0 && aovs) {
+                        aovs->add(j * image_width + current_index, s, scatters ? attenuation : color(1, 1, 1), record.normal,
+                                    rayhit.ray.tfar[i] * current_ray.direction().length(), targetID);
+                    }
+                    if (!scatters) {
+                        if (current[i].depth == 0) { temp_buffer[current_index] = color_from_emission; }
+                        else { temp_buffer[current_index] = temp_buffer[current_index] + (attenuation_buffer[current_index] * color_from_emission); }
+                        completeRayQueueTask(current, temp_buffer, full_buffer, queue, mask, i, current_index, binner.get());
+                    } else {
+                        if (current[i].depth == 0) {
+                            temp_buffer[current_index] = color_from_emission;
+                            attenuation_buffer[current_index] = attenuation;
+                        }
+                        else {
+                            temp_buffer[current_index] = temp_buffer[current_index] + (attenuation_buffer[current_index] * color_from_emission);
+                            attenuation_buffer[current_index] = attenuation_buffer[current_index] * attenuation;
+                        }
+                        if (current[i].depth + 1 == max_depth) { // reached max depth, replace with next in queue
+                            completeRayQueueTask(current, temp_buffer, full_buffer, queue, mask, i, current_index, binner.get());
+                            continue;
+                        }
+                        double scatter_pdf;
+                        PathSample path = { &sampler, static_cast<uint32_t>(j * image_width + current_index), static_cast<uint32_t>(s), static_cast<uint32_t>(current[i].depth) };
+                        temp_buffer[current_index] += attenuation_buffer[current_index] * directLight(*scene_ptr, mat, record, scattered, path, scatter_pdf);
+                        if (binner) { // not finished depth wise: the ray waits in its bin
+                            binner->push(RayQueue{ current_index, current[i].depth + 1, scattered, scatter_pdf, record.normal });
+                            mask[i] = 0;
+                        } else { // not finished depth wise
+                            current[i].depth += 1;
+                            current[i].r = scattered;
+                            current[i].scatter_pdf = scatter_pdf;
+                            current[i].scatter_normal = record.normal;
                         }
                     }
                 }
+                if (binner) binner->refill(current, mask, queue);
             }
         }
         for (int i=0; i<image_width; ++i) {
             int buffer_index = j * image_width + i;
-            data.buffer[buffer_index] = color(full_buffer[i].x(), full_buffer[i].y(), full_buffer[i].z());
+            color buffer_pixel(full_buffer[i].x(), full_buffer[i].y(), full_buffer[i].z());
+            if (data.first_sample > 0 || data.accumulate) data.buffer[buffer_index] += buffer_pixel;
+            else data.buffer[buffer_index] = buffer_pixel;
         }
-        data.completed_lines += 1;
-        float percentage_completed = ((float)data.completed_lines / (float)data.image_height)*100.00;
-        std::cerr << "[" <<int(percentage_completed) << "%] completed" << std::endl;
+        countRowSamples(data, j);
+        int completed_lines = (data.completed_lines += 1);
+        float percentage_completed = ((float)completed_lines / (float)data.image_height)*100.00;
+        if (!data.accumulate) std::cerr << "[" <<int(percentage_completed) << "%] completed" << std::endl;
     }
+    shade.cache_misses = cache_misses.read();
+    mergeShadeStats(data, shade);
 }
 
 void render_scanlines_avx(int lines, int start_line, std::shared_ptr<Scene> scene_ptr, RenderData& data, Camera cam) {
@@ -220,6 +585,9 @@ void render_scanlines_avx(int lines, int start_line, std::shared_ptr<Scene> scen
     int image_height        = data.image_height;
     int samples_per_pixel   = data.samples_per_pixel;
     int max_depth           = data.max_depth;
+    const Sampler& sampler  = *data.sampler;
+    const MaterialTable& materials = scene_ptr->materials;
+    AOVBuffers* aovs = data.aovs.any() ? &data.aovs : nullptr;
 
     std::vector<color> full_buffer(image_width);
 
@@ -230,18 +598,29 @@ void render_scanlines_avx(int lines, int start_line, std::shared_ptr<Scene> scen
     std::vector<color> attenuation_buffer(image_width);
     std::vector<RayQueue> current(8); // size = 8 only
 
+    ShadeHit hits[8], sorted[8];
+    std::vector<uint32_t> material_counts(materials.materialCount(), 0);
+    ShadeStats shade;
+    CacheMissCounter cache_misses;
+
+    std::unique_ptr<RayBinner> binner;
+    if (data.reorder_rays) {
+        RTCBounds bounds;
+        rtcGetSceneBounds(scene_ptr->rtc_scene, &bounds);
+        binner = std::make_unique<RayBinner>(bounds, 8);
+    }
+
     int mask[8] = {-1, -1, -1, -1, -1, -1, -1, -1};
     
     for (int j=start_line; j>=start_line - (lines - 1); --j) {
+        if (rowExpired(data, j)) continue;
         std::fill(full_buffer.begin(), full_buffer.end(), color(0, 0, 0));
-        for (int s=0; s < samples_per_pixel; s++) {
+        for (int s=data.first_sample; s < samples_per_pixel; s++) {
             std::fill(temp_buffer.begin(), temp_buffer.end(), color(0, 0, 0));
             std::fill(attenuation_buffer.begin(), attenuation_buffer.end(), color(0, 0, 0));
             queue.clear();
             for (int i=image_width-1; i>=0; --i) {
-                auto u = (i + random_double()) / (image_width-1);
-                auto v = (j + random_double()) / (image_height-1);
-                ray r = cam.get_ray(u, v);
+                ray r = cameraRay(cam, sampler, i, j, s, image_width, image_height);
                 RayQueue q = { i, 0, r };
                 queue.push_back(q);
             }
@@ -262,9 +641,12 @@ void render_scanlines_avx(int lines, int start_line, std::shared_ptr<Scene> scen
                     rays.push_back(current[i].r);
                 }
                 setupRayHit8(rayhit, rays);
+                auto intersect_start = std::chrono::steady_clock::now();
                 rtcIntersect8(mask, scene_ptr->rtc_scene, &rayhit);
+                shade.intersect_seconds += secondsSince(intersect_start);
 
                 HitInfo record;
+                int hit_count = 0;
 
                 for (int i=0; i<8; i++) {
                     if (mask[i] == 0) { continue; }
@@ -278,54 +660,85 @@ void render_scanlines_avx(int lines, int start_line, std::shared_ptr<Scene> scen
                     else if (rayhit.hit.geomID[i] != RTC_INVALID_GEOMETRY_ID) {
                         targetID = rayhit.hit.geomID[i]; }
                     else { // no hit
-                        // Sky background (gradient blue-white)
-                        vec3 unit_direction = current_ray.direction().unit_vector();
-                        auto t = 0.5*(unit_direction.y() + 1.0);
-
-                        color multiplier = (1.0-t)*color(1.0, 1.0, 1.0) + t*color(0.5, 0.7, 1.0); // lerp formula (1.0-t)*start + t*endval
+                        color multiplier = environmentRadiance(*scene_ptr, current_ray, current[i].scatter_pdf);
+                        if (current[i].depth == 0 && aovs) aovs->add(j * image_width + current_index, s, multiplier, vec3(0, 0, 0), 0.0f, -1);
                         if (current[i].depth == 0) { temp_buffer[current_index] = multiplier; }
                         else { temp_buffer[current_index] = temp_buffer[current_index] + (attenuation_buffer[current_index] * multiplier); }
-                        completeRayQueueTask(current, temp_buffer, full_buffer, queue, mask, i, current_index);
+                        completeRayQueueTask(current, temp_buffer, full_buffer, queue, mask, i, current_index, binner.get());
                     }
 
                     if (targetID != -1) {
-                        ray scattered;
-                        color attenuation;
-                        std::shared_ptr<Geometry> geomhit = scene_ptr->geom_map[rayhit.hit.geomID[i]];
-                        std::shared_ptr<material> mat_ptr = geomhit->materialById(rayhit.hit.geomID[i]);
-                        record = geomhit->getHitInfo(current_ray, current_ray.at(rayhit.ray.tfar[i]), rayhit.ray.tfar[i], rayhit.hit.geomID[i]);
-                        
-                        color color_from_emission = mat_ptr->emitted(record.u, record.v, record.pos);
-                        if (!mat_ptr->scatter(current_ray, record, attenuation, scattered)) {
-                            if (current[i].depth == 0) { temp_buffer[current_index] = color_from_emission; }
-                            else { temp_buffer[current_index] = temp_buffer[current_index] + (attenuation_buffer[current_index] * color_from_emission); }
-                            completeRayQueueTask(current, temp_buffer, full_buffer, queue, mask, i, current_index);
-                        } else {
-                            if (current[i].depth == 0) {
-                                temp_buffer[current_index] = color_from_emission;
-                                attenuation_buffer[current_index] = attenuation;
-                            }
-                            else {
-                                temp_buffer[current_index] = temp_buffer[current_index] + (attenuation_buffer[current_index] * color_from_emission);
-                                attenuation_buffer[current_index] = attenuation_buffer[current_index] * attenuation;
-                            }
-                            if (current[i].depth + 1 == max_depth) { // reached max depth, replace with next in queue
-                                completeRayQueueTask(current, temp_buffer, full_buffer, queue, mask, i, current_index);
-                            } else { // not finished depth wise
-                                current[i].depth += 1;
-                                current[i].r = scattered;
-                            }
+                        hits[hit_count++] = ShadeHit{ i, targetID, materials.lookup(targetID, rayhit.hit.primID[i]) };
+                    }
+                }
+
+                // Shade the hits grouped by material, so lanes that share a material (and so its texture) run back to back.
+                int unique_materials = sortByMaterial(hits, hit_count, sorted, material_counts);
+                shade.record(hits, hit_count, unique_materials);
+                for (int h=0; h<hit_count; h++) {
+                    int i = sorted[h].lane;
+                    int targetID = sorted[h].targetID;
+                    uint32_t mat = sorted[h].mat;
+                    ray current_ray = current[i].r;
+                    int current_index = current[i].index;
+                    ray scattered;
+                    color attenuation;
+                    std::shared_ptr<Geometry> geomhit = scene_ptr->geom_map[targetID];
+                    record = geomhit->getHitInfo(current_ray, current_ray.at(rayhit.ray.tfar[i]), rayhit.ray.tfar[i], targetID, rayhit.hit.primID[i]);
+                    
+                    color color_from_emission = hitEmission(*scene_ptr, mat, record, current_ray, targetID, rayhit.hit.primID[i],
+                                                            current[i].scatter_pdf, current[i].scatter_normal);
+                    ScatterSample sample = sampler.scatter(j * image_width + current_index, s, current[i].depth);
+                    bool scatters = materials.scatter(mat, current_ray, record, sample, attenuation, scattered);
+                    if (current[i].depth == 0 && aovs) {
+                        aovs->add(j * image_width + current_index, s, scatters ? attenuation : color(1, 1, 1), record.normal,
+                                    rayhit.ray.tfar[i] * current_ray.direction().length(), targetID);
+                    }
+                    if (!scatters) {
+                        if (current[i].depth == 0) { temp_buffer[current_index] = color_from_emission; }
+                        else { temp_buffer[current_index] = temp_buffer[current_index] + (attenuation_buffer[current_index] * color_from_emission); }
+                        completeRayQueueTask(current, temp_buffer, full_buffer, queue, mask, i, current_index, binner.get());
+                    } else {
+                        if (current[i].depth == 0) {
+                            temp_buffer[current_index] = color_from_emission;
+                            attenuation_buffer[current_index] = attenuation;
+                        }
+                        else {
+                            temp_buffer[current_index] = temp_buffer[current_index] + (attenuation_buffer[current_index] * color_from_emission);
+                            attenuation_buffer[current_index] = attenuation_buffer[current_index] * attenuation;
+                        }
+                        if (current[i].depth + 1 == max_depth) { // reached max depth, replace with next in queue
+                            completeRayQueueTask(current, temp_buffer, full_buffer, queue, mask, i, current_index, binner.get());
+                            continue;
+                        }
+                        double scatter_pdf;
+                        PathSample path = { &sampler, static_cast<uint32_t>(j * image_width + current_index), static_cast<uint32_t>(s), static_cast<uint32_t>(current[i].depth) };
+                        temp_buffer[current_index] += attenuation_buffer[current_index] * directLight(*scene_ptr, mat, record, scattered, path, scatter_pdf);
+                        if (binner) { // not finished depth wise: the ray waits in its bin
+                            binner->push(RayQueue{ current_index, current[i].depth + 1, scattered, scatter_pdf, record.normal });
+                            mask[i] = 0;
+                        } else { // not finished depth wise
+                            current[i].depth += 1;
+                            current[i].r = scattered;
+                            current[i].scatter_pdf = scatter_pdf;
+                            current[i].scatter_normal = record.normal;
                         }
                     }
                 }
+                if (binner) binner->refill(current, mask, queue);
             }
         }
         for (int i=0; i<image_width; ++i) {
             int buffer_index = j * image_width + i;
-            data.buffer[buffer_index] = color(full_buffer[i].x(), full_buffer[i].y(), full_buffer[i].z());
+            color buffer_pixel(full_buffer[i].x(), full_buffer[i].y(), full_buffer[i].z());
+            if (data.first_sample > 0 || data.accumulate) data.buffer[buffer_index] += buffer_pixel;
+            else data.buffer[buffer_index] = buffer_pixel;
         }
-        data.completed_lines += 1;
-        float percentage_completed = ((float)data.completed_lines / (float)data.image_height)*100.00;
-        std::cerr << "[" <<int(percentage_completed) << "%] completed" << std::endl;
+        countRowSamples(data, j);
+        int completed_lines = (data.completed_lines += 1);
+        float percentage_completed = ((float)completed_lines / (float)data.image_height)*100.00;
+        if (!data.accumulate) std::cerr << "[" <<int(percentage_completed) << "%] completed" << std::endl;
     }
+    shade.cache_misses = cache_misses.read();
+    mergeShadeStats(data, shade);
 }
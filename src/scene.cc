@@ -1,9 +1,47 @@
 #include "scene.h"
 #include <embree4/rtcore.h>
+#include "thread_pool.hh"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+RTCBuildQuality parseBuildQuality(const std::string& name) {
+    if (name == "low") return RTC_BUILD_QUALITY_LOW;
+    if (name == "medium") return RTC_BUILD_QUALITY_MEDIUM;
+    if (name == "high") return RTC_BUILD_QUALITY_HIGH;
+    throw std::invalid_argument("Unknown build quality '" + name + "' [low|medium|high]");
+}
+
+RTCSceneFlags parseSceneFlags(const std::string& names) {
+    std::string list = names;
+    std::replace(list.begin(), list.end(), ',', ' ');
+    std::istringstream in(list);
+    int flags = RTC_SCENE_FLAG_NONE;
+    std::string name;
+    while (in >> name) {
+        if (name == "compact") flags |= RTC_SCENE_FLAG_COMPACT;
+        else if (name == "robust") flags |= RTC_SCENE_FLAG_ROBUST;
+        else if (name == "dynamic") flags |= RTC_SCENE_FLAG_DYNAMIC;
+        else if (name != "none") throw std::invalid_argument("Unknown scene flag '" + name + "' [compact|robust|dynamic|none]");
+    }
+    return static_cast<RTCSceneFlags>(flags);
+}
 
 Scene::Scene(RTCDevice device, Camera cam) : cam{cam}, rtc_scene{rtcNewScene(device)} {
-    rtcSetSceneBuildQuality(rtc_scene, RTC_BUILD_QUALITY_HIGH);
-    rtcSetSceneFlags(rtc_scene, RTC_SCENE_FLAG_DYNAMIC);
+    rtcSetSceneBuildQuality(rtc_scene, build.quality);
+    rtcSetSceneFlags(rtc_scene, build.flags);
+}
+
+void Scene::setBuildSettings(const BuildSettings& settings) {
+    build = settings;
+    rtcSetSceneBuildQuality(rtc_scene, build.quality);
+    rtcSetSceneFlags(rtc_scene, build.flags);
+    for (auto& entry : geom_map) {
+        rtcSetGeometryBuildQuality(entry.second->geom, build.quality);
+        rtcCommitGeometry(entry.second->geom);
+    }
 }
 
 Scene::~Scene() {
@@ -11,6 +49,10 @@ Scene::~Scene() {
 }
 
 unsigned int Scene::add_primitive(std::shared_ptr<Primitive> prim) {
+    if (build.quality != RTC_BUILD_QUALITY_HIGH) { // primitives are built at HIGH quality
+        rtcSetGeometryBuildQuality(prim->geom, build.quality);
+        rtcCommitGeometry(prim->geom);
+    }
     unsigned int primID = rtcAttachGeometry(rtc_scene, prim->geom);
     rtcReleaseGeometry(prim->geom);
 
@@ -28,10 +70,89 @@ unsigned int Scene::add_primitive_instance(std::shared_ptr<PrimitiveInstance> pi
     rtcReleaseGeometry(instance_geom);
 
     geom_map[primID] = pi_ptr->pptr;
+    instances.push_back(InstanceRecord{ instance_geom, pi_ptr, vec3(pi_ptr->transform[3], pi_ptr->transform[7], pi_ptr->transform[11]) });
     return primID;
 }
 
-void Scene::commitScene() { rtcCommitScene(rtc_scene); }
+static bool samePosition(const vec3& a, const vec3& b) {
+    return a.x() == b.x() && a.y() == b.y() && a.z() == b.z();
+}
+
+bool Scene::isAnimated() const {
+    return !camera_keys.empty() || !instance_keys.empty() || !sphere_keys.empty();
+}
+
+int Scene::frameCount() const {
+    double last = 0;
+    if (!camera_keys.empty()) last = std::max(last, camera_keys.back().frame);
+    for (const auto& track : instance_keys) last = std::max(last, track.second.back().frame);
+    for (const auto& track : sphere_keys) last = std::max(last, track.second.back().frame);
+    return static_cast<int>(std::ceil(last)) + 1;
+}
+
+Camera Scene::setFrame(double frame) {
+    bool moved = false;
+
+    for (const auto& track : instance_keys) {
+        if (track.first >= instances.size()) continue;
+        InstanceRecord& record = instances[track.first];
+        vec3 translate = interpolate(track.second, frame);
+        if (samePosition(translate, record.translate)) continue;
+
+        float transform[12] = {
+            1, 0, 0, translate.x(),
+            0, 1, 0, translate.y(),
+            0, 0, 1, translate.z()
+        };
+        rtcSetGeometryTransform(record.geom, 0, RTC_FORMAT_FLOAT3X4_ROW_MAJOR, transform);
+        rtcCommitGeometry(record.geom);
+        record.instance->setTranslation(translate);
+        record.translate = translate;
+        moved = true;
+    }
+
+    for (const auto& track : sphere_keys) {
+        auto sphere = animated_spheres.find(track.first);
+        if (sphere == animated_spheres.end()) continue;
+        vec3 center = interpolate(track.second, frame);
+        if (samePosition(center, sphere->second->position)) continue;
+        sphere->second->setCenter(center);
+        moved = true;
+    }
+
+    if (moved) {
+        // Only the moved geometry changes between frames: refit its BVH and rebuild the top level quickly.
+        if (!refit_mode) {
+            rtcSetSceneBuildQuality(rtc_scene, RTC_BUILD_QUALITY_LOW);
+            refit_mode = true;
+        }
+        commitScene();
+    }
+
+    if (camera_keys.empty()) return cam;
+    return interpolate(camera_keys, frame, cam.getAspectRatio());
+}
+
+void Scene::commitScene() {
+    auto build_start = std::chrono::steady_clock::now();
+    ThreadPool& pool = ThreadPool::shared();
+    std::vector<std::future<void>> joined;
+    for (int i = 0; i < pool.size(); ++i) {
+        joined.push_back(pool.submit([this]() { rtcJoinCommitScene(rtc_scene); }));
+    }
+    rtcJoinCommitScene(rtc_scene);
+    for (auto& join : joined) join.get();
+    bvh_build_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - build_start).count();
+
+    for (auto& load : pending_loads) load.get();
+    pending_loads.clear();
+
+    if (!refit_mode) materials.compile(geom_map); // materials never change between animation frames
+
+    std::vector<LightShape> emitters;
+    for (const auto& entry : geom_map) entry.second->collectLights(materials, entry.first, emitters);
+    lights.build(std::move(emitters));
+}
 void Scene::releaseScene() { rtcReleaseScene(rtc_scene); }
 
 void add_sphere(RTCDevice device, RTCScene scene) {
@@ -0,0 +1,268 @@
+#include "render_server.hh"
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <csignal>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include "csr_parser.hh"
+#include "device.h"
+#include "hash.hh"
+#include "output.h"
+
+bool RenderJob::hasCameraOverride() const {
+    return lookfrom || lookat || vup || vfov || aperture || focus_dist;
+}
+
+RenderJob parseRenderJob(const std::string& request) {
+    RenderJob job;
+    std::istringstream lines(request);
+    std::string line;
+
+    auto readXYZ = [](std::istringstream& in, const std::string& key) {
+        float x, y, z;
+        if (!(in >> x >> y >> z)) throw std::invalid_argument("Invalid value for job key: " + key);
+        return vec3(x, y, z);
+    };
+    auto readNumber = [](std::istringstream& in, const std::string& key, double min, double max) {
+        double d;
+        if (!(in >> d) || !(d >= min && d <= max)) throw std::invalid_argument("Invalid value for job key: " + key);
+        return d;
+    };
+
+    while (std::getline(lines, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream in(line);
+        std::string key;
+        in >> key;
+
+        if (key == "scene") in >> job.scene;
+        else if (key == "resolution") {
+            int w, h;
+            if (!(in >> w >> h) || w <= 0 || h <= 0) throw std::invalid_argument("Invalid value for job key: resolution");
+            job.image_width = w; job.image_height = h;
+        } else if (key == "samples") {
+            int s;
+            if (!(in >> s) || s <= 0) throw std::invalid_argument("Invalid value for job key: samples");
+            job.samples_per_pixel = s;
+        } else if (key == "depth") {
+            int d;
+            if (!(in >> d) || d <= 0) throw std::invalid_argument("Invalid value for job key: depth");
+            job.max_depth = d;
+        } else if (key == "output") {
+            std::string path; in >> path; job.outputPath = path;
+        } else if (key == "type") {
+            std::string type; in >> type;
+            if (type != "ppm" && type != "png" && type != "jpg") throw std::invalid_argument("Invalid value for job key: type");
+            job.outputType = type;
+        }
+        else if (key == "lookfrom") job.lookfrom = readXYZ(in, key);
+        else if (key == "lookat") job.lookat = readXYZ(in, key);
+        else if (key == "vup") job.vup = readXYZ(in, key);
+        else if (key == "vfov") job.vfov = readNumber(in, key, 1e-6, 179.999);
+        else if (key == "aperture") job.aperture = readNumber(in, key, 0.0, 1e30);
+        else if (key == "focus_dist") job.focus_dist = readNumber(in, key, 1e-6, 1e30);
+        else throw std::invalid_argument("Unknown job key: " + key);
+    }
+
+    if (job.scene.empty()) throw std::invalid_argument("Job is missing a scene path.");
+    return job;
+}
+
+RenderServer::RenderServer(const Config& base_config) : base_config{base_config}, device{initializeDevice(deviceConfigString(base_config))} {
+    if (!device) throw std::runtime_error("Could not create render device.");
+}
+
+RenderServer::~RenderServer() {
+    // Scenes hold their own reference to the device, so release them before the device.
+    cache.clear();
+    lru.clear();
+    if (listen_fd != -1) {
+        close(listen_fd);
+        unlink(base_config.serverSocket.c_str());
+    }
+    rtcReleaseDevice(device);
+}
+
+// Hash of the path, size and modification time of every asset, so an edited texture or mesh changes it.
+static uint64_t assetStamp(const std::vector<std::string>& paths) {
+    uint64_t stamp = fnv1a64(nullptr, 0);
+    for (const std::string& path : paths) {
+        struct stat info;
+        int64_t fields[3] = { -1, -1, -1 }; // missing files stamp as -1
+        if (stat(path.c_str(), &info) == 0) {
+            fields[0] = static_cast<int64_t>(info.st_size);
+            fields[1] = static_cast<int64_t>(info.st_mtim.tv_sec);
+            fields[2] = static_cast<int64_t>(info.st_mtim.tv_nsec);
+        }
+        stamp = fnv1a64(path.data(), path.size(), stamp);
+        stamp = fnv1a64(fields, sizeof(fields), stamp);
+    }
+    return stamp;
+}
+
+std::shared_ptr<Scene> RenderServer::acquireScene(const std::string& path, bool& was_cached, RenderStats& stats) {
+    uint64_t hash = hashFile(path);
+
+    auto found = cache.find(hash);
+    if (found != cache.end()) {
+        if (assetStamp(found->second->scene->asset_paths) == found->second->asset_stamp) {
+            lru.splice(lru.begin(), lru, found->second); // mark as most recently used
+            was_cached = true;
+            return found->second->scene;
+        }
+        // An asset changed since the scene was parsed: drop it and parse again.
+        lru.erase(found->second);
+        cache.erase(found);
+    }
+
+    // parseCSR releases the device when it throws, so hand it a reference of its own.
+    std::string filePath = path;
+    CSRParser parser;
+    rtcRetainDevice(device);
+    auto parse_start = std::chrono::steady_clock::now();
+    auto scene_ptr = parser.parseCSR(filePath, device);
+    stats.parse_seconds = secondsSince(parse_start);
+    stats.mesh_load_seconds = scene_ptr->mesh_load_seconds;
+    stats.mesh_triangles = scene_ptr->mesh_triangles;
+    rtcReleaseDevice(device);
+
+    if (!base_config.buildQuality.empty() || !base_config.sceneFlags.empty()) scene_ptr->setBuildSettings(buildSettings(base_config, scene_ptr->build));
+    auto commit_start = std::chrono::steady_clock::now();
+    scene_ptr->commitScene();
+    stats.commit_seconds = secondsSince(commit_start);
+    stats.bvh_build_seconds = scene_ptr->bvh_build_seconds;
+    stats.bvh_bytes = deviceMemoryBytes();
+    stats.bvh_peak_bytes = deviceMemoryPeakBytes();
+    stats.lights = scene_ptr->lights.size();
+    stats.light_bvh_seconds = scene_ptr->lights.build_seconds;
+    stats.light_bvh_bytes = scene_ptr->lights.memoryBytes();
+    was_cached = false;
+
+    lru.push_front(CachedScene{hash, scene_ptr, assetStamp(scene_ptr->asset_paths)});
+    cache[hash] = lru.begin();
+    while ((int)lru.size() > base_config.serverCacheSize) {
+        cache.erase(lru.back().hash);
+        lru.pop_back();
+    }
+    return scene_ptr;
+}
+
+std::string RenderServer::handleJob(const RenderJob& job) {
+    Config config = base_config;
+    config.inputFile = job.scene;
+    if (job.image_width) config.image_width = *job.image_width;
+    if (job.image_height) config.image_height = *job.image_height;
+    if (job.samples_per_pixel) config.samples_per_pixel = *job.samples_per_pixel;
+    if (job.max_depth) config.max_depth = *job.max_depth;
+    if (job.outputPath) config.outputPath = *job.outputPath;
+    if (job.outputType) config.outputType = *job.outputType;
+
+    RenderData render_data;
+    const auto aspect_ratio = static_cast<float>(config.image_width) / config.image_height;
+    setRenderData(render_data, aspect_ratio, config.image_width, config.samples_per_pixel, config.max_depth);
+
+    bool was_cached;
+    auto scene_ptr = acquireScene(job.scene, was_cached, render_data.stats);
+
+    // The cached scene is shared between jobs, so overrides go into a copy of its camera. A job at a
+    // resolution of another shape needs one too, or the image would be stretched.
+    Camera cam = scene_ptr->cam;
+    if (job.hasCameraOverride() || std::abs(cam.getAspectRatio() - aspect_ratio) > 1e-6) {
+        cam = Camera(job.lookfrom.value_or(cam.getLookfrom()), job.lookat.value_or(cam.getLookat()),
+                     job.vup.value_or(cam.getVup()), job.vfov.value_or(cam.getVfov()), aspect_ratio,
+                     job.aperture.value_or(cam.getAperture()), job.focus_dist.value_or(cam.getFocusDist()));
+    }
+
+    auto start_time = std::chrono::high_resolution_clock::now();
+    output(render_data, cam, scene_ptr, config);
+    auto elapsed_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start_time).count();
+
+    std::ostringstream reply;
+    reply << "ok " << elapsed_time / 1000.0 << (was_cached ? " cached" : " parsed");
+    return reply.str();
+}
+
+void RenderServer::serveConnection(int client_fd, bool& shutdown) {
+    // Read until an empty line (or the client closes its end). A client that stops sending times
+    // out instead of blocking every other client forever.
+    timeval timeout{};
+    timeout.tv_sec = REQUEST_TIMEOUT_SECONDS;
+    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    std::string request;
+    char chunk[4096];
+    ssize_t n;
+    bool timed_out = false;
+    while (true) {
+        n = read(client_fd, chunk, sizeof(chunk));
+        if (n == -1 && errno == EINTR) continue;
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) timed_out = true;
+        if (n <= 0) break;
+        request.append(chunk, n);
+        if (request.find("\n\n") != std::string::npos) break;
+    }
+
+    std::string first_line = request.substr(0, request.find('\n'));
+    const char* blank = " \t\r";
+    first_line.erase(first_line.find_last_not_of(blank) + 1);
+    first_line.erase(0, first_line.find_first_not_of(blank));
+
+    std::string reply;
+    if (timed_out) {
+        reply = "error timed out waiting for the request";
+    } else if (first_line == "shutdown") {
+        shutdown = true;
+        reply = "ok shutdown";
+    } else {
+        try {
+            reply = handleJob(parseRenderJob(request));
+        } catch (const std::exception& e) {
+            reply = std::string("error ") + e.what();
+        }
+    }
+    if (base_config.verbose) std::cerr << "[server] " << reply << std::endl;
+
+    reply += "\n";
+    ssize_t written = write(client_fd, reply.data(), reply.size());
+    (void)written; // a client that hung up early is not an error for the server
+}
+
+void RenderServer::run() {
+    const std::string& path = base_config.serverSocket;
+
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) throw std::invalid_argument("Socket path is too long: " + path);
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd == -1) throw std::runtime_error("Could not create socket: " + std::string(std::strerror(errno)));
+
+    unlink(path.c_str()); // remove a stale socket left by a previous server
+    if (bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1 || listen(listen_fd, 16) == -1) {
+        throw std::runtime_error("Could not listen on " + path + ": " + std::strerror(errno));
+    }
+
+    std::signal(SIGPIPE, SIG_IGN);
+    std::cerr << "caitlyn render server listening on " << path << std::endl;
+
+    bool shutdown = false;
+    while (!shutdown) {
+        int client_fd = accept(listen_fd, nullptr, nullptr);
+        if (client_fd == -1) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("accept failed: " + std::string(std::strerror(errno)));
+        }
+        serveConnection(client_fd, shutdown);
+        close(client_fd);
+    }
+}
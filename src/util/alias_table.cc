@@ -0,0 +1,39 @@
+#include "alias_table.hh"
+#include <stdexcept>
+
+void AliasTable::build(const std::vector<double>& weights) {
+    if (weights.empty()) throw std::invalid_argument("AliasTable needs at least one weight");
+    size_t n = weights.size();
+    sum = 0;
+    for (double w : weights) {
+        if (!(w >= 0)) throw std::invalid_argument("AliasTable weights must be non-negative");
+        sum += w;
+    }
+
+    entries.assign(n, Entry{ 1.0f, 0, 1.0 / n });
+    for (size_t i = 0; i < n; ++i) entries[i].alias = static_cast<uint32_t>(i);
+    if (sum <= 0) return;
+
+    // Scale so the average is 1, then pair every under-full entry with an over-full one.
+    std::vector<double> scaled(n);
+    std::vector<uint32_t> small, large;
+    for (size_t i = 0; i < n; ++i) {
+        entries[i].pdf = weights[i] / sum;
+        scaled[i] = weights[i] / sum * n;
+        (scaled[i] < 1 ? small : large).push_back(static_cast<uint32_t>(i));
+    }
+    while (!small.empty() && !large.empty()) {
+        uint32_t s = small.back(); small.pop_back();
+        uint32_t l = large.back();
+        entries[s].prob = static_cast<float>(scaled[s]);
+        entries[s].alias = l;
+        scaled[l] -= 1 - scaled[s];
+        if (scaled[l] < 1) {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+    // Whatever is left is 1 up to rounding.
+    for (uint32_t i : large) entries[i].prob = 1.0f;
+    for (uint32_t i : small) entries[i].prob = 1.0f;
+}
@@ -1,15 +1,33 @@
 #include "device.h"
+#include <atomic>
+
+static std::atomic<long long> device_bytes{0};
+static std::atomic<long long> device_peak_bytes{0};
 
 void errorFunction(void* userPtr, enum RTCError error, const char* str) {
     std::cout << "error " << error << ": " << str << std::endl;
 }
 
-RTCDevice initializeDevice() {
-  RTCDevice device = rtcNewDevice(NULL);
+// Called by Embree with the size of every allocation (positive) and free (negative), possibly from several
+// threads at once. Accumulating the sizes tracks current usage; returning true lets every allocation go ahead.
+static bool memoryMonitor(void* userPtr, ssize_t bytes, bool post) {
+    long long now = device_bytes.fetch_add(bytes) + bytes;
+    long long peak = device_peak_bytes.load();
+    while (now > peak && !device_peak_bytes.compare_exchange_weak(peak, now)) {}
+    return true;
+}
+
+RTCDevice initializeDevice(const std::string& config) {
+  RTCDevice device = rtcNewDevice(config.empty() ? NULL : config.c_str());
 
   if (!device)
     std::cout << "error " << rtcGetDeviceError(NULL) << ": cannot create device" << std::endl;
 
   rtcSetDeviceErrorFunction(device, errorFunction, NULL);
+  rtcSetDeviceMemoryMonitorFunction(device, memoryMonitor, NULL);
   return device;
 }
+
+long long deviceMemoryBytes() { return device_bytes.load(); }
+
+long long deviceMemoryPeakBytes() { return device_peak_bytes.load(); }
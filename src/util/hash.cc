@@ -0,0 +1,37 @@
+#include "hash.hh"
+
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+uint64_t fnv1a64(const void* data, size_t size, uint64_t seed) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+uint64_t hashFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) throw std::runtime_error("Could not open file: " + path);
+
+    uint64_t hash = 14695981039346656037ULL;
+    std::vector<char> chunk(1 << 16);
+    while (file.read(chunk.data(), chunk.size()) || file.gcount() > 0) {
+        hash = fnv1a64(chunk.data(), file.gcount(), hash);
+    }
+    return hash;
+}
+
+std::string hashToHex(uint64_t hash) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(16, '0');
+    for (int i = 15; i >= 0; --i) {
+        hex[i] = digits[hash & 0xf];
+        hash >>= 4;
+    }
+    return hex;
+}
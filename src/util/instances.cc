@@ -4,6 +4,10 @@ Instance::Instance(float* transform) : transform{transform} {}
 
 PrimitiveInstance::PrimitiveInstance(float* transform) : Instance(transform) {}
 
+void PrimitiveInstance::setTranslation(const vec3& translate) {
+    pptr->position = origin + translate;
+}
+
 SpherePrimitiveInstance::SpherePrimitiveInstance(std::shared_ptr<SpherePrimitive> sprim, float* transform, RTCDevice device) : PrimitiveInstance(transform) {
     instance_scene = rtcNewScene(device);
     unsigned int geomID = rtcAttachGeometry(instance_scene, sprim->geom);
@@ -11,7 +15,8 @@ SpherePrimitiveInstance::SpherePrimitiveInstance(std::shared_ptr<SpherePrimitive
     rtcCommitScene(instance_scene);
 
     vec3 translate = vec3(transform[3], transform[7], transform[11]);
-    pptr = make_shared<SpherePrimitive>(sprim->position + translate, sprim->mat_ptr, 1, device);
+    origin = sprim->position;
+    pptr = make_shared<SpherePrimitive>(sprim->position + translate, sprim->mat_ptr, sprim->radius, device);
 }
 
 QuadPrimitiveInstance::QuadPrimitiveInstance(std::shared_ptr<QuadPrimitive> sprim, float* transform, RTCDevice device) : PrimitiveInstance(transform) {
@@ -21,6 +26,7 @@ QuadPrimitiveInstance::QuadPrimitiveInstance(std::shared_ptr<QuadPrimitive> spri
     rtcCommitScene(instance_scene);
 
     vec3 translate = vec3(transform[3], transform[7], transform[11]);
+    origin = sprim->position;
     vec3 u = sprim->getU();
     vec3 v = sprim->getV();
     pptr = make_shared<QuadPrimitive>(sprim->position + translate, u, v, sprim->mat_ptr, device);
@@ -33,6 +39,7 @@ BoxPrimitiveInstance::BoxPrimitiveInstance(std::shared_ptr<BoxPrimitive> sprim,
     rtcCommitScene(instance_scene);
 
     vec3 translate = vec3(transform[3], transform[7], transform[11]);
+    origin = sprim->position;
     vec3 a = sprim->getA();
     vec3 b = sprim->getB();
     vec3 c = sprim->getC();
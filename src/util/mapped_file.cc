@@ -0,0 +1,40 @@
+#include "mapped_file.hh"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+MappedFile::MappedFile(const std::string& path) : file_path{path} {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) throw std::runtime_error("Could not open file: " + path);
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        throw std::runtime_error("Could not stat file: " + path);
+    }
+    mapped_size = st.st_size;
+
+    // mmap rejects zero-length mappings; an empty file simply has no data.
+    if (mapped_size > 0) {
+        void* ptr = mmap(nullptr, mapped_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (ptr == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("Could not map file: " + path + " (" + std::strerror(errno) + ")");
+        }
+        mapped = static_cast<const char*>(ptr);
+    }
+    close(fd); // the mapping keeps its own reference to the file
+}
+
+MappedFile::~MappedFile() {
+    if (mapped) munmap(const_cast<char*>(mapped), mapped_size);
+}
+
+const char* MappedFile::data() const { return mapped; }
+size_t MappedFile::size() const { return mapped_size; }
+const std::string& MappedFile::path() const { return file_path; }
@@ -0,0 +1,113 @@
+#include "path_guide.hh"
+#include "general.h"
+#include <algorithm>
+#include <cmath>
+
+// A region is split once it recorded more than SPLIT_SAMPLES * sqrt(2^iteration) samples in a pass, the
+// threshold of Mueller et al.: passes double, so a region splits about every second pass under steady light.
+static const double SPLIT_SAMPLES = 2000;
+
+void PathGuide::Region::clear() {
+    for (int i = 0; i < BINS; ++i) bins[i].store(0.0f, std::memory_order_relaxed);
+    samples.store(0, std::memory_order_relaxed);
+}
+
+PathGuide::PathGuide(const point3& lower, const point3& upper) {
+    auto root = std::make_unique<Region>();
+    root->clear();
+    root->lower = lower;
+    root->upper = upper;
+    regions.push_back(std::move(root));
+    nodes.push_back(Node{ -1, 0.0f, -1, 0 });
+}
+
+int PathGuide::regionAt(const point3& p) const {
+    const Node* node = &nodes[0];
+    while (node->axis >= 0) {
+        node = &nodes[node->children + (p[node->axis] < node->split ? 0 : 1)];
+    }
+    return node->region;
+}
+
+int PathGuide::binOf(const vec3& direction) {
+    double cos_theta = std::clamp(static_cast<double>(direction.y()), -1.0, 1.0);
+    double phi = std::atan2(direction.z(), direction.x()) + pi;
+    int x = std::clamp(static_cast<int>((cos_theta + 1) * 0.5 * RESOLUTION), 0, RESOLUTION - 1);
+    int y = std::clamp(static_cast<int>(phi / (2*pi) * RESOLUTION), 0, RESOLUTION - 1);
+    return y * RESOLUTION + x;
+}
+
+vec3 PathGuide::sample(int region, double u, double v) const {
+    double remapped;
+    uint32_t bin = regions[region]->table.sample(u, remapped);
+    double cos_theta = 2.0 * ((bin % RESOLUTION) + remapped) / RESOLUTION - 1.0;
+    double phi = 2*pi * ((bin / RESOLUTION) + v) / RESOLUTION - pi;
+    double sin_theta = std::sqrt(std::max(0.0, 1.0 - cos_theta*cos_theta));
+    return vec3(sin_theta * std::cos(phi), cos_theta, sin_theta * std::sin(phi));
+}
+
+double PathGuide::pdf(int region, const vec3& direction) const {
+    return regions[region]->table.pdf(binOf(direction)) * BINS / (4*pi);
+}
+
+void PathGuide::record(int region, const vec3& direction, double radiance, double pdf) {
+    if (!(pdf > 0) || !std::isfinite(radiance) || radiance < 0) return;
+    std::atomic<float>& bin = regions[region]->bins[binOf(direction)];
+    float value = static_cast<float>(radiance / pdf);
+    float current = bin.load(std::memory_order_relaxed);
+    while (!bin.compare_exchange_weak(current, current + value, std::memory_order_relaxed)) {}
+    regions[region]->samples.fetch_add(1, std::memory_order_relaxed);
+}
+
+void PathGuide::update() {
+    const double split_threshold = SPLIT_SAMPLES * std::sqrt(std::pow(2.0, iteration));
+    std::vector<double> weights(BINS);
+    size_t leaves = nodes.size();
+    for (size_t n = 0; n < leaves; ++n) {
+        if (nodes[n].axis >= 0) continue;
+        Region& region = *regions[nodes[n].region];
+        uint32_t samples = region.samples.load(std::memory_order_relaxed);
+
+        // Regions that saw too little keep what they had (their parent's distribution after a split).
+        if (samples >= static_cast<uint32_t>(MIN_SAMPLES)) {
+            double total = 0;
+            for (int i = 0; i < BINS; ++i) total += weights[i] = region.bins[i].load(std::memory_order_relaxed);
+            if (total > 0) {
+                // A small uniform floor keeps directions that were never sampled reachable from the guide.
+                for (double& w : weights) w += 0.01 * total / BINS;
+                region.table.build(weights);
+                region.trained = true;
+            }
+        }
+
+        if (samples > split_threshold && regions.size() + 1 <= MAX_REGIONS) {
+            vec3 extent = region.upper - region.lower;
+            int axis = extent.x() >= extent.y() && extent.x() >= extent.z() ? 0 : (extent.y() >= extent.z() ? 1 : 2);
+            float split = 0.5f * (region.lower[axis] + region.upper[axis]);
+
+            auto right = std::make_unique<Region>();
+            right->clear();
+            right->table = region.table;
+            right->trained = region.trained;
+            right->lower = region.lower;
+            right->upper = region.upper;
+            right->lower[axis] = split;
+            region.upper[axis] = split;
+
+            int left_region = nodes[n].region;
+            int right_region = static_cast<int>(regions.size());
+            regions.push_back(std::move(right));
+            int children = static_cast<int>(nodes.size());
+            nodes.push_back(Node{ -1, 0.0f, -1, left_region });
+            nodes.push_back(Node{ -1, 0.0f, -1, right_region });
+            nodes[n] = Node{ axis, split, children, -1 };
+        }
+    }
+    for (auto& region : regions) region->clear();
+    iteration += 1;
+}
+
+size_t PathGuide::memoryBytes() const {
+    size_t per_region = sizeof(Region) + BINS * (sizeof(std::atomic<float>) + 16); // bins plus alias table entries
+    return nodes.size() * sizeof(Node) + regions.size() * per_region;
+}
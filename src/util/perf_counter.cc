@@ -0,0 +1,41 @@
+#include "perf_counter.hh"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#include <cstdint>
+
+CacheMissCounter::CacheMissCounter() {
+    struct perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    // pid 0, cpu -1: this thread, on whichever CPU it runs.
+    fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+    if (fd != -1) ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+}
+
+CacheMissCounter::~CacheMissCounter() {
+    if (fd != -1) close(fd);
+}
+
+long long CacheMissCounter::read() const {
+    uint64_t count = 0;
+    if (fd == -1 || ::read(fd, &count, sizeof(count)) != sizeof(count)) return -1;
+    return static_cast<long long>(count);
+}
+
+#else
+
+CacheMissCounter::CacheMissCounter() {}
+CacheMissCounter::~CacheMissCounter() {}
+long long CacheMissCounter::read() const { return -1; }
+
+#endif
@@ -0,0 +1,135 @@
+#include "radiance_cache.hh"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+
+CacheQuality parseCacheQuality(const std::string& name) {
+    if (name == "off") return CacheQuality::Off;
+    if (name == "preview") return CacheQuality::Preview;
+    if (name == "final") return CacheQuality::Final;
+    throw std::invalid_argument("Unknown radiance cache quality '" + name + "' [off|preview|final]");
+}
+
+// Fixed-point scale of the sums, and the clamp applied to every sample before it is added.
+static const double FIXED_ONE = 1 << 20;
+static const double MAX_RADIANCE = 64.0;
+
+// Slots tried after the home slot before giving up on a key.
+static const int MAX_PROBES = 16;
+
+// Cell coordinates are kept to 20 bits each (wrapping far outside the scene).
+static const int COORD_BITS = 20;
+
+static uint64_t mix64(uint64_t x) {
+    // splitmix64 finaliser
+    x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+// Index into the lookup counters for the calling thread, picked once per thread.
+static int counterIndex(int counters) {
+    thread_local int index = static_cast<int>(std::hash<std::thread::id>()(std::this_thread::get_id()) % counters);
+    return index;
+}
+
+RadianceCache::RadianceCache(CacheQuality quality, double cell_size, int log2_entries)
+    : entries(new Entry[size_t(1) << log2_entries]), mask((uint64_t(1) << log2_entries) - 1),
+      cell_size(cell_size), inv_cell_size(1.0 / cell_size) {
+    if (cell_size <= 0) throw std::invalid_argument("Radiance cache cell size must be positive");
+    for (uint64_t i = 0; i <= mask; ++i) {
+        for (auto& s : entries[i].sum) s.store(0, std::memory_order_relaxed);
+    }
+    // Preview ends paths at the first bounce and trusts thinner cells; final traces the first bounce exactly,
+    // so cell edges are blurred by it, and trains longer.
+    if (quality == CacheQuality::Preview) {
+        first_bounce = 1;
+        min_samples = 4;
+        training_fraction = 0.125;
+    } else {
+        first_bounce = 2;
+        min_samples = 16;
+        training_fraction = 0.25;
+    }
+}
+
+uint64_t RadianceCache::keyOf(const point3& p, const vec3& n) const {
+    const uint64_t coord_mask = (uint64_t(1) << COORD_BITS) - 1;
+    uint64_t key = 0;
+    for (int a = 0; a < 3; ++a) {
+        int64_t cell = static_cast<int64_t>(std::floor(p[a] * inv_cell_size));
+        key = (key << COORD_BITS) | (static_cast<uint64_t>(cell) & coord_mask);
+    }
+    float ax = std::fabs(n.x()), ay = std::fabs(n.y()), az = std::fabs(n.z());
+    int axis = (ax >= ay && ax >= az) ? 0 : (ay >= az ? 1 : 2);
+    int face = axis * 2 + (n[axis] < 0 ? 1 : 0);
+    return (key << 3 | static_cast<uint64_t>(face)) + 1;
+}
+
+RadianceCache::Entry* RadianceCache::find(uint64_t key, bool insert) {
+    uint64_t slot = mix64(key) & mask;
+    for (int probe = 0; probe <= MAX_PROBES; ++probe, slot = (slot + 1) & mask) {
+        Entry& e = entries[slot];
+        uint64_t current = e.key.load(std::memory_order_acquire);
+        if (current == 0) {
+            if (!insert) return nullptr;
+            // Claim the slot; if another worker got there first, current now holds its key.
+            if (e.key.compare_exchange_strong(current, key, std::memory_order_acq_rel)) return &e;
+        }
+        if (current == key) return &e;
+    }
+    return nullptr;
+}
+
+void RadianceCache::insert(const point3& p, const vec3& n, const color& radiance) {
+    Entry* e = find(keyOf(p, n), true);
+    if (e == nullptr) return; // neighbourhood of the table full: drop the sample
+    for (int c = 0; c < 3; ++c) {
+        double value = std::clamp(static_cast<double>(radiance[c]), 0.0, MAX_RADIANCE);
+        if (std::isnan(value)) value = 0;
+        e->sum[c].fetch_add(static_cast<uint64_t>(value * FIXED_ONE), std::memory_order_relaxed);
+    }
+    e->count.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool RadianceCache::lookup(const point3& p, const vec3& n, color& radiance) {
+    Counter& counter = counters[counterIndex(COUNTERS)];
+    counter.lookups.fetch_add(1, std::memory_order_relaxed);
+    Entry* e = find(keyOf(p, n), false);
+    if (e == nullptr) return false;
+    uint32_t count = e->count.load(std::memory_order_relaxed);
+    if (count < static_cast<uint32_t>(min_samples)) return false;
+    double scale = 1.0 / (FIXED_ONE * count);
+    radiance = color(e->sum[0].load(std::memory_order_relaxed) * scale,
+                     e->sum[1].load(std::memory_order_relaxed) * scale,
+                     e->sum[2].load(std::memory_order_relaxed) * scale);
+    counter.hits.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+size_t RadianceCache::memoryBytes() const {
+    return (mask + 1) * sizeof(Entry);
+}
+
+size_t RadianceCache::cells() const {
+    size_t used = 0;
+    for (uint64_t i = 0; i <= mask; ++i) {
+        if (entries[i].key.load(std::memory_order_relaxed) != 0) used += 1;
+    }
+    return used;
+}
+
+uint64_t RadianceCache::lookups() const {
+    uint64_t total = 0;
+    for (const Counter& c : counters) total += c.lookups.load(std::memory_order_relaxed);
+    return total;
+}
+
+uint64_t RadianceCache::hits() const {
+    uint64_t total = 0;
+    for (const Counter& c : counters) total += c.hits.load(std::memory_order_relaxed);
+    return total;
+}
@@ -0,0 +1,77 @@
+#include "ray_binner.hh"
+#include <algorithm>
+
+RayBinner::RayBinner(const RTCBounds& bounds, int packet_size)
+        : packet_size{packet_size}, bins(CELLS*CELLS*CELLS*8), in_full(CELLS*CELLS*CELLS*8, 0) {
+    const float lo[3] = { bounds.lower_x, bounds.lower_y, bounds.lower_z };
+    const float hi[3] = { bounds.upper_x, bounds.upper_y, bounds.upper_z };
+    for (int a = 0; a < 3; ++a) {
+        float extent = hi[a] - lo[a];
+        // An empty scene reports inverted bounds: put every origin in cell 0 along that axis.
+        lower[a] = extent > 0 ? lo[a] : 0;
+        cell_scale[a] = extent > 0 ? CELLS / extent : 0;
+    }
+    for (auto& bin : bins) bin.reserve(packet_size);
+}
+
+int RayBinner::binOf(const ray& r) const {
+    const vec3 o = r.origin();
+    const vec3 d = r.direction();
+    int cell = 0;
+    for (int a = 0; a < 3; ++a) {
+        int c = static_cast<int>((o[a] - lower[a]) * cell_scale[a]);
+        cell = cell * CELLS + std::min(std::max(c, 0), CELLS - 1);
+    }
+    int octant = (d.x() < 0 ? 1 : 0) | (d.y() < 0 ? 2 : 0) | (d.z() < 0 ? 4 : 0);
+    return cell * 8 + octant;
+}
+
+void RayBinner::push(const RayQueue& r) {
+    int bin = binOf(r.r);
+    bins[bin].push_back(r);
+    pending_rays += 1;
+    if (!in_full[bin] && static_cast<int>(bins[bin].size()) >= packet_size) {
+        full.push_back(bin);
+        in_full[bin] = 1;
+    }
+}
+
+void RayBinner::take(int bin, std::vector<RayQueue>& current, int mask[], int& lane) {
+    std::vector<RayQueue>& source = bins[bin];
+    for (; lane < packet_size && !source.empty(); ++lane) {
+        if (mask[lane] != 0) continue;
+        current[lane] = source.back();
+        source.pop_back();
+        mask[lane] = -1;
+        pending_rays -= 1;
+    }
+}
+
+void RayBinner::refill(std::vector<RayQueue>& current, int mask[], std::vector<RayQueue>& primary) {
+    int lane = 0;
+    while (lane < packet_size && mask[lane] != 0) ++lane;
+    if (lane == packet_size) return;
+
+    while (lane < packet_size && !full.empty()) {
+        int bin = full.back();
+        take(bin, current, mask, lane);
+        if (static_cast<int>(bins[bin].size()) < packet_size) {
+            full.pop_back();
+            in_full[bin] = 0;
+        }
+    }
+
+    for (; lane < packet_size && !primary.empty(); ++lane) {
+        if (mask[lane] != 0) continue;
+        current[lane] = primary.back();
+        primary.pop_back();
+        mask[lane] = -1;
+    }
+
+    while (lane < packet_size && pending_rays > 0) {
+        while (bins[cursor].empty()) cursor = (cursor + 1) % bins.size();
+        take(cursor, current, mask, lane);
+    }
+}
+
+size_t RayBinner::pending() const { return pending_rays; }
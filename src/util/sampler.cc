@@ -0,0 +1,233 @@
+#include "sampler.hh"
+#include "general.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+SamplerType parseSamplerType(const std::string& name) {
+    if (name == "random") return SamplerType::Random;
+    if (name == "stratified") return SamplerType::Stratified;
+    if (name == "sobol") return SamplerType::Sobol;
+    if (name == "bluenoise") return SamplerType::BlueNoise;
+    throw std::invalid_argument("Unknown sampler '" + name + "' [random|stratified|sobol|bluenoise]");
+}
+
+std::string samplerName(SamplerType type) {
+    switch (type) {
+        case SamplerType::Stratified: return "stratified";
+        case SamplerType::Sobol: return "sobol";
+        case SamplerType::BlueNoise: return "bluenoise";
+        default: return "random";
+    }
+}
+
+ScatterSample Sampler::scatter(uint32_t pixel, uint32_t index, uint32_t bounce) const {
+    ScatterSample sample;
+    uint32_t base = DIM_BOUNCE + bounce * DIMS_PER_BOUNCE;
+    get2D(pixel, index, base, sample.u, sample.v);
+    sample.w = get1D(pixel, index, base + 2);
+    return sample;
+}
+
+void Sampler::light(uint32_t pixel, uint32_t index, uint32_t bounce, double& u, double& v) const {
+    get2D(pixel, index, DIM_BOUNCE + bounce * DIMS_PER_BOUNCE + 3, u, v);
+}
+
+void Sampler::emitter(uint32_t pixel, uint32_t index, uint32_t bounce, double& u, double& v) const {
+    get2D(pixel, index, DIM_BOUNCE + bounce * DIMS_PER_BOUNCE + 5, u, v);
+}
+
+std::unique_ptr<Sampler> Sampler::create(SamplerType type, int samples_per_pixel, int image_width) {
+    switch (type) {
+        case SamplerType::Stratified: return std::make_unique<StratifiedSampler>(samples_per_pixel);
+        case SamplerType::Sobol: return std::make_unique<SobolSampler>();
+        case SamplerType::BlueNoise: return std::make_unique<BlueNoiseSampler>(image_width);
+        default: return std::make_unique<RandomSampler>();
+    }
+}
+
+// HASHING AND SCRAMBLING HELPERS
+
+// 32-bit integer mix with good avalanche (Wellons' lowbias32).
+static uint32_t hash32(uint32_t x) {
+    x ^= x >> 16; x *= 0x7feb352du;
+    x ^= x >> 15; x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+static uint32_t hashCombine(uint32_t seed, uint32_t value) {
+    return hash32(seed ^ (value + 0x9e3779b9u + (seed << 6) + (seed >> 2)));
+}
+
+// Maps 32 random bits to [0,1). The largest result stays below 1 after rounding to double.
+static double toUnit(uint32_t bits) {
+    return std::min(bits * (1.0 / 4294967296.0), 0.99999999999999989);
+}
+
+static uint32_t reverseBits(uint32_t x) {
+    x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+    x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+    x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+    x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+    return (x >> 16) | (x << 16);
+}
+
+// Nested uniform (Owen) scramble of the bits of x, most significant bit first.
+static uint32_t owenScramble(uint32_t x, uint32_t seed) {
+    x = reverseBits(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return reverseBits(x);
+}
+
+// First two dimensions of the Sobol sequence, as 32-bit fractions.
+static uint32_t sobol0(uint32_t index) { return reverseBits(index); }
+
+static uint32_t sobol1(uint32_t index) {
+    uint32_t result = 0;
+    for (uint32_t v = 1u << 31; index != 0; index >>= 1, v ^= v >> 1) {
+        if (index & 1) result ^= v;
+    }
+    return result;
+}
+
+// Owen-scrambled Sobol point of the given (already shuffled) index, scrambled by seed.
+static void scrambledSobol2D(uint32_t index, uint32_t seed, double& u, double& v) {
+    u = toUnit(owenScramble(sobol0(index), hashCombine(seed, 0xa511e9b3u)));
+    v = toUnit(owenScramble(sobol1(index), hashCombine(seed, 0x63d83595u)));
+}
+
+// Kensler's hash-based permutation of [0, n): i-th element of a permutation selected by seed.
+static uint32_t permute(uint32_t i, uint32_t n, uint32_t seed) {
+    if (n <= 1) return 0;
+    uint32_t w = n - 1;
+    w |= w >> 1; w |= w >> 2; w |= w >> 4; w |= w >> 8; w |= w >> 16;
+    do {
+        i ^= seed; i *= 0xe170893du;
+        i ^= seed >> 16;
+        i ^= (i & w) >> 4;
+        i ^= seed >> 8; i *= 0x0929eb3fu;
+        i ^= seed >> 23;
+        i ^= (i & w) >> 1; i *= 1 | seed >> 27;
+        i *= 0x6935fa69u;
+        i ^= (i & w) >> 11; i *= 0x74dcb303u;
+        i ^= (i & w) >> 2; i *= 0x9e501cc3u;
+        i ^= (i & w) >> 2; i *= 0xc860a3dfu;
+        i &= w;
+        i ^= i >> 5;
+    } while (i >= n);
+    return (i + seed) % n;
+}
+
+// RANDOM
+
+void RandomSampler::get2D(uint32_t pixel, uint32_t index, uint32_t dim, double& u, double& v) const {
+    u = random_double();
+    v = random_double();
+}
+
+double RandomSampler::get1D(uint32_t pixel, uint32_t index, uint32_t dim) const { return random_double(); }
+
+// STRATIFIED
+
+StratifiedSampler::StratifiedSampler(int samples_per_pixel)
+        : samples{static_cast<uint32_t>(std::max(samples_per_pixel, 1))},
+          grid{static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(std::max(samples_per_pixel, 1)))))} {}
+
+void StratifiedSampler::get2D(uint32_t pixel, uint32_t index, uint32_t dim, double& u, double& v) const {
+    uint32_t seed = hashCombine(hash32(pixel), dim);
+    uint32_t cells = grid * grid;
+    uint32_t cell = permute(index % cells, cells, seed);
+    uint32_t jitter = hashCombine(seed, index);
+    u = ((cell % grid) + toUnit(jitter)) / grid;
+    v = ((cell / grid) + toUnit(hash32(jitter))) / grid;
+}
+
+double StratifiedSampler::get1D(uint32_t pixel, uint32_t index, uint32_t dim) const {
+    uint32_t seed = hashCombine(hash32(pixel), dim);
+    uint32_t cell = permute(index % samples, samples, seed);
+    return (cell + toUnit(hashCombine(seed, index))) / samples;
+}
+
+// SOBOL
+
+void SobolSampler::get2D(uint32_t pixel, uint32_t index, uint32_t dim, double& u, double& v) const {
+    // Each dimension pair gets its own scramble and sample order, which decorrelates the padded pairs.
+    uint32_t seed = hashCombine(hash32(pixel), dim);
+    uint32_t shuffled = owenScramble(index, seed);
+    scrambledSobol2D(shuffled, hash32(seed), u, v);
+}
+
+double SobolSampler::get1D(uint32_t pixel, uint32_t index, uint32_t dim) const {
+    uint32_t seed = hashCombine(hash32(pixel), dim);
+    uint32_t shuffled = owenScramble(index, seed);
+    return toUnit(owenScramble(sobol0(shuffled), hash32(seed)));
+}
+
+// BLUE NOISE
+
+// Ranks of a 64x64 tileable blue-noise mask, normalised to (0,1). Built once with the void-and-cluster
+// method's incremental phase: every next pixel goes into the largest remaining void, measured by a
+// Gaussian energy on the torus.
+static const std::vector<float>& blueNoiseMask() {
+    static const std::vector<float> mask = []() {
+        const int N = 64, S = N * N;
+        const double sigma = 1.9;
+
+        std::vector<double> kernel(S);
+        for (int dy = 0; dy < N; ++dy) {
+            for (int dx = 0; dx < N; ++dx) {
+                int wx = std::min(dx, N - dx), wy = std::min(dy, N - dy);
+                kernel[dy * N + dx] = std::exp(-(wx * wx + wy * wy) / (2 * sigma * sigma));
+            }
+        }
+
+        std::vector<double> energy(S);
+        for (int i = 0; i < S; ++i) energy[i] = toUnit(hash32(i)) * 1e-6; // breaks ties without a visible pattern
+        std::vector<char> taken(S, 0);
+        std::vector<float> ranks(S);
+        for (int rank = 0; rank < S; ++rank) {
+            int best = -1;
+            for (int i = 0; i < S; ++i) {
+                if (!taken[i] && (best < 0 || energy[i] < energy[best])) best = i;
+            }
+            taken[best] = 1;
+            ranks[best] = (rank + 0.5f) / S;
+            int bx = best % N, by = best / N;
+            for (int y = 0; y < N; ++y) {
+                const double* row = &kernel[((y - by + N) % N) * N];
+                for (int x = 0; x < N; ++x) energy[y * N + x] += row[(x - bx + N) % N];
+            }
+        }
+        return ranks;
+    }();
+    return mask;
+}
+
+BlueNoiseSampler::BlueNoiseSampler(int image_width)
+        : width{static_cast<uint32_t>(std::max(image_width, 1))}, mask{blueNoiseMask()} {}
+
+double BlueNoiseSampler::offset(uint32_t pixel, uint32_t dim) const {
+    // A different toroidal shift of the mask per dimension keeps the dimensions' offsets uncorrelated.
+    uint32_t shift = hash32(dim + 1);
+    uint32_t x = (pixel % width + (shift & 63)) & 63;
+    uint32_t y = (pixel / width + ((shift >> 6) & 63)) & 63;
+    return mask[y * 64 + x];
+}
+
+void BlueNoiseSampler::get2D(uint32_t pixel, uint32_t index, uint32_t dim, double& u, double& v) const {
+    scrambledSobol2D(index, hash32(dim), u, v);
+    u += offset(pixel, dim);
+    v += offset(pixel, dim + 1);
+    if (u >= 1) u -= 1;
+    if (v >= 1) v -= 1;
+}
+
+double BlueNoiseSampler::get1D(uint32_t pixel, uint32_t index, uint32_t dim) const {
+    double u = toUnit(owenScramble(sobol0(index), hash32(dim))) + offset(pixel, dim);
+    return u >= 1 ? u - 1 : u;
+}
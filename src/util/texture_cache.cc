@@ -0,0 +1,264 @@
+#include "texture_cache.hh"
+
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include "hash.hh"
+#include "stb_image.h"
+
+// On-disk layout of a .ctex file: CTexHeader, ImageLevel[level_count], padding to 16 bytes, pixels.
+namespace {
+    const char CTEX_MAGIC[4] = {'C', 'T', 'E', 'X'};
+    const uint32_t CTEX_VERSION = 1;
+
+    struct CTexHeader {
+        char magic[4];
+        uint32_t version;
+        int32_t bytes_per_pixel;
+        int32_t tile;
+        uint32_t level_count;
+        uint32_t reserved;
+        uint64_t pixel_offset;
+        uint64_t pixel_size;
+    };
+
+    uint64_t levelBytes(const ImageLevel& level, int bytes_per_pixel) {
+        int tiles_y = (level.height + ImageData::TILE - 1) / ImageData::TILE;
+        return static_cast<uint64_t>(level.tiles_x) * tiles_y * ImageData::TILE * ImageData::TILE * bytes_per_pixel;
+    }
+}
+
+std::shared_ptr<ImageData> ImageData::fromLinear(const unsigned char* linear, int width, int height, int bytes_per_pixel) {
+    auto data = std::make_shared<ImageData>();
+    data->bytes_per_pixel = bytes_per_pixel;
+
+    // Lay out the level table first so the storage can be allocated once.
+    uint64_t total = 0;
+    for (int w = width, h = height; ; w = std::max(1, w / 2), h = std::max(1, h / 2)) {
+        ImageLevel level = { w, h, (w + TILE - 1) / TILE, total };
+        data->levels.push_back(level);
+        total += levelBytes(level, bytes_per_pixel);
+        if (w == 1 && h == 1) break;
+    }
+    data->owned.assign(total, 0);
+    data->pixels = data->owned.data();
+    unsigned char* out = data->owned.data();
+
+    // Level 0: scatter the row-major source into tiles.
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            unsigned char* dst = out + (data->texel(x, y) - data->pixels);
+            std::memcpy(dst, linear + (static_cast<uint64_t>(y) * width + x) * bytes_per_pixel, bytes_per_pixel);
+        }
+    }
+
+    // Remaining levels: 2x2 box filter of the previous level, clamping at odd edges.
+    for (size_t l = 1; l < data->levels.size(); ++l) {
+        const ImageLevel& prev = data->levels[l - 1];
+        const ImageLevel& cur = data->levels[l];
+        for (int y = 0; y < cur.height; ++y) {
+            for (int x = 0; x < cur.width; ++x) {
+                int x0 = std::min(2*x, prev.width - 1), x1 = std::min(2*x + 1, prev.width - 1);
+                int y0 = std::min(2*y, prev.height - 1), y1 = std::min(2*y + 1, prev.height - 1);
+                const unsigned char* a = data->texel(x0, y0, l - 1);
+                const unsigned char* b = data->texel(x1, y0, l - 1);
+                const unsigned char* c = data->texel(x0, y1, l - 1);
+                const unsigned char* d = data->texel(x1, y1, l - 1);
+                unsigned char* dst = out + (data->texel(x, y, l) - data->pixels);
+                for (int ch = 0; ch < bytes_per_pixel; ++ch) dst[ch] = (a[ch] + b[ch] + c[ch] + d[ch] + 2) / 4;
+            }
+        }
+    }
+    return data;
+}
+
+TextureCache& TextureCache::shared() {
+    static TextureCache cache;
+    return cache;
+}
+
+void TextureCache::setDiskCache(const std::string& directory) {
+    std::lock_guard<std::mutex> lock(mutex);
+    disk_cache = directory;
+    if (!disk_cache.empty()) mkdir(disk_cache.c_str(), 0755); // fine if it already exists
+}
+
+TextureCache::Stats TextureCache::stats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return counters;
+}
+
+std::string TextureCache::resolvePath(const std::string& filename) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = resolved_paths.find(filename);
+        if (found != resolved_paths.end()) return found->second;
+    }
+
+    // Same search order image has always used: the IMAGES directory, then the path as given.
+    struct stat st;
+    std::string resolved;
+    auto imagedir = getenv("IMAGES");
+    if (imagedir && stat((std::string(imagedir) + "/" + filename).c_str(), &st) == 0) resolved = std::string(imagedir) + "/" + filename;
+    else if (stat(filename.c_str(), &st) == 0) resolved = filename;
+
+    // Only successes are remembered, so a file that appears later is still found.
+    if (resolved.empty()) return resolved;
+    std::lock_guard<std::mutex> lock(mutex);
+    resolved_paths[filename] = resolved;
+    return resolved;
+}
+
+bool TextureCache::contentHash(const std::string& path, uint64_t& hash) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = file_ids.find(path);
+        if (found != file_ids.end() && found->second.size == st.st_size && found->second.mtime_sec == st.st_mtim.tv_sec
+            && found->second.mtime_nsec == st.st_mtim.tv_nsec) {
+            hash = found->second.hash;
+            return true;
+        }
+    }
+    try {
+        hash = hashFile(path);
+    } catch (const std::runtime_error&) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    file_ids[path] = FileId{ static_cast<int64_t>(st.st_size), static_cast<int64_t>(st.st_mtim.tv_sec),
+                             static_cast<int64_t>(st.st_mtim.tv_nsec), hash };
+    return true;
+}
+
+std::string TextureCache::diskPath(const Key& key) const {
+    return disk_cache + "/" + hashToHex(key.first) + "-" + std::to_string(key.second) + ".ctex";
+}
+
+std::shared_ptr<const ImageData> TextureCache::get(const std::string& filename, int bytes_per_pixel) {
+    std::string path = resolvePath(filename);
+    uint64_t hash;
+    if (path.empty() || !contentHash(path, hash)) return nullptr;
+    Key key(hash, bytes_per_pixel);
+
+    std::promise<std::shared_ptr<const ImageData>> promise;
+    std::string disk_file;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        counters.requests++;
+
+        auto found = entries.find(key);
+        if (found != entries.end()) {
+            if (auto alive = found->second.lock()) {
+                counters.shared++;
+                return alive;
+            }
+        }
+        // Another thread is already decoding the same contents: wait for its result.
+        auto pending = in_flight.find(key);
+        if (pending != in_flight.end()) {
+            auto result = pending->second;
+            counters.shared++;
+            lock.unlock();
+            return result.get();
+        }
+        in_flight[key] = promise.get_future().share();
+        if (!disk_cache.empty()) disk_file = diskPath(key);
+    }
+
+    std::shared_ptr<const ImageData> data;
+    if (!disk_file.empty()) data = loadFromDisk(disk_file, bytes_per_pixel);
+    bool from_disk = data != nullptr;
+
+    if (!data) {
+        int width, height, n;
+        unsigned char* linear = stbi_load(path.c_str(), &width, &height, &n, bytes_per_pixel);
+        if (linear) {
+            auto decoded = ImageData::fromLinear(linear, width, height, bytes_per_pixel);
+            stbi_image_free(linear);
+            if (!disk_file.empty()) writeToDisk(disk_file, *decoded);
+            data = decoded;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (data) {
+            entries[key] = data;
+            if (from_disk) counters.disk_hits++;
+            else counters.decodes++;
+        }
+        in_flight.erase(key);
+    }
+    promise.set_value(data);
+    return data;
+}
+
+std::shared_ptr<const ImageData> TextureCache::loadFromDisk(const std::string& path, int bytes_per_pixel) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return nullptr;
+
+    std::shared_ptr<MappedFile> mapping;
+    try {
+        mapping = std::make_shared<MappedFile>(path);
+    } catch (const std::runtime_error&) {
+        return nullptr;
+    }
+
+    // Anything unexpected just means the entry is stale or truncated; fall back to decoding.
+    if (mapping->size() < sizeof(CTexHeader)) return nullptr;
+    const CTexHeader* header = reinterpret_cast<const CTexHeader*>(mapping->data());
+    if (std::memcmp(header->magic, CTEX_MAGIC, 4) != 0 || header->version != CTEX_VERSION
+        || header->bytes_per_pixel != bytes_per_pixel || header->tile != ImageData::TILE || header->level_count == 0
+        || sizeof(CTexHeader) + header->level_count * sizeof(ImageLevel) > header->pixel_offset
+        || header->pixel_offset + header->pixel_size > mapping->size()) {
+        return nullptr;
+    }
+
+    auto data = std::make_shared<ImageData>();
+    data->bytes_per_pixel = bytes_per_pixel;
+    const ImageLevel* levels = reinterpret_cast<const ImageLevel*>(mapping->data() + sizeof(CTexHeader));
+    data->levels.assign(levels, levels + header->level_count);
+    for (const ImageLevel& level : data->levels) {
+        if (level.width <= 0 || level.height <= 0 || level.offset + levelBytes(level, bytes_per_pixel) > header->pixel_size) return nullptr;
+    }
+    data->pixels = reinterpret_cast<const unsigned char*>(mapping->data() + header->pixel_offset);
+    data->mapping = mapping;
+    return data;
+}
+
+void TextureCache::writeToDisk(const std::string& path, const ImageData& data) {
+    CTexHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, CTEX_MAGIC, 4);
+    header.version = CTEX_VERSION;
+    header.bytes_per_pixel = data.bytes_per_pixel;
+    header.tile = ImageData::TILE;
+    header.level_count = data.levels.size();
+    header.pixel_offset = (sizeof(CTexHeader) + data.levels.size() * sizeof(ImageLevel) + 15) / 16 * 16;
+    header.pixel_size = data.owned.size();
+
+    // Write under a temporary name and rename, so concurrent renders never map a partial file. The name is
+    // unique to this process (renderers may share --texture-cache) and to this image within it.
+    std::string temp = path + ".tmp" + std::to_string(getpid()) + "." + std::to_string(reinterpret_cast<uintptr_t>(&data));
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) return;
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(data.levels.data()), data.levels.size() * sizeof(ImageLevel));
+        const char zeros[16] = {};
+        out.write(zeros, header.pixel_offset - sizeof(header) - data.levels.size() * sizeof(ImageLevel));
+        out.write(reinterpret_cast<const char*>(data.owned.data()), data.owned.size());
+        if (!out.good()) {
+            std::remove(temp.c_str());
+            return;
+        }
+    }
+    if (std::rename(temp.c_str(), path.c_str()) != 0) std::remove(temp.c_str());
+}
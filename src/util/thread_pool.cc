@@ -0,0 +1,135 @@
+#include "thread_pool.hh"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+    struct SharedPoolSettings {
+        int threads = 0;
+        bool pin = false;
+        bool created = false;
+    };
+
+    SharedPoolSettings& sharedSettings() {
+        static SharedPoolSettings settings;
+        return settings;
+    }
+
+    // Parses a sysfs CPU list such as "0-7,16-23".
+    std::vector<int> parseCpuList(const std::string& list) {
+        std::vector<int> cpus;
+        std::stringstream in(list);
+        std::string range;
+        while (std::getline(in, range, ',')) {
+            if (range.empty() || range == "\n") continue;
+            size_t dash = range.find('-');
+            try {
+                int first = std::stoi(range.substr(0, dash));
+                int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+                for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+            } catch (const std::exception&) {
+                return std::vector<int>();
+            }
+        }
+        return cpus;
+    }
+
+    // CPUs of every NUMA node, node by node. Falls back to a single node of all hardware threads.
+    std::vector<std::vector<int>> numaTopology() {
+        std::vector<std::vector<int>> nodes;
+        for (int node = 0; ; ++node) {
+            std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            if (!file.is_open()) break;
+            std::string list;
+            std::getline(file, list);
+            std::vector<int> cpus = parseCpuList(list);
+            if (!cpus.empty()) nodes.push_back(cpus);
+        }
+        if (nodes.empty()) {
+            nodes.emplace_back();
+            for (unsigned cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); ++cpu) nodes.back().push_back(cpu);
+        }
+        return nodes;
+    }
+}
+
+ThreadPool::ThreadPool(int threads, bool pin) : pin_workers{pin} {
+    if (threads <= 0) threads = std::max(1u, std::thread::hardware_concurrency());
+
+    // Spread the workers evenly over all CPUs, which are listed node by node.
+    std::vector<std::vector<int>> topology = numaTopology();
+    std::vector<std::pair<int, int>> cpus; // (cpu, node)
+    for (size_t node = 0; node < topology.size(); ++node) {
+        for (int cpu : topology[node]) cpus.emplace_back(cpu, node);
+    }
+    node_count = topology.size();
+
+    workers = std::vector<Worker>(threads);
+    for (int i = 0; i < threads; ++i) {
+        const auto& slot = cpus[(static_cast<size_t>(i) * cpus.size() / threads) % cpus.size()];
+        workers[i].cpu = slot.first;
+        workers[i].node = slot.second;
+    }
+    for (int i = 0; i < threads; ++i) workers[i].thread = std::thread(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        stopping = true;
+    }
+    queue_cv.notify_all();
+    for (auto& worker : workers) worker.thread.join();
+}
+
+int ThreadPool::size() const { return workers.size(); }
+
+int ThreadPool::node(int worker) const { return workers[worker].node; }
+
+int ThreadPool::nodeCount() const { return node_count; }
+
+bool ThreadPool::pinned() const { return pin_workers; }
+
+bool ThreadPool::configureShared(int threads, bool pin) {
+    SharedPoolSettings& settings = sharedSettings();
+    if (settings.created) return false;
+    settings.threads = threads;
+    settings.pin = pin;
+    return true;
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool([] { sharedSettings().created = true; return sharedSettings().threads; }(), sharedSettings().pin);
+    return pool;
+}
+
+void ThreadPool::workerLoop(int index) {
+#ifdef __linux__
+    if (pin_workers) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(workers[index].cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set); // best effort: keep running unpinned on failure
+    }
+#endif
+
+    std::queue<std::function<void()>>& own = workers[index].tasks;
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_cv.wait(lock, [this, &own] { return stopping || !own.empty() || !tasks.empty(); });
+            if (stopping && own.empty() && tasks.empty()) return;
+            std::queue<std::function<void()>>& source = own.empty() ? tasks : own;
+            task = std::move(source.front());
+            source.pop();
+        }
+        task();
+    }
+}
@@ -119,6 +119,30 @@ vec3 random_in_unit_disk() {
     return rand_vec.unit_vector();
 }
 
+vec3 sample_unit_vector(double u, double v) {
+    double z = 1 - 2*u;
+    double r = sqrt(fmax(0.0, 1 - z*z));
+    double phi = 2*pi*v;
+    return vec3(r*cos(phi), r*sin(phi), z);
+}
+
+vec3 sample_in_unit_sphere(double u, double v, double w) { return sample_unit_vector(u, v) * std::cbrt(w); }
+
+vec3 sample_in_hemisphere(const vec3& normal, double u, double v) {
+    vec3 direction = sample_unit_vector(u, v);
+    return dot(direction, normal) > 0.0 ? direction : -direction;
+}
+
+vec3 sample_in_unit_disk(double u, double v) {
+    // Shirley-Chiu concentric mapping: keeps the strata of (u, v) compact on the disk.
+    double a = 2*u - 1, b = 2*v - 1;
+    if (a == 0 && b == 0) return vec3(0, 0, 0);
+    double r, theta;
+    if (fabs(a) > fabs(b)) { r = a; theta = (pi/4) * (b/a); }
+    else                   { r = b; theta = (pi/2) - (pi/4) * (a/b); }
+    return vec3(r*cos(theta), r*sin(theta), 0);
+}
+
 vec3 reflect(const vec3& v, const vec3& n) { return v - 2*n * dot(v, n); }
 
 vec3 refract(const vec3& uv, const vec3& n, float etai_over_etat) {
@@ -13,4 +13,8 @@ fi
 
 for file in "$tests_dir"/*.csr; do
     "$executable" -i "$file" -t png -o "$test_outputs_dir/$(basename "$file" .csr).png" -s 2 -d 2 -V
-done
\ No newline at end of file
+done
+
+# Compiled scenes: the same scene through --compile and the .csrb loader.
+"$executable" --compile "$tests_dir/build_options.csr" -o "$test_outputs_dir/build_options.csrb" -V
+"$executable" -i "$test_outputs_dir/build_options.csrb" -t png -o "$test_outputs_dir/build_options_compiled.png" -s 2 -d 2 -V